@@ -6,9 +6,16 @@ BINARIES_FOLDER="./shaders/"
 
 # raygen shaders
 $GLSL_COMPILER --target-env vulkan1.2 -V -S rgen "${SOURCE_FOLDER}ray_gen.glsl" -o "${BINARIES_FOLDER}ray_gen.bin"
+# instrumented variant, counts the rays (--ray-stats)
+$GLSL_COMPILER --target-env vulkan1.2 -V -S rgen -DRAY_STATS "${SOURCE_FOLDER}ray_gen.glsl" -o "${BINARIES_FOLDER}ray_gen_stats.bin"
+# shader clock variants, the cost heatmap shows real time instead of trace counts (VK_KHR_shader_clock)
+$GLSL_COMPILER --target-env vulkan1.2 -V -S rgen -DSHADER_CLOCK "${SOURCE_FOLDER}ray_gen.glsl" -o "${BINARIES_FOLDER}ray_gen_clock.bin"
+$GLSL_COMPILER --target-env vulkan1.2 -V -S rgen -DRAY_STATS -DSHADER_CLOCK "${SOURCE_FOLDER}ray_gen.glsl" -o "${BINARIES_FOLDER}ray_gen_stats_clock.bin"
 
-# closest-hit shaders
+# closest-hit shaders, one per material type
 $GLSL_COMPILER --target-env vulkan1.2 -V -S rchit "${SOURCE_FOLDER}ray_chit.glsl" -o "${BINARIES_FOLDER}ray_chit.bin"
+$GLSL_COMPILER --target-env vulkan1.2 -V -S rchit "${SOURCE_FOLDER}ray_chit_mirror.glsl" -o "${BINARIES_FOLDER}ray_chit_mirror.bin"
+$GLSL_COMPILER --target-env vulkan1.2 -V -S rchit "${SOURCE_FOLDER}ray_chit_dielectric.glsl" -o "${BINARIES_FOLDER}ray_chit_dielectric.bin"
 $GLSL_COMPILER --target-env vulkan1.2 -V -S rchit "${SOURCE_FOLDER}shadow_ray_chit.glsl" -o "${BINARIES_FOLDER}shadow_ray_chit.bin"
 
 # miss shaders
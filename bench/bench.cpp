@@ -0,0 +1,162 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+
+static volatile uint64_t sSink = 0;
+
+static String FormatHeader() {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-40s %12s %12s %12s %16s\n", "Benchmark", "min us", "median us", "max us", "throughput");
+    return line;
+}
+
+static String FormatRow(const BenchRunner::Result& result) {
+    String throughput;
+    if (result.itemsPerIteration && result.medianNs > 0.0) {
+        // millions per second read better than raw numbers at these sizes
+        const double itemsPerSecond = static_cast<double>(result.itemsPerIteration) * 1e9 / result.medianNs;
+        throughput = ToString(itemsPerSecond * 1e-6, 2) + " M" + result.itemsUnit + "/s";
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-40s %12.3f %12.3f %12.3f %16s\n", result.name.c_str(),
+                  result.minNs * 1e-3, result.medianNs * 1e-3, result.maxNs * 1e-3, throughput.c_str());
+    return line;
+}
+
+static double TimeNs(const BenchRunner::Func& func, const uint64_t iterations) {
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        func();
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+BenchRunner::BenchRunner()
+    : mNumBatches(10)
+    , mMinBatchTimeMs(20.0)
+{
+}
+
+void BenchRunner::SetFilter(const String& filter) {
+    mFilter = filter;
+}
+
+void BenchRunner::SetNumBatches(const uint32_t numBatches) {
+    mNumBatches = Max(numBatches, 1u);
+}
+
+void BenchRunner::SetMinBatchTime(const double ms) {
+    mMinBatchTimeMs = Max(ms, 0.0);
+}
+
+void BenchRunner::Add(const String& name, const uint64_t itemsPerIteration, const String& itemsUnit, Func func) {
+    mCases.push_back({ name, itemsPerIteration, itemsUnit, std::move(func) });
+}
+
+void BenchRunner::Skip(const String& name, const String& reason) {
+    if (this->PassesFilter(name)) {
+        mSkipped.push_back({ name, reason });
+    }
+}
+
+void BenchRunner::RunAll() {
+    mResults.clear();
+
+    // rows are printed as they finish, the long cases would look like a hang otherwise
+    std::printf("%s", FormatHeader().c_str());
+
+    for (const Case& benchCase : mCases) {
+        if (!this->PassesFilter(benchCase.name)) {
+            continue;
+        }
+
+        // the first run warms the caches up and tells how long one iteration takes
+        const double firstNs = Max(TimeNs(benchCase.func, 1), 1.0);
+        const uint64_t batchIterations = Max<uint64_t>(1, static_cast<uint64_t>(mMinBatchTimeMs * 1e6 / firstNs));
+
+        Array<double> samples(mNumBatches);
+        for (double& sample : samples) {
+            sample = TimeNs(benchCase.func, batchIterations) / static_cast<double>(batchIterations);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        double sum = 0.0;
+        for (const double sample : samples) {
+            sum += sample;
+        }
+
+        Result result;
+        result.name = benchCase.name;
+        result.iterations = batchIterations * mNumBatches;
+        result.minNs = samples.front();
+        result.medianNs = samples[samples.size() / 2];
+        result.meanNs = sum / static_cast<double>(samples.size());
+        result.maxNs = samples.back();
+        result.itemsPerIteration = benchCase.itemsPerIteration;
+        result.itemsUnit = benchCase.itemsUnit;
+        mResults.push_back(result);
+
+        std::printf("%s", FormatRow(result).c_str());
+        std::fflush(stdout);
+    }
+
+    for (const auto& skipped : mSkipped) {
+        std::printf("%-40s skipped: %s\n", skipped.first.c_str(), skipped.second.c_str());
+    }
+}
+
+const Array<BenchRunner::Result>& BenchRunner::GetResults() const {
+    return mResults;
+}
+
+bool BenchRunner::WriteJSON(const String& fileName) const {
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < mResults.size(); ++i) {
+        const Result& result = mResults[i];
+        const double itemsPerSecond = (result.medianNs > 0.0) ? static_cast<double>(result.itemsPerIteration) * 1e9 / result.medianNs : 0.0;
+
+        file << (i ? ",\n" : "\n")
+             << "    { \"name\": \"" << EscapeJSON(result.name) << "\""
+             << ", \"iterations\": " << result.iterations
+             << ", \"minNs\": " << ToString(result.minNs, 1)
+             << ", \"medianNs\": " << ToString(result.medianNs, 1)
+             << ", \"meanNs\": " << ToString(result.meanNs, 1)
+             << ", \"maxNs\": " << ToString(result.maxNs, 1);
+        if (result.itemsPerIteration) {
+            file << ", \"itemsPerIteration\": " << result.itemsPerIteration
+                 << ", \"itemsUnit\": \"" << EscapeJSON(result.itemsUnit) << "\""
+                 << ", \"itemsPerSecond\": " << ToString(itemsPerSecond, 1);
+        }
+        file << " }";
+    }
+    file << (mResults.empty() ? "],\n" : "\n  ],\n");
+
+    file << "  \"skipped\": [";
+    for (size_t i = 0; i < mSkipped.size(); ++i) {
+        file << (i ? ",\n" : "\n")
+             << "    { \"name\": \"" << EscapeJSON(mSkipped[i].first) << "\", \"reason\": \"" << EscapeJSON(mSkipped[i].second) << "\" }";
+    }
+    file << (mSkipped.empty() ? "]\n" : "\n  ]\n");
+    file << "}\n";
+
+    return file.good();
+}
+
+void BenchRunner::Consume(const uint64_t value) {
+    sSink = sSink + value;
+}
+
+bool BenchRunner::PassesFilter(const String& name) const {
+    return mFilter.empty() || name.find(mFilter) != String::npos;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "framework/common.h"
+
+#include <functional>
+
+// Minimal micro-benchmark harness. Every case first runs once to find out how many iterations fill a batch,
+// then a number of batches are timed, the per-iteration times of the batches give min/median/mean/max.
+// Setup goes outside of the timed function, so every case runs on data that is already in memory.
+class BenchRunner {
+public:
+    using Func = std::function<void()>;
+
+    struct Result {
+        String      name;
+        uint64_t    iterations;         // over all the timed batches
+        double      minNs;              // per iteration
+        double      medianNs;
+        double      meanNs;
+        double      maxNs;
+        uint64_t    itemsPerIteration;  // 0 - no throughput
+        String      itemsUnit;
+    };
+
+    BenchRunner();
+    ~BenchRunner() = default;
+
+    // only the cases with this in the name run
+    void                    SetFilter(const String& filter);
+    void                    SetNumBatches(const uint32_t numBatches);
+    void                    SetMinBatchTime(const double ms);
+
+    // items are what the throughput is counted in (faces, texels, ...)
+    void                    Add(const String& name, const uint64_t itemsPerIteration, const String& itemsUnit, Func func);
+    // a case that can't run here, e.g. its dataset is missing, still shows up in the report
+    void                    Skip(const String& name, const String& reason);
+
+    // prints every result as it finishes
+    void                    RunAll();
+
+    const Array<Result>&    GetResults() const;
+    bool                    WriteJSON(const String& fileName) const;
+
+    // keeps the compiler from throwing the benchmarked work away
+    static void             Consume(const uint64_t value);
+
+private:
+    struct Case {
+        String      name;
+        uint64_t    itemsPerIteration;
+        String      itemsUnit;
+        Func        func;
+    };
+
+    bool                    PassesFilter(const String& name) const;
+
+private:
+    String                                  mFilter;
+    uint32_t                                mNumBatches;
+    double                                  mMinBatchTimeMs;
+    Array<Case>                             mCases;
+    Array<Result>                           mResults;
+    Array<std::pair<String, String>>        mSkipped;       // name, reason
+};
+
+
+// same numbers on every platform and compiler, unlike the std distributions
+inline float BenchRandom(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+}
+
+// the suites, one per file
+void    AddSceneBenchmarks(BenchRunner& runner);
+void    AddImageBenchmarks(BenchRunner& runner);
+void    AddCameraBenchmarks(BenchRunner& runner);
@@ -0,0 +1,57 @@
+#include "bench.h"
+#include "framework/camera.h"
+#include "framework/camerapath.h"
+
+#include <cstring> // for memcpy
+#include <memory>
+
+
+static const String sCameraPathFile = "_data/benchmarks/fake_whitted_orbit.txt";
+static const uint32_t sNumUpdates = 1024;   // camera updates per iteration
+
+
+static uint64_t HashMatrix(const mat4& m) {
+    uint32_t bits;
+    std::memcpy(&bits, &m[3][0], sizeof(bits));
+    return bits;
+}
+
+
+void AddCameraBenchmarks(BenchRunner& runner) {
+    auto camera = std::make_shared<Camera>();
+    camera->SetViewport({ 0, 0, 1920, 1080 });
+    camera->SetViewPlanes(0.1f, 100.0f);
+    camera->SetFovY(45.0f);
+
+    // the same mouse look and WASD movement the app does every frame
+    runner.Add("camera/move_rotate", sNumUpdates, "updates", [camera]() {
+        camera->LookAt(vec3(0.25f, 3.20f, 6.15f), vec3(0.25f, 2.75f, 5.25f));
+        for (uint32_t i = 0; i < sNumUpdates; ++i) {
+            camera->Rotate(0.002f, (i & 1) ? 0.001f : -0.001f);
+            camera->Move(0.01f, 0.02f);
+        }
+        BenchRunner::Consume(HashMatrix(camera->GetTransform()));
+    });
+
+    runner.Add("camera/projection", sNumUpdates, "updates", [camera]() {
+        for (uint32_t i = 0; i < sNumUpdates; ++i) {
+            camera->SetFovY(40.0f + static_cast<float>(i & 15));
+        }
+        BenchRunner::Consume(HashMatrix(camera->GetProjection()));
+    });
+
+    auto path = std::make_shared<CameraPath>();
+    if (!path->Load(sCameraPathFile)) {
+        runner.Skip("camera/path_sample", "can't load " + sCameraPathFile);
+        return;
+    }
+
+    runner.Add("camera/path_sample", sNumUpdates, "samples", [path]() {
+        const float step = path->GetDuration() / static_cast<float>(sNumUpdates);
+        vec3 position(0.0f), target(0.0f);
+        for (uint32_t i = 0; i < sNumUpdates; ++i) {
+            path->Sample(static_cast<float>(i) * step, position, target);
+        }
+        BenchRunner::Consume(static_cast<uint64_t>(position.x * 1000.0f));
+    });
+}
@@ -0,0 +1,73 @@
+#include "bench.h"
+#include "framework/envmap.h"
+
+#include <memory>
+
+
+static const String sTextureFile = "_data/scenes/fake_whitted/concrete_floor_02_diff_1k.jpg";
+static const String sEnvFile = "_data/envs/studio_garden_2k.jpg";
+static const uint32_t sConvertSize = 1024;  // texels per side of the synthetic HDR image
+static const uint32_t sOctahedralSize = 1024;
+
+
+static void AddDecodeBenchmark(BenchRunner& runner, const String& name, const String& fileName) {
+    vulkanhelpers::ImageData probe;
+    if (!probe.Decode(fileName.c_str())) {
+        runner.Skip(name, "can't decode " + fileName);
+        return;
+    }
+
+    runner.Add(name, static_cast<uint64_t>(probe.width) * probe.height, "texels", [fileName]() {
+        vulkanhelpers::ImageData data;
+        data.Decode(fileName.c_str());
+        BenchRunner::Consume(data.pixels.size());
+    });
+}
+
+
+void AddImageBenchmarks(BenchRunner& runner) {
+    AddDecodeBenchmark(runner, "image/decode_jpg_1k", sTextureFile);
+    AddDecodeBenchmark(runner, "image/decode_jpg_2k", sEnvFile);
+
+    // HDR values from a fixed seed, a good share of them above what 8 bits could hold
+    const size_t numTexels = static_cast<size_t>(sConvertSize) * sConvertSize;
+    auto hdr = std::make_shared<Array<float>>(numTexels * 4);
+    uint32_t seed = 0x4D2u;
+    for (float& v : *hdr) {
+        const float r = BenchRandom(seed);
+        v = r * r * 16.0f;
+    }
+
+    auto half = std::make_shared<Array<uint16_t>>(numTexels * 4);
+    runner.Add("convert/rgba32f_to_rgba16f_1k", numTexels, "texels", [hdr, half, numTexels]() {
+        ConvertRGBA32FToRGBA16F(hdr->data(), half->data(), numTexels);
+        BenchRunner::Consume(half->back());
+    });
+
+    auto packed = std::make_shared<Array<uint32_t>>(numTexels);
+    runner.Add("convert/rgba32f_to_rgb9e5_1k", numTexels, "texels", [hdr, packed, numTexels]() {
+        ConvertRGBA32FToRGB9E5(hdr->data(), packed->data(), numTexels);
+        BenchRunner::Consume(packed->back());
+    });
+
+    // both environment passes run single-threaded, so the numbers don't depend on the core count
+    auto env = std::make_shared<vulkanhelpers::ImageData>();
+    if (!env->Decode(sEnvFile.c_str())) {
+        runner.Skip("envmap/build_distribution_2k", "can't decode " + sEnvFile);
+        runner.Skip("envmap/latlong_to_octahedral_1k", "can't decode " + sEnvFile);
+        return;
+    }
+
+    const uint64_t numEnvTexels = static_cast<uint64_t>(env->width) * env->height;
+    runner.Add("envmap/build_distribution_2k", numEnvTexels, "texels", [env]() {
+        EnvMapDistribution distribution;
+        distribution.Build(*env, nullptr);
+        BenchRunner::Consume(distribution.conditionalCdf.size());
+    });
+
+    runner.Add("envmap/latlong_to_octahedral_1k", static_cast<uint64_t>(sOctahedralSize) * sOctahedralSize, "texels", [env]() {
+        vulkanhelpers::ImageData octahedral;
+        ConvertLatLongToOctahedral(*env, sOctahedralSize, HDRFormat::Float16, octahedral, nullptr);
+        BenchRunner::Consume(octahedral.pixels.size());
+    });
+}
@@ -0,0 +1,139 @@
+#include "bench.h"
+#include "rtxApp.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+#include "shared_with_shaders.h"
+
+
+static const String sSceneFile = "_data/scenes/fake_whitted/fake_whitted.obj";
+static const uint32_t sGridSize = 256;      // quads per side, 2 * 256^2 triangles
+
+
+// a slightly bumpy grid with normals and uvs, the same file every run
+static String GenerateGridOBJ(const uint32_t size) {
+    uint32_t seed = 0x0B1EC7u;
+    std::ostringstream obj;
+    obj << std::fixed;
+    obj.precision(5);
+
+    const float step = 1.0f / static_cast<float>(size);
+    for (uint32_t y = 0; y <= size; ++y) {
+        for (uint32_t x = 0; x <= size; ++x) {
+            const float u = static_cast<float>(x) * step;
+            const float v = static_cast<float>(y) * step;
+            obj << "v " << u * 10.0f << " " << BenchRandom(seed) * 0.1f << " " << v * 10.0f << "\n";
+            obj << "vn 0.0 1.0 0.0\n";
+            obj << "vt " << u << " " << v << "\n";
+        }
+    }
+
+    const uint32_t rowSize = size + 1;
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            // OBJ indices are 1-based
+            const uint32_t a = y * rowSize + x + 1;
+            const uint32_t b = a + 1;
+            const uint32_t c = a + rowSize;
+            const uint32_t d = c + 1;
+            obj << "f " << a << "/" << a << "/" << a << " " << c << "/" << c << "/" << c << " " << b << "/" << b << "/" << b << "\n";
+            obj << "f " << b << "/" << b << "/" << b << " " << c << "/" << c << "/" << c << " " << d << "/" << d << "/" << d << "\n";
+        }
+    }
+
+    return obj.str();
+}
+
+static bool ParseOBJ(std::istream& stream, tinyobj::attrib_t& attrib, Array<tinyobj::shape_t>& shapes) {
+    Array<tinyobj::material_t> materials;
+    String warn, error;
+    return tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, &stream);
+}
+
+static VkPipelineShaderStageCreateInfo MakeStage(const VkShaderStageFlagBits stage) {
+    VkPipelineShaderStageCreateInfo stageInfo = {};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = stage;
+    stageInfo.module = VK_NULL_HANDLE;
+    stageInfo.pName = "main";
+    return stageInfo;
+}
+
+// the layout is all CPU work, no device needed until CreateSBT
+static void AddSBTBenchmark(BenchRunner& runner, const uint32_t numHitGroups, const uint32_t numMissGroups) {
+    const VkPipelineShaderStageCreateInfo raygen = MakeStage(VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+    const Array<VkPipelineShaderStageCreateInfo> hitStages = { MakeStage(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR), MakeStage(VK_SHADER_STAGE_ANY_HIT_BIT_KHR) };
+    const VkPipelineShaderStageCreateInfo miss = MakeStage(VK_SHADER_STAGE_MISS_BIT_KHR);
+
+    auto sbt = std::make_shared<SBTHelper>();
+    const String name = "sbt/layout_" + std::to_string(numHitGroups) + "hit_" + std::to_string(numMissGroups) + "miss";
+    runner.Add(name, numHitGroups + numMissGroups + 1, "groups", [=]() {
+        sbt->Destroy();
+        sbt->Initialize(numHitGroups, numMissGroups, 32, 64);
+        sbt->SetRaygenStage(raygen);
+        for (uint32_t i = 0; i < numHitGroups; ++i) {
+            sbt->AddStageToHitGroup(hitStages, i);
+        }
+        for (uint32_t i = 0; i < numMissGroups; ++i) {
+            sbt->AddStageToMissGroup(miss, i);
+        }
+        BenchRunner::Consume(sbt->GetSBTSize() + sbt->GetNumStages() + sbt->GetMissGroupsOffset());
+    });
+}
+
+
+void AddSceneBenchmarks(BenchRunner& runner) {
+    auto gridOBJ = std::make_shared<String>(GenerateGridOBJ(sGridSize));
+    const uint64_t numGridFaces = 2ull * sGridSize * sGridSize;
+    const String gridName = "grid" + std::to_string(sGridSize);
+
+    runner.Add("obj/parse_" + gridName, numGridFaces, "faces", [gridOBJ]() {
+        std::istringstream stream(*gridOBJ);
+        tinyobj::attrib_t attrib;
+        Array<tinyobj::shape_t> shapes;
+        ParseOBJ(stream, attrib, shapes);
+        BenchRunner::Consume(attrib.vertices.size());
+    });
+
+    // parsed once, only the conversion into the GPU layout is timed
+    auto attrib = std::make_shared<tinyobj::attrib_t>();
+    auto shapes = std::make_shared<Array<tinyobj::shape_t>>();
+    std::istringstream gridStream(*gridOBJ);
+    if (ParseOBJ(gridStream, *attrib, *shapes) && !shapes->empty()) {
+        const tinyobj::shape_t& shape = shapes->front();
+        const size_t numFaces = shape.mesh.num_face_vertices.size();
+
+        auto positions = std::make_shared<Array<vec3>>(numFaces * 3);
+        auto attribs = std::make_shared<Array<VertexAttribute>>(numFaces * 3);
+        auto indices = std::make_shared<Array<uint32_t>>(numFaces * 3);
+        auto faces = std::make_shared<Array<uint32_t>>(numFaces * 4);
+        auto matIDs = std::make_shared<Array<uint32_t>>(numFaces);
+
+        runner.Add("obj/convert_" + gridName, numFaces, "faces", [=]() {
+            ConvertOBJShape(*attrib, shapes->front(), positions->data(), attribs->data(), indices->data(), faces->data(), matIDs->data());
+            BenchRunner::Consume(faces->back());
+        });
+    } else {
+        runner.Skip("obj/convert_" + gridName, "the generated grid failed to parse");
+    }
+
+    std::ifstream sceneFile(sSceneFile);
+    if (sceneFile.is_open()) {
+        auto sceneOBJ = std::make_shared<String>((std::istreambuf_iterator<char>(sceneFile)), std::istreambuf_iterator<char>());
+        runner.Add("obj/parse_fake_whitted", 0, "", [sceneOBJ]() {
+            std::istringstream stream(*sceneOBJ);
+            tinyobj::attrib_t attrib;
+            Array<tinyobj::shape_t> shapes;
+            ParseOBJ(stream, attrib, shapes);
+            BenchRunner::Consume(attrib.vertices.size());
+        });
+    } else {
+        runner.Skip("obj/parse_fake_whitted", "no " + sSceneFile);
+    }
+
+    // what the app builds, and a scene with a hit group per material
+    AddSBTBenchmark(runner, SWS_NUM_MATERIAL_TYPES * SWS_NUM_RAY_TYPES, 2);
+    AddSBTBenchmark(runner, 64, 2);
+}
@@ -0,0 +1,42 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// CPU-side hot paths on fixed datasets, no GPU needed.
+// Run from the folder with _data, same as the app.
+int main(int argc, const char** argv) {
+    BenchRunner runner;
+    String jsonFile;
+
+    for (int i = 1; i < argc; ++i) {
+        const String arg = argv[i];
+        const bool hasValue = (i + 1) < argc;
+
+        if (arg == "--filter" && hasValue) {
+            runner.SetFilter(argv[++i]);
+        } else if (arg == "--batches" && hasValue) {
+            runner.SetNumBatches(static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "--batch-ms" && hasValue) {
+            runner.SetMinBatchTime(std::strtod(argv[++i], nullptr));
+        } else if (arg == "--json" && hasValue) {
+            jsonFile = argv[++i];
+        } else {
+            std::printf("Usage: rtxON_bench [--filter substring] [--batches N] [--batch-ms ms] [--json report.json]\n");
+            return 1;
+        }
+    }
+
+    AddSceneBenchmarks(runner);
+    AddImageBenchmarks(runner);
+    AddCameraBenchmarks(runner);
+
+    runner.RunAll();
+
+    if (!jsonFile.empty() && !runner.WriteJSON(jsonFile)) {
+        std::printf("Failed to write the results to %s\n", jsonFile.c_str());
+        return 1;
+    }
+
+    return 0;
+}
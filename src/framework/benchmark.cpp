@@ -0,0 +1,155 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+
+// nearest rank on sorted values
+static float Percentile(const Array<float>& sorted, const float percent) {
+    const size_t rank = static_cast<size_t>(std::ceil(percent * 0.01f * static_cast<float>(sorted.size())));
+    return sorted[Clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static String StatsToJSON(Array<float> values) {
+    if (values.empty()) {
+        return "{}";
+    }
+
+    std::sort(values.begin(), values.end());
+
+    double sum = 0.0;
+    for (const float v : values) {
+        sum += v;
+    }
+
+    return "{ \"min\": " + ToString(values.front(), 3) +
+           ", \"avg\": " + ToString(sum / static_cast<double>(values.size()), 3) +
+           ", \"p50\": " + ToString(Percentile(values, 50.0f), 3) +
+           ", \"p90\": " + ToString(Percentile(values, 90.0f), 3) +
+           ", \"p95\": " + ToString(Percentile(values, 95.0f), 3) +
+           ", \"p99\": " + ToString(Percentile(values, 99.0f), 3) +
+           ", \"max\": " + ToString(values.back(), 3) + " }";
+}
+
+
+Benchmark::Benchmark()
+    : mWarmupFrames(0)
+    , mMeasuredFrames(0)
+    , mNumRays(0)
+{
+}
+
+void Benchmark::Initialize(const uint32_t warmupFrames, const uint32_t measuredFrames) {
+    mWarmupFrames = warmupFrames;
+    mMeasuredFrames = measuredFrames;
+    mFrameTimes.clear();
+    mFrameTimes.reserve(measuredFrames);
+    mPassTimes.clear();
+    mNumRays = 0;
+    mCounters.clear();
+}
+
+bool Benchmark::IsActive() const {
+    return mMeasuredFrames > 0;
+}
+
+uint32_t Benchmark::GetTotalFrames() const {
+    return mWarmupFrames + mMeasuredFrames;
+}
+
+bool Benchmark::IsMeasuredFrame(const uint32_t frameNumber) const {
+    return frameNumber >= mWarmupFrames && frameNumber < this->GetTotalFrames();
+}
+
+void Benchmark::SetRaysPass(const String& name) {
+    mRaysPass = name;
+}
+
+void Benchmark::SetVariant(const String& variant) {
+    mVariant = variant;
+}
+
+void Benchmark::AddFrameTime(const uint32_t frameNumber, const float frameTimeMs) {
+    if (this->IsMeasuredFrame(frameNumber)) {
+        mFrameTimes.push_back(frameTimeMs);
+    }
+}
+
+void Benchmark::AddPassTimes(const uint32_t frameNumber, const GPUProfiler& profiler) {
+    if (!this->IsMeasuredFrame(frameNumber)) {
+        return;
+    }
+
+    for (const GPUProfiler::ScopeStats& scope : profiler.GetScopes()) {
+        if (scope.lastMs > 0.0f) {
+            mPassTimes[scope.name].push_back(scope.lastMs);
+        }
+    }
+}
+
+void Benchmark::AddRays(const uint32_t frameNumber, const uint64_t numRays) {
+    if (this->IsMeasuredFrame(frameNumber)) {
+        mNumRays += numRays;
+    }
+}
+
+void Benchmark::AddCounter(const uint32_t frameNumber, const String& name, const uint64_t value) {
+    if (!this->IsMeasuredFrame(frameNumber)) {
+        return;
+    }
+
+    for (auto& counter : mCounters) {
+        if (counter.first == name) {
+            counter.second += value;
+            return;
+        }
+    }
+    mCounters.push_back({ name, value });
+}
+
+bool Benchmark::WriteReport(const String& fileName, const String& deviceName, const String& cameraPath, const uint32_t width, const uint32_t height) const {
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    double raysPassMs = 0.0;
+    const auto raysPass = mPassTimes.find(mRaysPass);
+    if (raysPass != mPassTimes.end()) {
+        for (const float ms : raysPass->second) {
+            raysPassMs += ms;
+        }
+    }
+    const double mraysPerSecond = (raysPassMs > 0.0) ? (static_cast<double>(mNumRays) / (raysPassMs * 1000.0)) : 0.0;
+
+    file << "{\n";
+    file << "  \"device\": \"" << EscapeJSON(deviceName) << "\",\n";
+    file << "  \"cameraPath\": \"" << EscapeJSON(cameraPath) << "\",\n";
+    file << "  \"resolution\": [" << width << ", " << height << "],\n";
+    if (!mVariant.empty()) {
+        file << "  \"variant\": \"" << EscapeJSON(mVariant) << "\",\n";
+    }
+    file << "  \"warmupFrames\": " << mWarmupFrames << ",\n";
+    file << "  \"measuredFrames\": " << mFrameTimes.size() << ",\n";
+    file << "  \"frameTimeMs\": " << StatsToJSON(mFrameTimes) << ",\n";
+    file << "  \"gpuPassesMs\": {";
+    bool first = true;
+    for (const auto& pass : mPassTimes) {
+        file << (first ? "\n" : ",\n") << "    \"" << EscapeJSON(pass.first) << "\": " << StatsToJSON(pass.second);
+        first = false;
+    }
+    file << (first ? "},\n" : "\n  },\n");
+    file << "  \"rays\": " << mNumRays << ",\n";
+    if (!mCounters.empty()) {
+        file << "  \"counters\": {";
+        for (size_t i = 0; i < mCounters.size(); ++i) {
+            file << (i ? ",\n" : "\n") << "    \"" << EscapeJSON(mCounters[i].first) << "\": " << mCounters[i].second;
+        }
+        file << "\n  },\n";
+    }
+    file << "  \"mraysPerSecond\": " << ToString(mraysPerSecond, 2) << "\n";
+    file << "}\n";
+
+    return file.good();
+}
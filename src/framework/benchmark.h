@@ -0,0 +1,41 @@
+#pragma once
+#include "gpuprofiler.h"
+
+#include <map>
+
+// Gathers the timings of a scripted run: a number of warm-up frames that are ignored,
+// then the measured ones whose CPU frame times, GPU pass times and ray counts end up in a JSON report.
+class Benchmark {
+public:
+    Benchmark();
+    ~Benchmark() = default;
+
+    void        Initialize(const uint32_t warmupFrames, const uint32_t measuredFrames);
+    bool        IsActive() const;
+    uint32_t    GetTotalFrames() const;
+    bool        IsMeasuredFrame(const uint32_t frameNumber) const;
+
+    // the pass the rays are traced in, Mrays/s are counted against its GPU time
+    void        SetRaysPass(const String& name);
+    // which pipeline variant was measured, goes into the report as is
+    void        SetVariant(const String& variant);
+
+    // these ignore warm-up frames
+    void        AddFrameTime(const uint32_t frameNumber, const float frameTimeMs);
+    void        AddPassTimes(const uint32_t frameNumber, const GPUProfiler& profiler);
+    void        AddRays(const uint32_t frameNumber, const uint64_t numRays);
+    // free-form totals, e.g. the ray breakdown
+    void        AddCounter(const uint32_t frameNumber, const String& name, const uint64_t value);
+
+    bool        WriteReport(const String& fileName, const String& deviceName, const String& cameraPath, const uint32_t width, const uint32_t height) const;
+
+private:
+    uint32_t                            mWarmupFrames;
+    uint32_t                            mMeasuredFrames;
+    String                              mRaysPass;
+    String                              mVariant;
+    Array<float>                        mFrameTimes;
+    std::map<String, Array<float>>      mPassTimes;     // sorted by name, keeps the report stable
+    uint64_t                            mNumRays;
+    Array<std::pair<String, uint64_t>>  mCounters;      // in the order they were first added
+};
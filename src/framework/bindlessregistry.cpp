@@ -0,0 +1,201 @@
+#include "bindlessregistry.h"
+
+
+static uint32_t SubtractReserved(const uint32_t limit) {
+    return (limit > BindlessRegistry::kReservedPerStage) ? (limit - BindlessRegistry::kReservedPerStage) : 0;
+}
+
+
+uint32_t BindlessRegistry::SlotAllocator::Allocate() {
+    if (!freeSlots.empty()) {
+        const uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    return (highWater < capacity) ? highWater++ : kInvalidSlot;
+}
+
+void BindlessRegistry::SlotAllocator::Release(const uint32_t slot, const uint32_t frameStamp) {
+    if (slot < highWater) {
+        released.push_back({ slot, frameStamp });
+    }
+}
+
+void BindlessRegistry::SlotAllocator::Recycle(const uint32_t frameStamp, const uint32_t releaseDelay) {
+    size_t numLeft = 0;
+    for (const auto& entry : released) {
+        if (entry.second + releaseDelay <= frameStamp) {
+            freeSlots.push_back(entry.first);
+        } else {
+            released[numLeft++] = entry;
+        }
+    }
+    released.resize(numLeft);
+}
+
+
+BindlessRegistry::BindlessRegistry()
+    : mDevice(VK_NULL_HANDLE)
+    , mLayout(VK_NULL_HANDLE)
+    , mPool(VK_NULL_HANDLE)
+    , mSet(VK_NULL_HANDLE)
+    , mFrameStamp(0)
+    , mReleaseDelay(0)
+    , mBufferSlots({ 0, 0 })
+{
+}
+BindlessRegistry::~BindlessRegistry() {
+    this->Destroy();
+}
+
+bool BindlessRegistry::Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const uint32_t maxBuffers, const uint32_t framesInFlight, VkShaderStageFlags stages) {
+    mDevice = device;
+    // the frames in flight plus the one being recorded
+    mReleaseDelay = Max(framesInFlight, 1u) + 1;
+
+    VkPhysicalDeviceDescriptorIndexingProperties indexingProps = {};
+    indexingProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 devProps = {};
+    devProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    devProps.pNext = &indexingProps;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &devProps);
+
+    // the set is visible to every stage in `stages`, so the per-stage limits apply as well. Those are shared
+    // with the other sets of the pipeline layout, kReservedPerStage is left over for them
+    const uint32_t perStageBuffers = Min(SubtractReserved(indexingProps.maxPerStageDescriptorUpdateAfterBindStorageBuffers),
+                                         SubtractReserved(indexingProps.maxPerStageUpdateAfterBindResources));
+
+    mBufferSlots.capacity = Min(Min(maxBuffers, indexingProps.maxDescriptorSetUpdateAfterBindStorageBuffers), perStageBuffers);
+    if (!mBufferSlots.capacity) {
+        return false;
+    }
+
+    VkDescriptorSetLayoutBinding binding;
+    binding.binding = kBuffersBinding;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    binding.descriptorCount = mBufferSlots.capacity;
+    binding.stageFlags = stages;
+    binding.pImmutableSamplers = nullptr;
+
+    // slots nobody uses may stay empty, and may be written while the set is bound in a pending command buffer
+    const VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                                  VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                                  VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo;
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.pNext = nullptr;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    VkResult error = vkCreateDescriptorSetLayout(mDevice, &layoutInfo, nullptr, &mLayout);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    const VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mBufferSlots.capacity };
+
+    VkDescriptorPoolCreateInfo poolInfo;
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.pNext = nullptr;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+
+    error = vkCreateDescriptorPool(mDevice, &poolInfo, nullptr, &mPool);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo;
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = nullptr;
+    allocInfo.descriptorPool = mPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &mLayout;
+
+    error = vkAllocateDescriptorSets(mDevice, &allocInfo, &mSet);
+    return (VK_SUCCESS == error);
+}
+
+void BindlessRegistry::Destroy() {
+    if (mPool) {
+        vkDestroyDescriptorPool(mDevice, mPool, nullptr);
+        mPool = VK_NULL_HANDLE;
+        mSet = VK_NULL_HANDLE;
+    }
+
+    if (mLayout) {
+        vkDestroyDescriptorSetLayout(mDevice, mLayout, nullptr);
+        mLayout = VK_NULL_HANDLE;
+    }
+
+    mBufferSlots = { 0, 0 };
+    mPendingBufferWrites.clear();
+}
+
+uint32_t BindlessRegistry::RegisterBuffer(const VkDescriptorBufferInfo& info) {
+    const uint32_t slot = mBufferSlots.Allocate();
+    if (slot != kInvalidSlot) {
+        this->UpdateBuffer(slot, info);
+    }
+    return slot;
+}
+
+void BindlessRegistry::UpdateBuffer(const uint32_t slot, const VkDescriptorBufferInfo& info) {
+    mPendingBufferWrites.push_back({ slot, info });
+}
+
+void BindlessRegistry::ReleaseBuffer(const uint32_t slot) {
+    mBufferSlots.Release(slot, mFrameStamp);
+}
+
+void BindlessRegistry::Flush(const uint32_t frameStamp) {
+    mFrameStamp = frameStamp;
+    mBufferSlots.Recycle(frameStamp, mReleaseDelay);
+
+    if (mPendingBufferWrites.empty()) {
+        return;
+    }
+
+    Array<VkWriteDescriptorSet> writes;
+    writes.reserve(mPendingBufferWrites.size());
+
+    VkWriteDescriptorSet write;
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = mSet;
+    write.descriptorCount = 1;
+    write.pTexelBufferView = nullptr;
+
+    write.dstBinding = kBuffersBinding;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pImageInfo = nullptr;
+    for (const PendingWrite<VkDescriptorBufferInfo>& pending : mPendingBufferWrites) {
+        write.dstArrayElement = pending.slot;
+        write.pBufferInfo = &pending.info;
+        writes.push_back(write);
+    }
+
+    vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    mPendingBufferWrites.clear();
+}
+
+VkDescriptorSetLayout BindlessRegistry::GetLayout() const {
+    return mLayout;
+}
+
+VkDescriptorSet BindlessRegistry::GetSet() const {
+    return mSet;
+}
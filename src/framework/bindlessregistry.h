@@ -0,0 +1,60 @@
+#pragma once
+#include "vulkanhelpers.h"
+
+// One descriptor set with a big UPDATE_AFTER_BIND | PARTIALLY_BOUND array of storage buffers.
+// Resources get a slot that stays the same for their whole life, released slots are recycled through
+// a free list once the frames that could still see them are done, and all the descriptor writes made
+// during a frame go out in a single vkUpdateDescriptorSets call.
+class BindlessRegistry {
+public:
+    static const uint32_t kInvalidSlot = ~0u;
+    static const uint32_t kBuffersBinding = 0;
+    static const uint32_t kReservedPerStage = 32;   // per-stage descriptors left for the pipeline layout's other sets
+
+    BindlessRegistry();
+    ~BindlessRegistry();
+
+    // the capacity gets clamped to the device's update-after-bind limits, per set and per stage,
+    // fails if nothing is left. Released slots wait for the framesInFlight frames that could still see them
+    bool                    Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const uint32_t maxBuffers, const uint32_t framesInFlight, VkShaderStageFlags stages);
+    void                    Destroy();
+
+    uint32_t                RegisterBuffer(const VkDescriptorBufferInfo& info);
+    void                    UpdateBuffer(const uint32_t slot, const VkDescriptorBufferInfo& info);
+    void                    ReleaseBuffer(const uint32_t slot);
+
+    // writes everything queued since the last flush, call once per frame before submitting
+    void                    Flush(const uint32_t frameStamp);
+
+    VkDescriptorSetLayout   GetLayout() const;
+    VkDescriptorSet         GetSet() const;
+
+private:
+    struct SlotAllocator {
+        uint32_t                                capacity;
+        uint32_t                                highWater;
+        Array<uint32_t>                         freeSlots;
+        Array<std::pair<uint32_t, uint32_t>>    released;   // slot, frame stamp it was released at
+
+        uint32_t    Allocate();
+        void        Release(const uint32_t slot, const uint32_t frameStamp);
+        void        Recycle(const uint32_t frameStamp, const uint32_t releaseDelay);
+    };
+
+    template <typename T>
+    struct PendingWrite {
+        uint32_t    slot;
+        T           info;
+    };
+
+private:
+    VkDevice                                        mDevice;
+    VkDescriptorSetLayout                           mLayout;
+    VkDescriptorPool                                mPool;
+    VkDescriptorSet                                 mSet;
+    uint32_t                                        mFrameStamp;
+    uint32_t                                        mReleaseDelay;  // frames before a released slot can be reused
+
+    SlotAllocator                                   mBufferSlots;
+    Array<PendingWrite<VkDescriptorBufferInfo>>     mPendingBufferWrites;
+};
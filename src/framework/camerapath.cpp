@@ -0,0 +1,75 @@
+#include "camerapath.h"
+
+#include <fstream>
+
+
+bool CameraPath::Load(const String& fileName) {
+    mKeyframes.clear();
+
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    String line;
+    while (std::getline(file, line)) {
+        const size_t start = line.find_first_not_of(" \t\r");
+        if (start == String::npos || line[start] == '#') {
+            continue;
+        }
+
+        std::istringstream stream(line);
+        Keyframe key;
+        stream >> key.time
+               >> key.position.x >> key.position.y >> key.position.z
+               >> key.target.x >> key.target.y >> key.target.z;
+        if (stream.fail()) {
+            mKeyframes.clear();
+            return false;
+        }
+
+        if (!mKeyframes.empty() && key.time <= mKeyframes.back().time) {
+            mKeyframes.clear();
+            return false;
+        }
+
+        mKeyframes.push_back(key);
+    }
+
+    return !mKeyframes.empty();
+}
+
+bool CameraPath::IsEmpty() const {
+    return mKeyframes.empty();
+}
+
+float CameraPath::GetDuration() const {
+    return mKeyframes.empty() ? 0.0f : (mKeyframes.back().time - mKeyframes.front().time);
+}
+
+void CameraPath::Sample(const float time, vec3& position, vec3& target) const {
+    if (mKeyframes.empty()) {
+        return;
+    }
+
+    const float t = mKeyframes.front().time + time;
+
+    size_t next = 0;
+    while (next < mKeyframes.size() && mKeyframes[next].time < t) {
+        ++next;
+    }
+
+    if (next == 0 || next == mKeyframes.size()) {
+        const Keyframe& key = mKeyframes[next ? next - 1 : 0];
+        position = key.position;
+        target = key.target;
+        return;
+    }
+
+    const Keyframe& a = mKeyframes[next - 1];
+    const Keyframe& b = mKeyframes[next];
+    const float k = (t - a.time) / (b.time - a.time);
+
+    position = Lerp(a.position, b.position, k);
+    target = Lerp(a.target, b.target, k);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "common.h"
+
+// Camera keyframes loaded from a text file, one "time posX posY posZ targetX targetY targetZ" per line.
+// Empty lines and lines starting with '#' are skipped, keyframes must go in increasing time.
+class CameraPath {
+public:
+    struct Keyframe {
+        float   time;
+        vec3    position;
+        vec3    target;
+    };
+
+    CameraPath() = default;
+    ~CameraPath() = default;
+
+    bool        Load(const String& fileName);
+    bool        IsEmpty() const;
+    float       GetDuration() const;
+
+    // linear in between the keyframes, clamped to the ends
+    void        Sample(const float time, vec3& position, vec3& target) const;
+
+private:
+    Array<Keyframe> mKeyframes;
+};
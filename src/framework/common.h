@@ -19,6 +19,19 @@ String ToString(const T f, const int n = 6) {
     return out.str();
 }
 
+inline String EscapeJSON(const String& str) {
+    String result;
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            result += c;
+        }
+    }
+    return result;
+}
+
 
 #pragma warning(push)
 #pragma warning(disable : 4201) // C4201: nonstandard extension used: nameless struct/union
@@ -35,6 +48,7 @@ String ToString(const T f, const int n = 6) {
 using vec2 = glm::highp_vec2;
 using vec3 = glm::highp_vec3;
 using vec4 = glm::highp_vec4;
+using uvec4 = glm::highp_uvec4;
 using mat4 = glm::highp_mat4;
 using quat = glm::highp_quat;
 
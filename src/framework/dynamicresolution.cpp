@@ -0,0 +1,96 @@
+#include "dynamicresolution.h"
+
+#include <cmath>
+
+
+static const float sSmoothing = 0.1f;           // weight of the newest timing
+static const float sLowerDeadband = 0.85f;      // no changes while the time is within these fractions of the target
+static const float sUpperDeadband = 1.05f;
+static const float sMaxStepDown = 0.75f;        // per change, dropping fast matters more than growing fast
+static const float sMaxStepUp = 1.1f;
+
+
+DynamicResolution::DynamicResolution()
+    : mMaxWidth(0)
+    , mMaxHeight(0)
+    , mTargetMs(0.0f)
+    , mMinScale(1.0f)
+    , mScale(1.0f)
+    , mSmoothedMs(0.0f)
+    , mWidth(0)
+    , mHeight(0)
+    , mFramesSinceChange(0)
+{
+}
+
+void DynamicResolution::Initialize(const uint32_t maxWidth, const uint32_t maxHeight, const float targetMs, const float minScale) {
+    mMaxWidth = maxWidth;
+    mMaxHeight = maxHeight;
+    mTargetMs = targetMs;
+    mMinScale = Clamp(minScale, 0.1f, 1.0f);
+    mSmoothedMs = 0.0f;
+    mFramesSinceChange = 0;
+
+    this->ApplyScale(1.0f);
+}
+
+bool DynamicResolution::Update(const float gpuTimeMs) {
+    if (gpuTimeMs <= 0.0f || mTargetMs <= 0.0f) {
+        return false;
+    }
+
+    mSmoothedMs = (mSmoothedMs > 0.0f) ? Lerp(mSmoothedMs, gpuTimeMs, sSmoothing) : gpuTimeMs;
+
+    if (++mFramesSinceChange < kSettleFrames) {
+        return false;
+    }
+
+    const float ratio = mTargetMs / mSmoothedMs;
+    if (ratio >= sLowerDeadband && ratio <= sUpperDeadband) {
+        return false;
+    }
+
+    // trace time follows the pixel count, which goes with the square of the scale
+    const float step = Clamp(std::sqrt(ratio), sMaxStepDown, sMaxStepUp);
+    const float newScale = Clamp(mScale * step, mMinScale, 1.0f);
+
+    const uint32_t oldWidth = mWidth;
+    const uint32_t oldHeight = mHeight;
+    this->ApplyScale(newScale);
+
+    if (mWidth == oldWidth && mHeight == oldHeight) {
+        return false;
+    }
+
+    // best guess until the new timings arrive
+    mSmoothedMs *= static_cast<float>(mWidth * mHeight) / static_cast<float>(oldWidth * oldHeight);
+    mFramesSinceChange = 0;
+
+    return true;
+}
+
+uint32_t DynamicResolution::GetWidth() const {
+    return mWidth;
+}
+
+uint32_t DynamicResolution::GetHeight() const {
+    return mHeight;
+}
+
+float DynamicResolution::GetScale() const {
+    return mScale;
+}
+
+void DynamicResolution::ApplyScale(const float scale) {
+    mScale = scale;
+
+    auto scaleSize = [scale](const uint32_t size) -> uint32_t {
+        const uint32_t granularity = kSizeGranularity;
+        const uint32_t scaled = static_cast<uint32_t>(static_cast<float>(size) * scale);
+        const uint32_t rounded = (scaled / granularity) * granularity;
+        return Clamp(rounded, Min(granularity, size), size);
+    };
+
+    mWidth = scaleSize(mMaxWidth);
+    mHeight = scaleSize(mMaxHeight);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "common.h"
+
+#include <cstdint>
+
+// Picks the render resolution that keeps the measured GPU time around the target.
+// Timings are smoothed and the resolution only moves when it's clearly off, so it doesn't flicker.
+class DynamicResolution {
+public:
+    static const uint32_t kSizeGranularity = 8;     // width and height are multiples of this
+    static const uint32_t kSettleFrames = 8;        // frames to wait for the timings of a new resolution
+
+    DynamicResolution();
+    ~DynamicResolution() = default;
+
+    // minScale - smallest allowed fraction of the max width and height
+    void        Initialize(const uint32_t maxWidth, const uint32_t maxHeight, const float targetMs, const float minScale);
+
+    // feeds the GPU time of the last frame, returns true if the resolution has changed
+    bool        Update(const float gpuTimeMs);
+
+    uint32_t    GetWidth() const;
+    uint32_t    GetHeight() const;
+    float       GetScale() const;
+
+private:
+    void        ApplyScale(const float scale);
+
+private:
+    uint32_t    mMaxWidth;
+    uint32_t    mMaxHeight;
+    float       mTargetMs;
+    float       mMinScale;
+    float       mScale;
+    float       mSmoothedMs;
+    uint32_t    mWidth;
+    uint32_t    mHeight;
+    uint32_t    mFramesSinceChange;
+};
@@ -0,0 +1,238 @@
+#include "envmap.h"
+#include "threadpool.h"
+
+#include <cstring> // for memcpy
+#include <cmath>
+
+
+static float Luminance(const float* rgb) {
+    return rgb[0] * 0.2126f + rgb[1] * 0.7152f + rgb[2] * 0.0722f;
+}
+
+// turns func[0 .. count) into a normalized CDF with (count + 1) entries, returns the function integral
+static float BuildCdf(const float* func, float* cdf, const uint32_t count) {
+    cdf[0] = 0.0f;
+    for (uint32_t i = 0; i < count; ++i) {
+        cdf[i + 1] = cdf[i] + func[i] / static_cast<float>(count);
+    }
+
+    const float integral = cdf[count];
+    if (integral > 0.0f) {
+        for (uint32_t i = 1; i <= count; ++i) {
+            cdf[i] /= integral;
+        }
+    } else {
+        // black row - fall back to uniform
+        for (uint32_t i = 1; i <= count; ++i) {
+            cdf[i] = static_cast<float>(i) / static_cast<float>(count);
+        }
+    }
+    cdf[count] = 1.0f;
+
+    return integral;
+}
+
+
+bool EnvMapDistribution::Build(const vulkanhelpers::ImageData& image, ThreadPool* threadPool) {
+    width = image.width;
+    height = image.height;
+    integral = 0.0f;
+
+    if (!width || !height) {
+        return false;
+    }
+
+    const size_t rowSize = static_cast<size_t>(width) + 1;
+
+    conditionalCdf.resize(rowSize * height);
+    marginalCdf.resize(static_cast<size_t>(height) + 1);
+
+    Array<float> rowIntegrals(height, 0.0f);
+
+    auto buildRow = [&](const size_t y) {
+        // rows near the poles cover less solid angle
+        const float sinTheta = std::sin(MM_Pi * (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+
+        Array<float> func(width);
+        float rgba[4];
+        for (uint32_t x = 0; x < width; ++x) {
+            image.ReadTexel(x, static_cast<uint32_t>(y), rgba);
+            func[x] = Max(Luminance(rgba), 0.0f) * sinTheta;
+        }
+
+        rowIntegrals[y] = BuildCdf(func.data(), conditionalCdf.data() + y * rowSize, width);
+    };
+
+    ThreadPool::ParallelFor(threadPool, height, buildRow);
+
+    integral = BuildCdf(rowIntegrals.data(), marginalCdf.data(), height);
+
+    return true;
+}
+
+size_t EnvMapDistribution::GetGPUDataSize() const {
+    return sizeof(uint32_t[4]) + (marginalCdf.size() + conditionalCdf.size()) * sizeof(float);
+}
+
+void EnvMapDistribution::WriteGPUData(void* dst) const {
+    const uint32_t header[4] = { width, height, 0, 0 };
+
+    uint8_t* mem = static_cast<uint8_t*>(dst);
+    std::memcpy(mem, header, sizeof(header));
+    mem += sizeof(header);
+    std::memcpy(mem, marginalCdf.data(), marginalCdf.size() * sizeof(float));
+    mem += marginalCdf.size() * sizeof(float);
+    std::memcpy(mem, conditionalCdf.data(), conditionalCdf.size() * sizeof(float));
+}
+
+
+static vec2 SignNotZero(const vec2& v) {
+    return vec2((v.x >= 0.0f) ? 1.0f : -1.0f, (v.y >= 0.0f) ? 1.0f : -1.0f);
+}
+
+vec2 DirToOctahedral(const vec3& dir) {
+    vec2 p = vec2(dir.x, dir.y) * (1.0f / (std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z)));
+    if (dir.z < 0.0f) {
+        p = (vec2(1.0f) - glm::abs(vec2(p.y, p.x))) * SignNotZero(p);
+    }
+    return p * 0.5f + vec2(0.5f);
+}
+
+vec3 OctahedralToDir(const vec2& uv) {
+    const vec2 p = uv * 2.0f - vec2(1.0f);
+    vec3 dir = vec3(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+    if (dir.z < 0.0f) {
+        const vec2 folded = (vec2(1.0f) - glm::abs(vec2(dir.y, dir.x))) * SignNotZero(vec2(dir.x, dir.y));
+        dir.x = folded.x;
+        dir.y = folded.y;
+    }
+    return Normalize(dir);
+}
+
+// same as DirToLatLong in shared_with_shaders.h
+static vec2 DirToLatLong(const vec3& dir) {
+    const float phi = std::atan2(dir.x, dir.z);
+    const float theta = std::acos(Clamp(dir.y, -1.0f, 1.0f));
+    return vec2((MM_Pi + phi) * (0.5f / MM_Pi), theta / MM_Pi);
+}
+
+// bilinear lookup, wrapping horizontally and clamping vertically
+static vec4 SampleLatLong(const vulkanhelpers::ImageData& image, const vec2& uv) {
+    const float x = uv.x * static_cast<float>(image.width) - 0.5f;
+    const float y = Clamp(uv.y * static_cast<float>(image.height) - 0.5f, 0.0f, static_cast<float>(image.height - 1));
+
+    const float fx = std::floor(x);
+    const float fy = std::floor(y);
+    const float tx = x - fx;
+    const float ty = y - fy;
+
+    const int w = static_cast<int>(image.width);
+    const int x0 = ((static_cast<int>(fx) % w) + w) % w;
+    const int x1 = (x0 + 1) % w;
+    const uint32_t y0 = static_cast<uint32_t>(fy);
+    const uint32_t y1 = Min(y0 + 1, image.height - 1);
+
+    vec4 t00, t10, t01, t11;
+    image.ReadTexel(static_cast<uint32_t>(x0), y0, &t00.x);
+    image.ReadTexel(static_cast<uint32_t>(x1), y0, &t10.x);
+    image.ReadTexel(static_cast<uint32_t>(x0), y1, &t01.x);
+    image.ReadTexel(static_cast<uint32_t>(x1), y1, &t11.x);
+
+    return Lerp(Lerp(t00, t10, tx), Lerp(t01, t11, tx), ty);
+}
+
+static void PackTexels(const float* src, uint8_t* dst, const size_t numTexels, const HDRFormat format) {
+    switch (format) {
+        case HDRFormat::Float32: std::memcpy(dst, src, numTexels * sizeof(float[4])); break;
+        case HDRFormat::Float16: ConvertRGBA32FToRGBA16F(src, reinterpret_cast<uint16_t*>(dst), numTexels); break;
+        case HDRFormat::RGB9E5:  ConvertRGBA32FToRGB9E5(src, reinterpret_cast<uint32_t*>(dst), numTexels); break;
+    }
+}
+
+// texel coordinates past an edge of an octahedral map continue on the same edge, mirrored,
+// so a filter footprint that crosses it picks up the directions that are actually next to the edge texels
+static size_t WrapOctahedralTexel(int x, int y, const int size) {
+    if (x < 0 || x >= size) {
+        x = (x < 0) ? (-x - 1) : (2 * size - 1 - x);
+        y = size - 1 - y;
+    }
+    if (y < 0 || y >= size) {
+        y = (y < 0) ? (-y - 1) : (2 * size - 1 - y);
+        x = size - 1 - x;
+    }
+    return static_cast<size_t>(y) * static_cast<size_t>(size) + static_cast<size_t>(x);
+}
+
+bool ConvertLatLongToOctahedral(const vulkanhelpers::ImageData& latLong,
+                                const uint32_t size,
+                                const HDRFormat format,
+                                vulkanhelpers::ImageData& result,
+                                ThreadPool* threadPool) {
+    if (!latLong.width || !latLong.height || !size) {
+        return false;
+    }
+
+    uint32_t mipLevels = 1;
+    while ((size >> mipLevels) > 0) {
+        ++mipLevels;
+    }
+
+    result.width = size;
+    result.height = size;
+    result.mipLevels = mipLevels;
+    switch (format) {
+        case HDRFormat::Float32: result.format = VK_FORMAT_R32G32B32A32_SFLOAT; break;
+        case HDRFormat::Float16: result.format = VK_FORMAT_R16G16B16A16_SFLOAT; break;
+        case HDRFormat::RGB9E5:  result.format = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32; break;
+    }
+    result.pixels.resize(result.GetMipOffset(mipLevels));
+
+    // top level - 2x2 supersampled from the source
+    Array<vec4> level(static_cast<size_t>(size) * size);
+    ThreadPool::ParallelFor(threadPool, size, [&](const size_t y) {
+        const float invSize = 1.0f / static_cast<float>(size);
+        for (uint32_t x = 0; x < size; ++x) {
+            vec4 sum(0.0f);
+            for (uint32_t s = 0; s < 4; ++s) {
+                const vec2 uv = vec2((static_cast<float>(x) + 0.25f + 0.5f * static_cast<float>(s & 1)) * invSize,
+                                     (static_cast<float>(y) + 0.25f + 0.5f * static_cast<float>(s >> 1)) * invSize);
+                sum += SampleLatLong(latLong, DirToLatLong(OctahedralToDir(uv)));
+            }
+            level[y * size + x] = sum * 0.25f;
+        }
+    });
+
+    // the rest of the chain - a 4x4 tent (1 3 3 1) around the 2x2 children, reaching over the edges,
+    // a plain box would never mix the texels on either side of the fold and the coarse mips would show the seams
+    static const float sTentWeights[4] = { 1.0f / 8.0f, 3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f };
+
+    uint32_t levelSize = size;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+        PackTexels(&level[0].x, result.pixels.data() + result.GetMipOffset(mip), level.size(), format);
+
+        if (mip + 1 < mipLevels) {
+            const uint32_t nextSize = Max(levelSize >> 1, 1u);
+            Array<vec4> nextLevel(static_cast<size_t>(nextSize) * nextSize);
+            ThreadPool::ParallelFor(threadPool, nextSize, [&](const size_t y) {
+                const int srcSize = static_cast<int>(levelSize);
+                for (uint32_t x = 0; x < nextSize; ++x) {
+                    const int sx = static_cast<int>(x) * 2 - 1;
+                    const int sy = static_cast<int>(y) * 2 - 1;
+
+                    vec4 sum(0.0f);
+                    for (int j = 0; j < 4; ++j) {
+                        for (int i = 0; i < 4; ++i) {
+                            sum += level[WrapOctahedralTexel(sx + i, sy + j, srcSize)] * (sTentWeights[i] * sTentWeights[j]);
+                        }
+                    }
+                    nextLevel[y * nextSize + x] = sum;
+                }
+            });
+
+            level.swap(nextLevel);
+            levelSize = nextSize;
+        }
+    }
+
+    return true;
+}
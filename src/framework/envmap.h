@@ -0,0 +1,33 @@
+#pragma once
+#include "vulkanhelpers.h"
+
+class ThreadPool;
+
+// importance sampling tables for a lat-long environment map
+// (piecewise-constant 2D distribution over luminance * sin(theta))
+struct EnvMapDistribution {
+    uint32_t        width;
+    uint32_t        height;
+    float           integral;
+    Array<float>    marginalCdf;    // height + 1 entries
+    Array<float>    conditionalCdf; // height rows of (width + 1) entries
+
+    bool            Build(const vulkanhelpers::ImageData& image, ThreadPool* threadPool);
+
+    // the layout shaders expect: uvec4(width, height, 0, 0), marginal CDF, then all conditional CDFs
+    size_t          GetGPUDataSize() const;
+    void            WriteGPUData(void* dst) const;
+};
+
+
+// octahedral mapping, same as DirToOctahedral/OctahedralToDir in shared_with_shaders.h
+vec2    DirToOctahedral(const vec3& dir);
+vec3    OctahedralToDir(const vec2& uv);
+
+// resamples a lat-long image into a (size x size) octahedral map with a full chain of prefiltered mips,
+// the filter wraps over the map's edges the way the octahedral fold does
+bool    ConvertLatLongToOctahedral(const vulkanhelpers::ImageData& latLong,
+                                   const uint32_t size,
+                                   const HDRFormat format,
+                                   vulkanhelpers::ImageData& result,
+                                   ThreadPool* threadPool);
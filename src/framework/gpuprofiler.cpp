@@ -0,0 +1,270 @@
+#include "gpuprofiler.h"
+#include "tracer.h"
+
+#include <cfloat>
+
+
+GPUProfiler::GPUProfiler()
+    : mDevice(VK_NULL_HANDLE)
+    , mTimestampPeriod(1.0f)
+    , mTimestampMask(0)
+    , mTraceEnabled(false)
+    , mTraceHostClock(false)
+    , mCurrentSlot(kInvalidScope)
+{
+}
+GPUProfiler::~GPUProfiler() {
+    this->Destroy();
+}
+
+bool GPUProfiler::Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndex, const uint32_t numSlots) {
+    mDevice = device;
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+    mTimestampPeriod = props.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    Array<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // no timestamps on this queue - the profiler silently does nothing
+    const uint32_t validBits = (queueFamilyIndex < queueFamilyCount) ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+    if (!validBits) {
+        return false;
+    }
+    mTimestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo;
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.pNext = nullptr;
+    queryPoolCreateInfo.flags = 0;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = kMaxScopesPerSlot * 2;
+    queryPoolCreateInfo.pipelineStatistics = 0;
+
+    mSlots.resize(numSlots + 1, Slot{ VK_NULL_HANDLE, {}, false });
+    for (Slot& slot : mSlots) {
+        const VkResult error = vkCreateQueryPool(mDevice, &queryPoolCreateInfo, nullptr, &slot.queryPool);
+        if (VK_SUCCESS != error) {
+            slot.queryPool = VK_NULL_HANDLE;
+            this->Destroy();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void GPUProfiler::Destroy() {
+    for (Slot& slot : mSlots) {
+        if (slot.queryPool) {
+            vkDestroyQueryPool(mDevice, slot.queryPool, nullptr);
+        }
+    }
+    mSlots.clear();
+    mCurrentSlot = kInvalidScope;
+}
+
+uint32_t GPUProfiler::GetSetupSlot() const {
+    return mSlots.empty() ? kInvalidScope : static_cast<uint32_t>(mSlots.size() - 1);
+}
+
+bool GPUProfiler::EnableTrace(VkPhysicalDevice physicalDevice) {
+    mTraceEnabled = false;
+    mTraceHostClock = false;
+
+    if (mSlots.empty() || !vkGetPhysicalDeviceCalibrateableTimeDomainsEXT || !vkGetCalibratedTimestampsEXT) {
+        return false;
+    }
+
+    uint32_t numDomains = 0;
+    vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &numDomains, nullptr);
+    Array<VkTimeDomainEXT> domains(numDomains);
+    vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &numDomains, domains.data());
+
+    for (const VkTimeDomainEXT domain : domains) {
+        if (domain == VK_TIME_DOMAIN_DEVICE_EXT) {
+            mTraceEnabled = true;
+        } else if (domain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) {
+            // what steady_clock reads on Linux
+            mTraceHostClock = true;
+        }
+    }
+
+    return mTraceEnabled;
+}
+
+void GPUProfiler::BeginFrame(VkCommandBuffer commandBuffer, const uint32_t slot) {
+    if (slot >= mSlots.size()) {
+        mCurrentSlot = kInvalidScope;
+        return;
+    }
+
+    mCurrentSlot = slot;
+    mSlots[slot].scopes.clear();
+    mSlots[slot].pending = false;
+
+    vkCmdResetQueryPool(commandBuffer, mSlots[slot].queryPool, 0, kMaxScopesPerSlot * 2);
+}
+
+uint32_t GPUProfiler::BeginScope(VkCommandBuffer commandBuffer, const String& name) {
+    if (mCurrentSlot == kInvalidScope) {
+        return kInvalidScope;
+    }
+
+    Slot& slot = mSlots[mCurrentSlot];
+    if (slot.scopes.size() >= kMaxScopesPerSlot) {
+        return kInvalidScope;
+    }
+
+    auto it = mScopesMap.find(name);
+    if (it == mScopesMap.end()) {
+        ScopeStats stats = {};
+        stats.name = name;
+        it = mScopesMap.insert({ name, static_cast<uint32_t>(mScopes.size()) }).first;
+        mScopes.push_back(stats);
+    }
+
+    const uint32_t scope = static_cast<uint32_t>(slot.scopes.size());
+    slot.scopes.push_back(it->second);
+    slot.pending = true;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.queryPool, scope * 2);
+
+    return scope;
+}
+
+void GPUProfiler::EndScope(VkCommandBuffer commandBuffer, const uint32_t scope) {
+    if (mCurrentSlot == kInvalidScope || scope == kInvalidScope) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mSlots[mCurrentSlot].queryPool, scope * 2 + 1);
+}
+
+bool GPUProfiler::Collect(const uint32_t slotIndex) {
+    if (slotIndex >= mSlots.size() || !mSlots[slotIndex].pending) {
+        return false;
+    }
+
+    Slot& slot = mSlots[slotIndex];
+    slot.pending = false;
+
+    const uint32_t numQueries = static_cast<uint32_t>(slot.scopes.size() * 2);
+    Array<uint64_t> timestamps(numQueries);
+    const VkResult result = vkGetQueryPoolResults(mDevice, slot.queryPool, 0, numQueries,
+                                                  timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (VK_SUCCESS != result) {
+        return false;
+    }
+
+    if (mTraceEnabled && trace::IsEnabled()) {
+        this->AddTraceEvents(slot, timestamps);
+    }
+
+    for (ScopeStats& stats : mScopes) {
+        stats.lastMs = 0.0f;
+    }
+
+    Array<bool> touched(mScopes.size(), false);
+    for (size_t i = 0; i < slot.scopes.size(); ++i) {
+        const uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & mTimestampMask;
+        mScopes[slot.scopes[i]].lastMs += static_cast<float>(static_cast<double>(ticks) * mTimestampPeriod * 1e-6);
+        touched[slot.scopes[i]] = true;
+    }
+
+    const size_t historyCapacity = kHistorySize;
+    for (size_t i = 0; i < mScopes.size(); ++i) {
+        if (!touched[i]) {
+            continue;
+        }
+
+        ScopeStats& stats = mScopes[i];
+        stats.history[stats.historyPointer] = stats.lastMs;
+        stats.historyPointer = (stats.historyPointer + 1) % kHistorySize;
+        stats.historySize = Min(stats.historySize + 1, historyCapacity);
+
+        stats.minMs = FLT_MAX;
+        stats.maxMs = 0.0f;
+        float sum = 0.0f;
+        for (size_t j = 0; j < stats.historySize; ++j) {
+            stats.minMs = Min(stats.minMs, stats.history[j]);
+            stats.maxMs = Max(stats.maxMs, stats.history[j]);
+            sum += stats.history[j];
+        }
+        stats.avgMs = sum / static_cast<float>(stats.historySize);
+    }
+
+    return true;
+}
+
+const Array<GPUProfiler::ScopeStats>& GPUProfiler::GetScopes() const {
+    return mScopes;
+}
+
+float GPUProfiler::GetLastMs(const String& name) const {
+    const ScopeStats* stats = this->FindScope(name);
+    return stats ? stats->lastMs : 0.0f;
+}
+
+float GPUProfiler::GetAvgMs(const String& name) const {
+    const ScopeStats* stats = this->FindScope(name);
+    return stats ? stats->avgMs : 0.0f;
+}
+
+String GPUProfiler::GetReport() const {
+    String report;
+    for (const ScopeStats& stats : mScopes) {
+        if (!stats.historySize) {
+            continue;
+        }
+
+        report += stats.name + ": min " + ToString(stats.minMs, 3) +
+                  " ms, avg " + ToString(stats.avgMs, 3) +
+                  " ms, max " + ToString(stats.maxMs, 3) + " ms\n";
+    }
+    return report;
+}
+
+const GPUProfiler::ScopeStats* GPUProfiler::FindScope(const String& name) const {
+    const auto it = mScopesMap.find(name);
+    return (it == mScopesMap.end()) ? nullptr : &mScopes[it->second];
+}
+
+void GPUProfiler::AddTraceEvents(const Slot& slot, const Array<uint64_t>& timestamps) const {
+    // one pair of GPU and host readings per collect keeps the clock drift out of long traces
+    VkCalibratedTimestampInfoEXT timestampInfos[2];
+    timestampInfos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfos[0].pNext = nullptr;
+    timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    timestampInfos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    timestampInfos[1].pNext = nullptr;
+    timestampInfos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+
+    uint64_t calibrated[2] = { 0, 0 };
+    uint64_t maxDeviation = 0;
+    const uint64_t hostBefore = trace::GetTimeNs();
+    const VkResult error = vkGetCalibratedTimestampsEXT(mDevice, mTraceHostClock ? 2 : 1, timestampInfos, calibrated, &maxDeviation);
+    const uint64_t hostAfter = trace::GetTimeNs();
+    if (VK_SUCCESS != error) {
+        return;
+    }
+
+    // without the host domain the reads around the call are the best we have
+    const uint64_t hostNs = mTraceHostClock ? calibrated[1] : (hostBefore + (hostAfter - hostBefore) / 2);
+    const uint64_t deviceTicks = calibrated[0];
+
+    auto toHostNs = [this, hostNs, deviceTicks](const uint64_t ticks) -> uint64_t {
+        // the timestamps are in the past, so the difference is usually negative
+        const uint64_t delta = (ticks - deviceTicks) & mTimestampMask;
+        const double signedTicks = (delta > (mTimestampMask >> 1)) ? -static_cast<double>(mTimestampMask - delta + 1) : static_cast<double>(delta);
+        return static_cast<uint64_t>(static_cast<double>(hostNs) + signedTicks * mTimestampPeriod);
+    };
+
+    for (size_t i = 0; i < slot.scopes.size(); ++i) {
+        trace::AddGPUEvent(mScopes[slot.scopes[i]].name, toHostNs(timestamps[i * 2]), toHostNs(timestamps[i * 2 + 1]));
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "vulkanhelpers.h"
+
+#include <unordered_map>
+
+// Timestamp pairs around named scopes, one query pool per slot (frame in flight).
+// A slot's results are only read back once the caller knows the GPU is done with it, so nothing ever stalls.
+class GPUProfiler {
+public:
+    static const uint32_t kMaxScopesPerSlot = 64;
+    static const uint32_t kInvalidScope = ~0u;
+    static const size_t   kHistorySize = 128;
+
+    struct ScopeStats {
+        String  name;
+        float   lastMs;                     // 0 if the scope wasn't in the latest collected slot
+        float   minMs;                      // rolling over the history
+        float   avgMs;
+        float   maxMs;
+        float   history[kHistorySize];
+        size_t  historySize;
+        size_t  historyPointer;
+    };
+
+    GPUProfiler();
+    ~GPUProfiler();
+
+    // one extra slot is reserved for setup work that is waited on right after the submit
+    bool                        Initialize(VkDevice device, VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndex, const uint32_t numSlots);
+    void                        Destroy();
+    uint32_t                    GetSetupSlot() const;
+    // collected scopes also go to the trace, mapped onto the CPU clock, needs VK_EXT_calibrated_timestamps enabled
+    bool                        EnableTrace(VkPhysicalDevice physicalDevice);
+
+    // resets the slot's queries, every scope recorded after this belongs to the slot
+    void                        BeginFrame(VkCommandBuffer commandBuffer, const uint32_t slot);
+    uint32_t                    BeginScope(VkCommandBuffer commandBuffer, const String& name);
+    void                        EndScope(VkCommandBuffer commandBuffer, const uint32_t scope);
+    // reads the slot back into the stats, scopes with the same name get summed up
+    // returns false if the slot had nothing new
+    bool                        Collect(const uint32_t slot);
+
+    const Array<ScopeStats>&    GetScopes() const;
+    float                       GetLastMs(const String& name) const;
+    float                       GetAvgMs(const String& name) const;
+    String                      GetReport() const;
+
+private:
+    struct Slot {
+        VkQueryPool         queryPool;
+        Array<uint32_t>     scopes;     // stats index of every scope, queries go in pairs
+        bool                pending;
+    };
+
+    const ScopeStats*   FindScope(const String& name) const;
+    void                AddTraceEvents(const Slot& slot, const Array<uint64_t>& timestamps) const;
+
+private:
+    VkDevice                                    mDevice;
+    float                                       mTimestampPeriod;   // nanoseconds per tick
+    uint64_t                                    mTimestampMask;
+    bool                                        mTraceEnabled;
+    bool                                        mTraceHostClock;    // the driver can read the trace's host clock itself
+    Array<Slot>                                 mSlots;
+    uint32_t                                    mCurrentSlot;
+    Array<ScopeStats>                           mScopes;
+    std::unordered_map<String, uint32_t>        mScopesMap;
+};
@@ -0,0 +1,230 @@
+#include "imageconvert.h"
+#include <cstring> // for memcpy
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGECONVERT_SSE2
+#include <emmintrin.h>
+#if defined(__F16C__) || defined(__AVX2__)
+#define IMAGECONVERT_F16C
+#include <immintrin.h>
+#endif
+#endif
+
+
+// RGB9E5 constants, see VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 in the Vulkan spec
+static const int    sRGB9E5ExpBias = 15;
+static const int    sRGB9E5MantissaBits = 9;
+static const float  sRGB9E5MaxValue = 65408.0f; // (2^9 - 1) / 2^9 * 2^(31 - 15)
+
+
+static inline uint32_t AsUint(const float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float AsFloat(const uint32_t u) {
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+
+uint16_t FloatToHalf(const float f) {
+    const uint32_t bits = AsUint(f);
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t absBits = bits & 0x7fffffffu;
+
+    if (absBits >= 0x47800000u) {
+        // overflow to inf, keep NaNs as NaNs
+        return static_cast<uint16_t>(sign | ((absBits > 0x7f800000u) ? 0x7e00u : 0x7c00u));
+    }
+
+    if (absBits < 0x38800000u) {
+        // subnormal half - let the FPU do the rounding for us
+        const float subnormal = AsFloat(absBits) + AsFloat(0x3f000000u);
+        return static_cast<uint16_t>(sign | (AsUint(subnormal) - 0x3f000000u));
+    }
+
+    // normal half, round to nearest even
+    const uint32_t mantissaOdd = (absBits >> 13) & 1u;
+    absBits += 0xc8000fffu + mantissaOdd; // rebias exponent (-112 << 23) and add rounding
+    return static_cast<uint16_t>(sign | (absBits >> 13));
+}
+
+float HalfToFloat(const uint16_t h) {
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1fu;
+    const uint32_t mantissa = h & 0x3ffu;
+
+    if (!exponent) {
+        // zero or subnormal
+        const float value = static_cast<float>(mantissa) * (1.0f / 16777216.0f); // 2^-24
+        return AsFloat(AsUint(value) | sign);
+    } else if (exponent == 0x1fu) {
+        return AsFloat(sign | 0x7f800000u | (mantissa << 13));
+    } else {
+        return AsFloat(sign | ((exponent + 112u) << 23) | (mantissa << 13));
+    }
+}
+
+uint32_t RGBToRGB9E5(const float r, const float g, const float b) {
+    // NaNs and negatives go to zero
+    const float rc = (r > 0.0f) ? ((r < sRGB9E5MaxValue) ? r : sRGB9E5MaxValue) : 0.0f;
+    const float gc = (g > 0.0f) ? ((g < sRGB9E5MaxValue) ? g : sRGB9E5MaxValue) : 0.0f;
+    const float bc = (b > 0.0f) ? ((b < sRGB9E5MaxValue) ? b : sRGB9E5MaxValue) : 0.0f;
+
+    const float maxc = (rc > gc) ? ((rc > bc) ? rc : bc) : ((gc > bc) ? gc : bc);
+
+    // floor(log2(maxc)) straight from the float exponent
+    int expShared = static_cast<int>((AsUint(maxc) >> 23) & 0xffu) - 127;
+    if (expShared < -sRGB9E5ExpBias - 1) {
+        expShared = -sRGB9E5ExpBias - 1;
+    }
+    expShared += 1 + sRGB9E5ExpBias;
+
+    float invScale = AsFloat(static_cast<uint32_t>(127 - (expShared - sRGB9E5ExpBias - sRGB9E5MantissaBits)) << 23);
+    if (static_cast<uint32_t>(maxc * invScale + 0.5f) == (1u << sRGB9E5MantissaBits)) {
+        ++expShared;
+        invScale *= 0.5f;
+    }
+
+    const uint32_t rm = static_cast<uint32_t>(rc * invScale + 0.5f);
+    const uint32_t gm = static_cast<uint32_t>(gc * invScale + 0.5f);
+    const uint32_t bm = static_cast<uint32_t>(bc * invScale + 0.5f);
+
+    return rm | (gm << 9) | (bm << 18) | (static_cast<uint32_t>(expShared) << 27);
+}
+
+void RGB9E5ToRGB(const uint32_t v, float* rgb) {
+    const int expShared = static_cast<int>(v >> 27);
+    const float scale = AsFloat(static_cast<uint32_t>(127 + expShared - sRGB9E5ExpBias - sRGB9E5MantissaBits) << 23);
+
+    rgb[0] = static_cast<float>(v & 0x1ffu) * scale;
+    rgb[1] = static_cast<float>((v >> 9) & 0x1ffu) * scale;
+    rgb[2] = static_cast<float>((v >> 18) & 0x1ffu) * scale;
+}
+
+
+#ifdef IMAGECONVERT_SSE2
+
+static inline __m128i Select(const __m128i mask, const __m128i a, const __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+#ifndef IMAGECONVERT_F16C
+// 4 floats -> 4 halfs (in the low 16 bits of each lane), same math as FloatToHalf
+static inline __m128i FloatToHalf4(const __m128 f) {
+    const __m128i kInfOrMax   = _mm_set1_epi32(0x47800000);
+    const __m128i kMinNormal  = _mm_set1_epi32(0x38800000);
+    const __m128i kSubMagic   = _mm_set1_epi32(0x3f000000);
+    const __m128i kNormalBias = _mm_set1_epi32(static_cast<int>(0xc8000fffu));
+    const __m128i kInf        = _mm_set1_epi32(0x7c00);
+    const __m128i kNaNBit     = _mm_set1_epi32(0x0200);
+    const __m128i kOne        = _mm_set1_epi32(1);
+
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 sign = _mm_and_ps(f, signMask);
+    const __m128 absf = _mm_xor_ps(f, sign);
+    const __m128i absBits = _mm_castps_si128(absf);
+
+    const __m128i isRegular = _mm_cmpgt_epi32(kInfOrMax, absBits);
+    const __m128i isSubnormal = _mm_cmpgt_epi32(kMinNormal, absBits);
+    const __m128i isNaN = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+
+    const __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(kSubMagic))), kSubMagic);
+
+    const __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(absBits, 13), kOne);
+    const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(absBits, kNormalBias), mantissaOdd), 13);
+
+    const __m128i special = _mm_or_si128(kInf, _mm_and_si128(isNaN, kNaNBit));
+    const __m128i magnitude = Select(isRegular, Select(isSubnormal, subnormal, normal), special);
+
+    return _mm_or_si128(magnitude, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+#endif // IMAGECONVERT_F16C
+
+#endif // IMAGECONVERT_SSE2
+
+
+void ConvertRGBA32FToRGBA16F(const float* src, uint16_t* dst, const size_t numTexels) {
+    const size_t numValues = numTexels * 4;
+    size_t i = 0;
+
+#if defined(IMAGECONVERT_F16C)
+    for (; i + 8 <= numValues; i += 8) {
+        const __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        const __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+#elif defined(IMAGECONVERT_SSE2)
+    for (; i + 8 <= numValues; i += 8) {
+        const __m128i lo = FloatToHalf4(_mm_loadu_ps(src + i));
+        const __m128i hi = FloatToHalf4(_mm_loadu_ps(src + i + 4));
+        // lanes are sign-extended 16 bit values, so signed saturation keeps them intact
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+
+    for (; i < numValues; ++i) {
+        dst[i] = FloatToHalf(src[i]);
+    }
+}
+
+void ConvertRGBA32FToRGB9E5(const float* src, uint32_t* dst, const size_t numTexels) {
+    size_t i = 0;
+
+#ifdef IMAGECONVERT_SSE2
+    const __m128 kZero = _mm_setzero_ps();
+    const __m128 kMax = _mm_set1_ps(sRGB9E5MaxValue);
+    const __m128 kHalf = _mm_set1_ps(0.5f);
+    const __m128i kMinExp = _mm_set1_epi32(-sRGB9E5ExpBias - 1);
+    const __m128i kExpFieldMask = _mm_set1_epi32(0xff);
+    const __m128i kMantissaOverflow = _mm_set1_epi32(1 << sRGB9E5MantissaBits);
+    const __m128i kInvScaleBase = _mm_set1_epi32(127 + sRGB9E5ExpBias + sRGB9E5MantissaBits);
+    const __m128i kOne = _mm_set1_epi32(1);
+
+    // 4 texels at a time, transposed so every lane is one texel
+    for (; i + 4 <= numTexels; i += 4) {
+        __m128 r = _mm_loadu_ps(src + i * 4 + 0);
+        __m128 g = _mm_loadu_ps(src + i * 4 + 4);
+        __m128 b = _mm_loadu_ps(src + i * 4 + 8);
+        __m128 a = _mm_loadu_ps(src + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        // max/min with zero first also flushes NaNs to zero
+        r = _mm_min_ps(_mm_max_ps(r, kZero), kMax);
+        g = _mm_min_ps(_mm_max_ps(g, kZero), kMax);
+        b = _mm_min_ps(_mm_max_ps(b, kZero), kMax);
+
+        const __m128 maxc = _mm_max_ps(r, _mm_max_ps(g, b));
+
+        __m128i expShared = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(_mm_castps_si128(maxc), 23), kExpFieldMask), _mm_set1_epi32(127));
+        expShared = Select(_mm_cmpgt_epi32(kMinExp, expShared), kMinExp, expShared);
+        expShared = _mm_add_epi32(expShared, _mm_set1_epi32(1 + sRGB9E5ExpBias));
+
+        // 1 / 2^(exp - bias - mantissaBits), built directly as float bits
+        __m128 invScale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(kInvScaleBase, expShared), 23));
+
+        const __m128i maxm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxc, invScale), kHalf));
+        const __m128i overflow = _mm_cmpeq_epi32(maxm, kMantissaOverflow);
+        expShared = _mm_add_epi32(expShared, _mm_and_si128(overflow, kOne));
+        invScale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(kInvScaleBase, expShared), 23));
+
+        const __m128i rm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, invScale), kHalf));
+        const __m128i gm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, invScale), kHalf));
+        const __m128i bm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, invScale), kHalf));
+
+        __m128i packed = _mm_or_si128(rm, _mm_slli_epi32(gm, 9));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(bm, 18));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(expShared, 27));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#endif // IMAGECONVERT_SSE2
+
+    for (; i < numTexels; ++i) {
+        dst[i] = RGBToRGB9E5(src[i * 4 + 0], src[i * 4 + 1], src[i * 4 + 2]);
+    }
+}
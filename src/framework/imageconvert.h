@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// what we store HDR images as on the GPU
+enum class HDRFormat {
+    Float32,    // R32G32B32A32_SFLOAT, 16 bytes per texel
+    Float16,    // R16G16B16A16_SFLOAT,  8 bytes per texel
+    RGB9E5      // E5B9G9R9_UFLOAT_PACK32, 4 bytes per texel, no alpha and no negatives
+};
+
+// bulk converters, src is tightly packed RGBA32F
+void        ConvertRGBA32FToRGBA16F(const float* src, uint16_t* dst, const size_t numTexels);
+void        ConvertRGBA32FToRGB9E5(const float* src, uint32_t* dst, const size_t numTexels);
+
+// single values
+uint16_t    FloatToHalf(const float f);
+float       HalfToFloat(const uint16_t h);
+uint32_t    RGBToRGB9E5(const float r, const float g, const float b);
+void        RGB9E5ToRGB(const uint32_t v, float* rgb);
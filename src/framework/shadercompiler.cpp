@@ -0,0 +1,257 @@
+#include "shadercompiler.h"
+#include "tracer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring> // for memcpy
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static const uint64_t sHashSeed = 14695981039346656037ull;     // FNV-1a 64
+static const uint64_t sHashPrime = 1099511628211ull;
+
+static uint64_t HashBytes(const void* data, const size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * sHashPrime;
+    }
+    return hash;
+}
+
+static uint64_t HashString(const String& str, uint64_t hash) {
+    // the terminator too, so "ab" + "c" and "a" + "bc" differ
+    return HashBytes(str.c_str(), str.size() + 1, hash);
+}
+
+// glslangValidator's -S names
+static const char* GetStageName(const VkShaderStageFlagBits stage) {
+    switch (stage) {
+        case VK_SHADER_STAGE_RAYGEN_BIT_KHR:        return "rgen";
+        case VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR:   return "rchit";
+        case VK_SHADER_STAGE_ANY_HIT_BIT_KHR:       return "rahit";
+        case VK_SHADER_STAGE_MISS_BIT_KHR:          return "rmiss";
+        case VK_SHADER_STAGE_INTERSECTION_BIT_KHR:  return "rint";
+        case VK_SHADER_STAGE_CALLABLE_BIT_KHR:      return "rcall";
+        case VK_SHADER_STAGE_COMPUTE_BIT:           return "comp";
+        case VK_SHADER_STAGE_VERTEX_BIT:            return "vert";
+        case VK_SHADER_STAGE_FRAGMENT_BIT:          return "frag";
+        default:                                    return nullptr;
+    }
+}
+
+// cmd /c, which std::system and _popen go through on Windows, strips the first and the last quote of the line,
+// an extra pair keeps the quoted paths intact
+static String MakeShellCommand(const String& command) {
+#ifdef _WIN32
+    return "\"" + command + "\"";
+#else
+    return command;
+#endif
+}
+
+// whatever the command prints to stdout, empty if it can't be run
+static String ReadCommandOutput(const String& command) {
+#ifdef _WIN32
+    FILE* pipe = _popen(MakeShellCommand(command).c_str(), "r");
+#else
+    FILE* pipe = popen(MakeShellCommand(command).c_str(), "r");
+#endif
+    if (!pipe) {
+        return String();
+    }
+
+    String output;
+    char buffer[256];
+    while (std::fgets(buffer, sizeof(buffer), pipe)) {
+        output += buffer;
+    }
+
+#ifdef _WIN32
+    _pclose(pipe);
+#else
+    pclose(pipe);
+#endif
+    return output;
+}
+
+static bool ReadSPIRV(const fs::path& path, Array<uint32_t>& spirv) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    const Array<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.empty() || (bytes.size() % sizeof(uint32_t)) != 0) {
+        return false;
+    }
+
+    spirv.resize(bytes.size() / sizeof(uint32_t));
+    std::memcpy(spirv.data(), bytes.data(), bytes.size());
+    return true;
+}
+
+
+ShaderCompiler::ShaderCompiler()
+    : mEnabled(false)
+    , mCompilerHash(sHashSeed)
+{
+}
+
+bool ShaderCompiler::Initialize(const String& sourceFolder, const String& cacheFolder, const String& compiler) {
+    std::error_code ec;
+    if (!fs::is_directory(sourceFolder, ec)) {
+        std::printf("Shader sources folder %s doesn't exist, using the precompiled shaders\n", sourceFolder.c_str());
+        return false;
+    }
+
+    fs::create_directories(cacheFolder, ec);
+    if (ec) {
+        std::printf("Can't create the shader cache folder %s\n", cacheFolder.c_str());
+        return false;
+    }
+
+    mSourceFolder = sourceFolder;
+    mCacheFolder = cacheFolder;
+    mCompiler = compiler;
+
+    // a different compiler, or an update of the same one, must not get the SPIR-V of the old one
+    const String version = ReadCommandOutput("\"" + mCompiler + "\" --version");
+    if (version.empty()) {
+        std::printf("Can't get the version of %s, shaders won't compile\n", mCompiler.c_str());
+    }
+    mCompilerHash = HashString(version, HashString(mCompiler, sHashSeed));
+
+    mEnabled = true;
+    return true;
+}
+
+bool ShaderCompiler::IsEnabled() const {
+    return mEnabled;
+}
+
+bool ShaderCompiler::Compile(const String& fileName, const VkShaderStageFlagBits stage, const Array<String>& defines, Array<uint32_t>& spirv) {
+    const char* stageName = GetStageName(stage);
+    if (!mEnabled || !stageName) {
+        return false;
+    }
+
+    const fs::path sourcePath = mSourceFolder / fileName;
+
+    uint64_t hash = mCompilerHash;
+    Array<String> visited;
+    if (!this->HashSource(sourcePath, hash, visited)) {
+        std::printf("Can't read shader %s\n", sourcePath.string().c_str());
+        return false;
+    }
+
+    hash = HashString(stageName, hash);
+    for (const String& define : defines) {
+        hash = HashString(define, hash);
+    }
+
+    char hashText[17];
+    std::snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(hash));
+    const fs::path cachePath = mCacheFolder / (sourcePath.stem().string() + "_" + hashText + ".spv");
+
+    if (ReadSPIRV(cachePath, spirv)) {
+        return true;
+    }
+
+    trace::ScopedEvent event("Compile shader");
+
+    // written next to the cached one and renamed, a compile that dies halfway can't leave a broken entry
+    const fs::path tempPath = mCacheFolder / (cachePath.filename().string() + ".tmp");
+
+    std::ostringstream command;
+    command << "\"" << mCompiler << "\" --target-env vulkan1.2 -V -S " << stageName;
+    for (const String& define : defines) {
+        command << " -D" << define;
+    }
+    command << " \"" << sourcePath.string() << "\" -o \"" << tempPath.string() << "\"";
+
+    std::printf("Compiling %s\n", sourcePath.string().c_str());
+    const int exitCode = std::system(MakeShellCommand(command.str()).c_str());
+
+    std::error_code ec;
+    if (exitCode != 0) {
+        std::printf("Failed to compile %s (%s returned %d)\n", sourcePath.string().c_str(), mCompiler.c_str(), exitCode);
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    fs::rename(tempPath, cachePath, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    return ReadSPIRV(cachePath, spirv);
+}
+
+bool ShaderCompiler::CheckForChanges() {
+    bool changed = false;
+
+    std::error_code ec;
+    for (auto& it : mWatchedFiles) {
+        const fs::file_time_type writeTime = fs::last_write_time(it.first, ec);
+        // editors often delete and recreate the file, skip the moment it's missing
+        if (!ec && writeTime != it.second) {
+            it.second = writeTime;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool ShaderCompiler::HashSource(const fs::path& path, uint64_t& hash, Array<String>& visited) {
+    const String key = path.lexically_normal().string();
+    for (const String& v : visited) {
+        if (v == key) {
+            return true;
+        }
+    }
+    visited.push_back(key);
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    const String source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    hash = HashString(source, hash);
+
+    std::error_code ec;
+    const fs::file_time_type writeTime = fs::last_write_time(path, ec);
+    if (!ec && mWatchedFiles.find(key) == mWatchedFiles.end()) {
+        mWatchedFiles[key] = writeTime;
+    }
+
+    // only the quoted form, relative to the including file, that's all GL_GOOGLE_include_directive does for us
+    std::istringstream lines(source);
+    String line;
+    while (std::getline(lines, line)) {
+        const size_t directive = line.find("#include");
+        if (directive == String::npos || line.find_first_not_of(" \t") != directive) {
+            continue;
+        }
+
+        const size_t open = line.find('"', directive);
+        const size_t close = (open == String::npos) ? String::npos : line.find('"', open + 1);
+        if (close == String::npos) {
+            continue;
+        }
+
+        // not every include is meant for GLSL (shared_with_shaders.h pulls common.h in for C++ only),
+        // one that can't be found just goes in by name and the compiler complains if it's really needed
+        const String includeName = line.substr(open + 1, close - open - 1);
+        if (!this->HashSource(path.parent_path() / includeName, hash, visited)) {
+            hash = HashString(includeName, hash);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "vulkanhelpers.h"
+
+#include <filesystem>
+#include <unordered_map>
+
+// GLSL to SPIR-V at runtime through glslangValidator, so the shaders can be edited while the app runs.
+// Results are cached on disk under a hash of the compiler and its version, the source, everything it includes,
+// the stage and the defines, a shader that didn't change never goes through the compiler again.
+class ShaderCompiler {
+public:
+    ShaderCompiler();
+
+    // compiler - glslangValidator executable, either a path or just the name if it's on the PATH
+    bool    Initialize(const String& sourceFolder, const String& cacheFolder, const String& compiler);
+    bool    IsEnabled() const;
+
+    // fileName is relative to the source folder, compile errors go to stdout
+    bool    Compile(const String& fileName, const VkShaderStageFlagBits stage, const Array<String>& defines, Array<uint32_t>& spirv);
+
+    // true if any source or include seen by Compile has been written since the last call
+    bool    CheckForChanges();
+
+private:
+    // hashes the file and everything it includes, recursively, and starts watching them
+    bool    HashSource(const std::filesystem::path& path, uint64_t& hash, Array<String>& visited);
+
+private:
+    bool                                                    mEnabled;
+    std::filesystem::path                                   mSourceFolder;
+    std::filesystem::path                                   mCacheFolder;
+    String                                                  mCompiler;
+    uint64_t                                                mCompilerHash;  // path and --version output
+    std::unordered_map<String, std::filesystem::file_time_type> mWatchedFiles;
+};
@@ -0,0 +1,111 @@
+#include "startuptimeline.h"
+#include "tracer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
+namespace startup {
+
+namespace __details {
+    std::mutex                              sMutex;
+    Array<Phase>                            sPhases;
+    Array<size_t>                           sOpenPhases;    // indices into sPhases, innermost last
+    bool                                    sStarted = false;
+    std::chrono::steady_clock::time_point   sStartTime;
+
+    double NowMs() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sStartTime).count();
+    }
+} // namespace __details
+
+
+void BeginPhase(const char* name) {
+    std::lock_guard<std::mutex> lock(__details::sMutex);
+
+    if (!__details::sStarted) {
+        __details::sStarted = true;
+        __details::sStartTime = std::chrono::steady_clock::now();
+    }
+
+    Phase phase;
+    phase.name = name;
+    phase.depth = static_cast<uint32_t>(__details::sOpenPhases.size());
+    phase.startMs = __details::NowMs();
+    phase.wallMs = 0.0;
+    phase.gpuWaitMs = 0.0;
+
+    __details::sOpenPhases.push_back(__details::sPhases.size());
+    __details::sPhases.push_back(phase);
+}
+
+void EndPhase() {
+    std::lock_guard<std::mutex> lock(__details::sMutex);
+
+    if (__details::sOpenPhases.empty()) {
+        return;
+    }
+
+    Phase& phase = __details::sPhases[__details::sOpenPhases.back()];
+    phase.wallMs = __details::NowMs() - phase.startMs;
+    __details::sOpenPhases.pop_back();
+
+    const uint64_t endNs = trace::GetTimeNs();
+    trace::AddCPUEvent(phase.name, endNs - static_cast<uint64_t>(phase.wallMs * 1e6), endNs);
+}
+
+void AddGPUWait(const double ms) {
+    std::lock_guard<std::mutex> lock(__details::sMutex);
+
+    for (const size_t index : __details::sOpenPhases) {
+        __details::sPhases[index].gpuWaitMs += ms;
+    }
+}
+
+Array<Phase> GetPhases() {
+    std::lock_guard<std::mutex> lock(__details::sMutex);
+    return __details::sPhases;
+}
+
+String GetReport() {
+    const Array<Phase> phases = GetPhases();
+
+    String report;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-48s %10s %12s\n", "Startup phase", "wall ms", "GPU wait ms");
+    report += line;
+
+    for (const Phase& phase : phases) {
+        const String name = String(phase.depth * 2, ' ') + phase.name;
+        std::snprintf(line, sizeof(line), "%-48s %10.2f %12.2f\n", name.c_str(), phase.wallMs, phase.gpuWaitMs);
+        report += line;
+    }
+
+    return report;
+}
+
+bool WriteJSON(const String& fileName) {
+    const Array<Phase> phases = GetPhases();
+
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // one phase per line, so two runs diff nicely
+    file << "{\n  \"phases\": [";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const Phase& phase = phases[i];
+        file << (i ? ",\n" : "\n")
+             << "    { \"name\": \"" << EscapeJSON(phase.name) << "\""
+             << ", \"depth\": " << phase.depth
+             << ", \"startMs\": " << ToString(phase.startMs, 3)
+             << ", \"wallMs\": " << ToString(phase.wallMs, 3)
+             << ", \"gpuWaitMs\": " << ToString(phase.gpuWaitMs, 3) << " }";
+    }
+    file << "\n  ]\n}\n";
+
+    return file.good();
+}
+
+} // namespace startup
@@ -0,0 +1,43 @@
+#pragma once
+#include "common.h"
+
+#include <chrono>
+
+// Wall time of the nested startup phases, with the part of it the CPU sat waiting for the GPU.
+// Phases are opened and closed on the thread that runs the startup, GPU waits may come from anywhere.
+namespace startup {
+
+    struct Phase {
+        String      name;
+        uint32_t    depth;
+        double      startMs;        // since the first phase was opened
+        double      wallMs;
+        double      gpuWaitMs;
+    };
+
+    void                BeginPhase(const char* name);
+    void                EndPhase();
+    // charged to every phase open at the moment, ignored once the startup is over
+    void                AddGPUWait(const double ms);
+
+    Array<Phase>        GetPhases();
+    String              GetReport();
+    bool                WriteJSON(const String& fileName);
+
+    class ScopedPhase {
+    public:
+        explicit ScopedPhase(const char* name) { BeginPhase(name); }
+        ~ScopedPhase() { EndPhase(); }
+    };
+
+    // put around vkQueueWaitIdle, vkWaitForFences and the like
+    class ScopedGPUWait {
+    public:
+        ScopedGPUWait() : mStart(std::chrono::steady_clock::now()) { }
+        ~ScopedGPUWait() { AddGPUWait(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count()); }
+
+    private:
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+} // namespace startup
@@ -0,0 +1,120 @@
+#include "threadpool.h"
+#include "tracer.h"
+
+ThreadPool::ThreadPool()
+    : mNumBusy(0)
+    , mStopping(false)
+{
+}
+ThreadPool::~ThreadPool() {
+    this->Shutdown();
+}
+
+void ThreadPool::Initialize(const size_t numThreads) {
+    size_t threadsToStart = numThreads;
+    if (!threadsToStart) {
+        threadsToStart = Max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    mStopping = false;
+    mThreads.reserve(threadsToStart);
+    for (size_t i = 0; i < threadsToStart; ++i) {
+        mThreads.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+void ThreadPool::Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mTaskAvailable.notify_all();
+
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+    mThreads.clear();
+    mTasks.clear();
+}
+
+void ThreadPool::Enqueue(Task task) {
+    // no workers - just do the job right here
+    if (mThreads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.push_back(std::move(task));
+    }
+    mTaskAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasksDone.wait(lock, [this]() { return mTasks.empty() && !mNumBusy; });
+}
+
+void ThreadPool::ParallelFor(const size_t count, const std::function<void(const size_t)>& func) {
+    if (!count) {
+        return;
+    }
+
+    const size_t numChunks = Min(count, Max<size_t>(1, mThreads.size()));
+    const size_t chunkSize = (count + numChunks - 1) / numChunks;
+
+    for (size_t first = 0; first < count; first += chunkSize) {
+        const size_t last = Min(first + chunkSize, count);
+        this->Enqueue([first, last, &func]() {
+            for (size_t i = first; i < last; ++i) {
+                func(i);
+            }
+        });
+    }
+
+    this->Wait();
+}
+
+void ThreadPool::ParallelFor(ThreadPool* threadPool, const size_t count, const std::function<void(const size_t)>& func) {
+    if (threadPool) {
+        threadPool->ParallelFor(count, func);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+    }
+}
+
+size_t ThreadPool::GetNumThreads() const {
+    return mThreads.size();
+}
+
+void ThreadPool::WorkerLoop() {
+    trace::SetThreadName("Worker");
+
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mTaskAvailable.wait(lock, [this]() { return mStopping || !mTasks.empty(); });
+            if (mStopping && mTasks.empty()) {
+                return;
+            }
+
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+            ++mNumBusy;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mNumBusy;
+            if (mTasks.empty() && !mNumBusy) {
+                mTasksDone.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "common.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    // numThreads == 0 means "use all hardware threads"
+    void    Initialize(const size_t numThreads = 0);
+    void    Shutdown();
+
+    void    Enqueue(Task task);
+    // blocks until all enqueued tasks are done, must not be called from a worker thread
+    void    Wait();
+    // splits [0, count) into chunks and runs func(i) for every index on the workers, then waits
+    void    ParallelFor(const size_t count, const std::function<void(const size_t)>& func);
+    // same on the given pool, or serially on the calling thread if there is none
+    static void ParallelFor(ThreadPool* threadPool, const size_t count, const std::function<void(const size_t)>& func);
+
+    size_t  GetNumThreads() const;
+
+private:
+    void    WorkerLoop();
+
+private:
+    Array<std::thread>      mThreads;
+    std::deque<Task>        mTasks;
+    std::mutex              mMutex;
+    std::condition_variable mTaskAvailable;
+    std::condition_variable mTasksDone;
+    size_t                  mNumBusy;
+    bool                    mStopping;
+};
@@ -0,0 +1,66 @@
+#include "tilescheduler.h"
+
+#include <algorithm>
+
+
+TileScheduler::TileScheduler()
+    : mNextTile(0)
+{
+}
+
+void TileScheduler::Initialize(const uint32_t width, const uint32_t height, const uint32_t tileSize, const Order order) {
+    mTiles.clear();
+    mNextTile = 0;
+
+    if (!width || !height) {
+        return;
+    }
+
+    const uint32_t tileWidth = tileSize ? Min(tileSize, width) : width;
+    const uint32_t tileHeight = tileSize ? Min(tileSize, height) : height;
+
+    for (uint32_t y = 0; y < height; y += tileHeight) {
+        for (uint32_t x = 0; x < width; x += tileWidth) {
+            mTiles.push_back({ x, y, Min(tileWidth, width - x), Min(tileHeight, height - y) });
+        }
+    }
+
+    if (order == Order::CenterFirst) {
+        // distances are doubled to stay in integers
+        auto distanceToCenter = [width, height](const Tile& tile) -> uint64_t {
+            const int64_t dx = static_cast<int64_t>(tile.x * 2 + tile.width) - static_cast<int64_t>(width);
+            const int64_t dy = static_cast<int64_t>(tile.y * 2 + tile.height) - static_cast<int64_t>(height);
+            return static_cast<uint64_t>(dx * dx + dy * dy);
+        };
+
+        std::stable_sort(mTiles.begin(), mTiles.end(), [&distanceToCenter](const Tile& a, const Tile& b) {
+            return distanceToCenter(a) < distanceToCenter(b);
+        });
+    }
+}
+
+void TileScheduler::Restart() {
+    mNextTile = 0;
+}
+
+uint32_t TileScheduler::NextTiles(const uint32_t maxTiles, Array<Tile>& tiles) {
+    const uint32_t numLeft = this->GetNumTiles() - mNextTile;
+    const uint32_t count = maxTiles ? Min(maxTiles, numLeft) : numLeft;
+
+    tiles.insert(tiles.end(), mTiles.begin() + mNextTile, mTiles.begin() + mNextTile + count);
+    mNextTile += count;
+
+    return count;
+}
+
+bool TileScheduler::IsPassStarted() const {
+    return mNextTile > 0;
+}
+
+bool TileScheduler::IsPassComplete() const {
+    return mNextTile >= this->GetNumTiles();
+}
+
+uint32_t TileScheduler::GetNumTiles() const {
+    return static_cast<uint32_t>(mTiles.size());
+}
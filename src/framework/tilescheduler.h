@@ -0,0 +1,40 @@
+#pragma once
+#include "common.h"
+
+#include <cstdint>
+
+// Splits a big 2D launch into tiles and hands them out a few at a time, so a single pass over
+// the image can be spread across several submissions.
+class TileScheduler {
+public:
+    enum class Order {
+        Scanline,       // left to right, top to bottom
+        CenterFirst     // closest to the image center first, that's where people look
+    };
+
+    struct Tile {
+        uint32_t    x;
+        uint32_t    y;
+        uint32_t    width;
+        uint32_t    height;
+    };
+
+    TileScheduler();
+    ~TileScheduler() = default;
+
+    // tileSize == 0 means the whole image is one tile
+    void            Initialize(const uint32_t width, const uint32_t height, const uint32_t tileSize, const Order order);
+
+    // starts a new pass over the image
+    void            Restart();
+    // appends up to maxTiles tiles (0 - all the remaining ones) of the current pass, returns how many were added
+    uint32_t        NextTiles(const uint32_t maxTiles, Array<Tile>& tiles);
+
+    bool            IsPassStarted() const;
+    bool            IsPassComplete() const;
+    uint32_t        GetNumTiles() const;
+
+private:
+    Array<Tile>     mTiles;         // in the order they are handed out
+    uint32_t        mNextTile;
+};
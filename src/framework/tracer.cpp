@@ -0,0 +1,139 @@
+#include "tracer.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace trace {
+
+namespace __details {
+    struct Event {
+        String      name;
+        uint64_t    startNs;
+        uint64_t    endNs;
+    };
+
+    struct ThreadEvents {
+        std::mutex      mutex;      // only ever contended while the trace is written
+        uint32_t        tid;
+        String          name;
+        Array<Event>    events;
+    };
+
+    std::atomic<bool>                       sEnabled(false);
+    std::mutex                              sMutex;
+    Array<std::shared_ptr<ThreadEvents>>    sThreads;       // keeps the buffers of finished threads alive
+    Array<Event>                            sGPUEvents;
+
+    thread_local String                         tThreadName;
+    thread_local std::shared_ptr<ThreadEvents>  tEvents;
+
+    ThreadEvents& GetThreadEvents() {
+        if (!tEvents) {
+            tEvents = std::make_shared<ThreadEvents>();
+
+            std::lock_guard<std::mutex> lock(sMutex);
+            tEvents->tid = static_cast<uint32_t>(sThreads.size() + 1);
+            tEvents->name = tThreadName.empty() ? ("Thread " + std::to_string(tEvents->tid)) : tThreadName;
+            sThreads.push_back(tEvents);
+        }
+        return *tEvents;
+    }
+
+    void WriteEvent(std::ofstream& file, const Event& event, const uint64_t baseNs, const uint32_t pid, const uint32_t tid) {
+        // Chrome wants microseconds, signed in case the GPU calibration is a bit off
+        const double ts = (static_cast<double>(event.startNs) - static_cast<double>(baseNs)) * 1e-3;
+        const double dur = (event.endNs > event.startNs) ? static_cast<double>(event.endNs - event.startNs) * 1e-3 : 0.0;
+
+        file << ",\n    { \"name\": \"" << EscapeJSON(event.name) << "\", \"ph\": \"X\""
+             << ", \"ts\": " << ToString(ts, 3) << ", \"dur\": " << ToString(dur, 3)
+             << ", \"pid\": " << pid << ", \"tid\": " << tid << " }";
+    }
+} // namespace __details
+
+
+void Start() {
+    __details::sEnabled = true;
+}
+
+bool IsEnabled() {
+    return __details::sEnabled;
+}
+
+void SetThreadName(const char* name) {
+    __details::tThreadName = name;
+    if (__details::tEvents) {
+        std::lock_guard<std::mutex> lock(__details::tEvents->mutex);
+        __details::tEvents->name = name;
+    }
+}
+
+uint64_t GetTimeNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void AddCPUEvent(const String& name, const uint64_t startNs, const uint64_t endNs) {
+    if (!__details::sEnabled) {
+        return;
+    }
+
+    __details::ThreadEvents& thread = __details::GetThreadEvents();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.events.push_back({ name, startNs, endNs });
+}
+
+void AddGPUEvent(const String& name, const uint64_t startNs, const uint64_t endNs) {
+    if (!__details::sEnabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(__details::sMutex);
+    __details::sGPUEvents.push_back({ name, startNs, endNs });
+}
+
+bool WriteChromeTrace(const String& fileName) {
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(__details::sMutex);
+
+    // the earliest event is zero, so the numbers stay readable
+    uint64_t baseNs = ~0ull;
+    for (const auto& thread : __details::sThreads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        for (const __details::Event& event : thread->events) {
+            baseNs = Min(baseNs, event.startNs);
+        }
+    }
+    for (const __details::Event& event : __details::sGPUEvents) {
+        baseNs = Min(baseNs, event.startNs);
+    }
+
+    // CPU threads go into process 1, the GPU queue into process 2, so they get their own groups
+    file << "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n";
+    file << "    { \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": { \"name\": \"CPU\" } },\n";
+    file << "    { \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 2, \"args\": { \"name\": \"GPU\" } },\n";
+    file << "    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 2, \"tid\": 0, \"args\": { \"name\": \"Graphics queue\" } }";
+
+    for (const auto& thread : __details::sThreads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        file << ",\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->tid
+             << ", \"args\": { \"name\": \"" << EscapeJSON(thread->name) << "\" } }";
+        for (const __details::Event& event : thread->events) {
+            __details::WriteEvent(file, event, baseNs, 1, thread->tid);
+        }
+    }
+    for (const __details::Event& event : __details::sGPUEvents) {
+        __details::WriteEvent(file, event, baseNs, 2, 0);
+    }
+
+    file << "\n  ]\n}\n";
+
+    return file.good();
+}
+
+} // namespace trace
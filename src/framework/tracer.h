@@ -0,0 +1,34 @@
+#pragma once
+#include "common.h"
+
+// Timeline of CPU scopes from every thread plus GPU scopes mapped onto the same clock,
+// written out in the Chrome trace format (chrome://tracing, Perfetto).
+// Every thread records into its own buffer, so scopes from the workers don't contend with each other.
+namespace trace {
+
+    void        Start();
+    bool        IsEnabled();
+
+    // shows up as the thread's row name, may be called before Start
+    void        SetThreadName(const char* name);
+
+    // the host clock every event is stamped with (CLOCK_MONOTONIC on Linux)
+    uint64_t    GetTimeNs();
+
+    void        AddCPUEvent(const String& name, const uint64_t startNs, const uint64_t endNs);
+    // already converted to the host clock
+    void        AddGPUEvent(const String& name, const uint64_t startNs, const uint64_t endNs);
+
+    bool        WriteChromeTrace(const String& fileName);
+
+    class ScopedEvent {
+    public:
+        explicit ScopedEvent(const char* name) : mName(name), mStart(IsEnabled() ? GetTimeNs() : 0) { }
+        ~ScopedEvent() { if (mStart) { AddCPUEvent(mName, mStart, GetTimeNs()); } }
+
+    private:
+        const char* mName;
+        uint64_t    mStart;
+    };
+
+} // namespace trace
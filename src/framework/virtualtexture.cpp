@@ -0,0 +1,755 @@
+#include "virtualtexture.h"
+#include "threadpool.h"
+#include "startuptimeline.h"
+#include "tracer.h"
+
+#include <cstring> // for memcpy
+#include <cmath>
+
+
+static const float* GetSrgbToLinearTable() {
+    static const Array<float> table = []() {
+        Array<float> result(256);
+        for (size_t i = 0; i < 256; ++i) {
+            const float c = static_cast<float>(i) / 255.0f;
+            result[i] = (c <= 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return result;
+    }();
+    return table.data();
+}
+
+static uint8_t LinearToSrgbByte(const float c) {
+    const float srgb = (c <= 0.0031308f) ? (12.92f * c) : (1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f);
+    return static_cast<uint8_t>(Clamp(srgb, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// number of pages along one side of the given mip
+static uint32_t PagesAlong(const uint32_t size, const uint32_t mip) {
+    return (Max(size >> mip, 1u) + VirtualTextureSystem::kPageSize - 1) / VirtualTextureSystem::kPageSize;
+}
+
+
+VirtualTextureSystem::VirtualTextureSystem()
+    : mDevice(VK_NULL_HANDLE)
+    , mCommandPool(VK_NULL_HANDLE)
+    , mQueue(VK_NULL_HANDLE)
+    , mPoolSizeInPages(0)
+    , mFramesInFlight(0)
+    , mEvictionDelay(0)
+    , mFeedbackSliceSize(0)
+    , mLRUHead(~0u)
+    , mLRUTail(~0u)
+    , mNumUsedSlots(0)
+    , mPoolImageInfo({})
+    , mFeedback(nullptr)
+    , mUploadBatches()
+    , mCurrentBatch(0)
+    , mStopping(false)
+{
+}
+VirtualTextureSystem::~VirtualTextureSystem() {
+    this->Destroy();
+}
+
+bool VirtualTextureSystem::Initialize(VkDevice device,
+                                      VkCommandPool commandPool,
+                                      VkQueue queue,
+                                      const uint32_t poolSizeInPages,
+                                      const uint32_t framesInFlight,
+                                      const VkDeviceSize feedbackAlignment) {
+    mDevice = device;
+    mCommandPool = commandPool;
+    mQueue = queue;
+    mPoolSizeInPages = poolSizeInPages;
+    mFramesInFlight = Max(framesInFlight, 1u);
+    // every frame in flight may still sample the page, plus the one being recorded
+    mEvictionDelay = mFramesInFlight + 1;
+
+    // the request count followed by the page ids
+    const VkDeviceSize alignment = Max<VkDeviceSize>(feedbackAlignment, 1);
+    mFeedbackSliceSize = ((sizeof(uint32_t) * (1 + kMaxFeedbackRequests) + alignment - 1) / alignment) * alignment;
+
+    const uint32_t poolSize = poolSizeInPages * kPageSlotSize;
+
+    VkResult error = mPagePool.Create(VK_IMAGE_TYPE_2D,
+                                      VK_FORMAT_R8G8B8A8_SRGB,
+                                      { poolSize, poolSize, 1 },
+                                      VK_IMAGE_TILING_OPTIMAL,
+                                      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = 1;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = 1;
+
+    // pages carry their own borders, so no wrapping and no mips here
+    mPagePool.CreateImageView(VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB, subresourceRange);
+    mPagePool.CreateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+    mPoolImageInfo.sampler = mPagePool.GetSampler();
+    mPoolImageInfo.imageView = mPagePool.GetImageView();
+    mPoolImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    mSlots.resize(static_cast<size_t>(poolSizeInPages) * poolSizeInPages);
+    for (Slot& slot : mSlots) {
+        slot.page = ~0u;
+        slot.lastUsed = 0;
+        slot.prev = ~0u;
+        slot.next = ~0u;
+        slot.pinned = false;
+    }
+
+    const VkDeviceSize slotBytes = kPageSlotSize * kPageSlotSize * 4;
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = mCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (UploadBatch& batch : mUploadBatches) {
+        error = batch.staging.Create(slotBytes * kMaxUploadsPerFrame, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (VK_SUCCESS != error) {
+            return false;
+        }
+
+        error = vkAllocateCommandBuffers(mDevice, &allocInfo, &batch.commandBuffer);
+        if (VK_SUCCESS != error) {
+            return false;
+        }
+
+        error = vkCreateFence(mDevice, &fenceCreateInfo, nullptr, &batch.fence);
+        if (VK_SUCCESS != error) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void VirtualTextureSystem::Destroy() {
+    if (mStreamingThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mRequestsAvailable.notify_all();
+        mStreamingThread.join();
+    }
+    mRequests.clear();
+    mLoadedPages.clear();
+
+    for (UploadBatch& batch : mUploadBatches) {
+        if (batch.fence) {
+            vkWaitForFences(mDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(mDevice, batch.fence, nullptr);
+            batch.fence = VK_NULL_HANDLE;
+        }
+        if (batch.commandBuffer) {
+            vkFreeCommandBuffers(mDevice, mCommandPool, 1, &batch.commandBuffer);
+            batch.commandBuffer = VK_NULL_HANDLE;
+        }
+        batch.staging.Destroy();
+    }
+
+    if (mFeedback) {
+        mFeedbackBuffer.Unmap();
+        mFeedback = nullptr;
+    }
+
+    mFeedbackBuffer.Destroy();
+    mPageStampsBuffer.Destroy();
+    mPageTableBuffer.Destroy();
+    mTexturesBuffer.Destroy();
+    mPagePool.Destroy();
+
+    mTextures.clear();
+    mPages.clear();
+    mSlots.clear();
+}
+
+uint32_t VirtualTextureSystem::AddTexture(vulkanhelpers::ImageData&& data) {
+    if (VK_FORMAT_R8G8B8A8_SRGB != data.format || !data.width || !data.height || data.pixels.size() < static_cast<size_t>(data.width) * data.height * 4) {
+        data.width = 1;
+        data.height = 1;
+        data.mipLevels = 1;
+        data.format = VK_FORMAT_R8G8B8A8_SRGB;
+        data.pixels.assign(4, 0xFF);
+    }
+
+    Texture texture;
+    texture.width = data.width;
+    texture.height = data.height;
+    texture.numMips = 1;
+    while ((Max(texture.width, texture.height) >> texture.numMips) > 0) {
+        ++texture.numMips;
+    }
+    texture.firstPage = 0;
+    texture.mips.resize(texture.numMips);
+
+    // only the top level is taken, the rest is rebuilt in Finalize
+    data.pixels.resize(static_cast<size_t>(data.width) * data.height * 4);
+    texture.mips[0] = std::move(data.pixels);
+
+    mTextures.push_back(std::move(texture));
+    return static_cast<uint32_t>(mTextures.size() - 1);
+}
+
+bool VirtualTextureSystem::Finalize(ThreadPool* threadPool) {
+    if (mTextures.empty()) {
+        return false;
+    }
+
+    // mip chains, box filtered in linear space
+    const float* toLinear = GetSrgbToLinearTable();
+    for (Texture& texture : mTextures) {
+        for (uint32_t mip = 1; mip < texture.numMips; ++mip) {
+            const uint32_t srcWidth = Max(texture.width >> (mip - 1), 1u);
+            const uint32_t srcHeight = Max(texture.height >> (mip - 1), 1u);
+            const uint32_t dstWidth = Max(texture.width >> mip, 1u);
+            const uint32_t dstHeight = Max(texture.height >> mip, 1u);
+
+            const uint8_t* src = texture.mips[mip - 1].data();
+            texture.mips[mip].resize(static_cast<size_t>(dstWidth) * dstHeight * 4);
+            uint8_t* dst = texture.mips[mip].data();
+
+            ThreadPool::ParallelFor(threadPool, dstHeight, [&](const size_t y) {
+                const size_t y0 = Min<size_t>(y * 2, srcHeight - 1);
+                const size_t y1 = Min<size_t>(y * 2 + 1, srcHeight - 1);
+                for (size_t x = 0; x < dstWidth; ++x) {
+                    const size_t x0 = Min<size_t>(x * 2, srcWidth - 1);
+                    const size_t x1 = Min<size_t>(x * 2 + 1, srcWidth - 1);
+                    const uint8_t* t00 = src + (y0 * srcWidth + x0) * 4;
+                    const uint8_t* t10 = src + (y0 * srcWidth + x1) * 4;
+                    const uint8_t* t01 = src + (y1 * srcWidth + x0) * 4;
+                    const uint8_t* t11 = src + (y1 * srcWidth + x1) * 4;
+
+                    uint8_t* out = dst + (y * dstWidth + x) * 4;
+                    for (size_t c = 0; c < 3; ++c) {
+                        out[c] = LinearToSrgbByte((toLinear[t00[c]] + toLinear[t10[c]] + toLinear[t01[c]] + toLinear[t11[c]]) * 0.25f);
+                    }
+                    out[3] = static_cast<uint8_t>((t00[3] + t10[3] + t01[3] + t11[3] + 2) / 4);
+                }
+            });
+        }
+    }
+
+    // virtual pages, mip by mip
+    for (uint32_t texIdx = 0; texIdx < static_cast<uint32_t>(mTextures.size()); ++texIdx) {
+        Texture& texture = mTextures[texIdx];
+        texture.firstPage = static_cast<uint32_t>(mPages.size());
+
+        for (uint32_t mip = 0; mip < texture.numMips; ++mip) {
+            const uint32_t pagesX = PagesAlong(texture.width, mip);
+            const uint32_t pagesY = PagesAlong(texture.height, mip);
+            for (uint32_t y = 0; y < pagesY; ++y) {
+                for (uint32_t x = 0; x < pagesX; ++x) {
+                    Page page;
+                    page.texture = texIdx;
+                    page.mip = mip;
+                    page.x = x;
+                    page.y = y;
+                    page.parent = ~0u;
+                    page.slot = ~0u;
+                    page.pending = false;
+                    mPages.push_back(page);
+                }
+            }
+        }
+
+        // the page covering the same area one mip down has half the coordinates
+        for (uint32_t i = texture.firstPage; i < static_cast<uint32_t>(mPages.size()); ++i) {
+            Page& page = mPages[i];
+            if (page.mip + 1 < texture.numMips) {
+                page.parent = this->GetPageIndex(texture, page.mip + 1, page.x / 2, page.y / 2);
+            }
+        }
+    }
+
+    const uint32_t numPages = static_cast<uint32_t>(mPages.size());
+
+    // GPU tables
+    VkResult error = mTexturesBuffer.Create(mTextures.size() * sizeof(uint32_t[4]), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    uint32_t* texturesInfo = reinterpret_cast<uint32_t*>(mTexturesBuffer.Map());
+    for (const Texture& texture : mTextures) {
+        *texturesInfo++ = texture.width;
+        *texturesInfo++ = texture.height;
+        *texturesInfo++ = texture.numMips;
+        *texturesInfo++ = texture.firstPage;
+    }
+    mTexturesBuffer.Unmap();
+
+    error = mPageTableBuffer.Create(numPages * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    // only the shaders use the stamps, they keep a page from being listed twice in a frame
+    error = mPageStampsBuffer.Create(numPages * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    // stays mapped, we read a slice every frame. Cached, the CPU reads are slow from write-combined memory
+    error = mFeedbackBuffer.Create(mFeedbackSliceSize * mFramesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    const VkMemoryPropertyFlags cachedMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    if (VK_SUCCESS == error && (mFeedbackBuffer.GetMemoryProperties() & cachedMemory) != cachedMemory) {
+        mFeedbackBuffer.Destroy();
+        error = mFeedbackBuffer.Create(mFeedbackSliceSize * mFramesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    mFeedback = reinterpret_cast<uint8_t*>(mFeedbackBuffer.Map());
+    if (!mFeedback) {
+        return false;
+    }
+    std::memset(mFeedback, 0, mFeedbackBuffer.GetSize());
+    mFeedbackBuffer.Flush();
+
+    // the coarsest page of every texture is always resident, so shaders have something to fall back to
+    Array<LoadedPage> pinnedPages(mTextures.size());
+    for (size_t i = 0; i < mTextures.size(); ++i) {
+        const Texture& texture = mTextures[i];
+        const uint32_t pageIdx = this->GetPageIndex(texture, texture.numMips - 1, 0, 0);
+
+        LoadedPage& pinned = pinnedPages[i];
+        pinned.page = pageIdx;
+        pinned.texels.resize(kPageSlotSize * kPageSlotSize * 4);
+        this->CutPage(mPages[pageIdx], pinned.texels.data());
+
+        const uint32_t slot = mNumUsedSlots++;
+        if (slot >= static_cast<uint32_t>(mSlots.size())) {
+            return false;
+        }
+        mSlots[slot].page = pageIdx;
+        mSlots[slot].pinned = true;
+        mPages[pageIdx].slot = slot;
+    }
+
+    vulkanhelpers::Buffer staging;
+    error = staging.Create(pinnedPages.size() * kPageSlotSize * kPageSlotSize * 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    const UploadBatch& batch = mUploadBatches[0];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+    vkCmdFillBuffer(batch.commandBuffer, mPageTableBuffer.GetBuffer(), 0, VK_WHOLE_SIZE, kPageNotResident);
+    // zero is "never requested", the frame stamps start at 1
+    vkCmdFillBuffer(batch.commandBuffer, mPageStampsBuffer.GetBuffer(), 0, VK_WHOLE_SIZE, 0);
+
+    VkBufferMemoryBarrier fillBarrier = {};
+    fillBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    fillBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    fillBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    fillBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    fillBarrier.buffer = mPageTableBuffer.GetBuffer();
+    fillBarrier.offset = 0;
+    fillBarrier.size = VK_WHOLE_SIZE;
+
+    VkBufferMemoryBarrier stampsBarrier = fillBarrier;
+    stampsBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    stampsBarrier.buffer = mPageStampsBuffer.GetBuffer();
+
+    const VkBufferMemoryBarrier fillBarriers[2] = { fillBarrier, stampsBarrier };
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 2, fillBarriers, 0, nullptr);
+
+    this->RecordPageUploads(batch.commandBuffer, staging, pinnedPages, {}, VK_IMAGE_LAYOUT_UNDEFINED);
+
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    vkResetFences(mDevice, 1, &batch.fence);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    error = vkQueueSubmit(mQueue, 1, &submitInfo, batch.fence);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+    {
+        startup::ScopedGPUWait gpuWait;
+        vkWaitForFences(mDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    }
+
+    mStopping = false;
+    mStreamingThread = std::thread(&VirtualTextureSystem::StreamingLoop, this);
+
+    return true;
+}
+
+bool VirtualTextureSystem::Update(const uint32_t frameIndex, const uint32_t frameStamp) {
+    if (!mFeedback) {
+        return false;
+    }
+
+    // this slot was last traced framesInFlight frames ago, its fence has signaled
+    const VkDeviceSize sliceOffset = this->GetFeedbackOffset(frameIndex);
+    mFeedbackBuffer.Invalidate(mFeedbackSliceSize, sliceOffset);
+
+    uint32_t* slice = reinterpret_cast<uint32_t*>(mFeedback + sliceOffset);
+    // the shaders keep counting past the end, the pages left out ask again next frame
+    const uint32_t numRequests = Min(slice[0], static_cast<uint32_t>(kMaxFeedbackRequests));
+    const uint32_t* requests = slice + 1;
+    const uint32_t numPages = static_cast<uint32_t>(mPages.size());
+
+    // feedback -> LRU touches and new requests
+    Array<uint32_t> newRequests;
+    for (uint32_t i = 0; i < numRequests; ++i) {
+        if (requests[i] >= numPages) {
+            continue;
+        }
+
+        // the page and everything it falls back to is in use, coarser pages are queued first
+        const size_t firstNew = newRequests.size();
+        for (uint32_t pageIdx = requests[i]; pageIdx != ~0u; pageIdx = mPages[pageIdx].parent) {
+            Page& page = mPages[pageIdx];
+            if (page.slot != ~0u) {
+                this->TouchSlot(page.slot, frameStamp);
+            } else if (!page.pending) {
+                page.pending = true;
+                newRequests.insert(newRequests.begin() + firstNew, pageIdx);
+            }
+        }
+    }
+
+    // the next submit of this slot starts from an empty list
+    slice[0] = 0;
+    mFeedbackBuffer.Flush(mFeedbackSliceSize, sliceOffset);
+
+    if (!newRequests.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRequests.insert(mRequests.end(), newRequests.begin(), newRequests.end());
+        }
+        mRequestsAvailable.notify_one();
+    }
+
+    // finished pages -> GPU, only if the previous use of this batch is done
+    UploadBatch& batch = mUploadBatches[mCurrentBatch];
+    if (VK_SUCCESS != vkGetFenceStatus(mDevice, batch.fence)) {
+        return false;
+    }
+
+    Array<LoadedPage> loadedPages;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        while (!mLoadedPages.empty() && loadedPages.size() < kMaxUploadsPerFrame) {
+            loadedPages.push_back(std::move(mLoadedPages.front()));
+            mLoadedPages.pop_front();
+        }
+    }
+
+    if (loadedPages.empty()) {
+        return false;
+    }
+
+    Array<LoadedPage> uploads;
+    Array<uint32_t> evictedPages;
+    for (LoadedPage& loaded : loadedPages) {
+        Page& page = mPages[loaded.page];
+        page.pending = false;
+
+        const uint32_t slot = this->AllocateSlot(frameStamp);
+        if (slot == ~0u) {
+            // everything is in use, feedback will ask for it again later
+            continue;
+        }
+
+        const uint32_t evicted = mSlots[slot].page;
+        if (evicted != ~0u) {
+            mPages[evicted].slot = ~0u;
+            evictedPages.push_back(evicted);
+        }
+
+        mSlots[slot].page = loaded.page;
+        page.slot = slot;
+        uploads.push_back(std::move(loaded));
+    }
+
+    if (uploads.empty()) {
+        return false;
+    }
+
+    vkResetCommandBuffer(batch.commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+    this->RecordPageUploads(batch.commandBuffer, batch.staging, uploads, evictedPages, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    vkResetFences(mDevice, 1, &batch.fence);
+
+    // same queue as the frame, so the frame submitted right after sees the new pages
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    vkQueueSubmit(mQueue, 1, &submitInfo, batch.fence);
+
+    mCurrentBatch = (mCurrentBatch + 1) % 2;
+
+    return true;
+}
+
+void VirtualTextureSystem::RecordFeedbackBarrier(VkCommandBuffer commandBuffer) const {
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = mFeedbackBuffer.GetBuffer();
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+const VkDescriptorImageInfo& VirtualTextureSystem::GetPoolImageInfo() const {
+    return mPoolImageInfo;
+}
+
+VkDescriptorBufferInfo VirtualTextureSystem::GetTexturesBufferInfo() const {
+    return { mTexturesBuffer.GetBuffer(), 0, mTexturesBuffer.GetSize() };
+}
+
+VkDescriptorBufferInfo VirtualTextureSystem::GetPageTableBufferInfo() const {
+    return { mPageTableBuffer.GetBuffer(), 0, mPageTableBuffer.GetSize() };
+}
+
+VkDescriptorBufferInfo VirtualTextureSystem::GetFeedbackBufferInfo() const {
+    return { mFeedbackBuffer.GetBuffer(), 0, sizeof(uint32_t) * (1 + kMaxFeedbackRequests) };
+}
+
+uint32_t VirtualTextureSystem::GetFeedbackOffset(const uint32_t frameIndex) const {
+    return static_cast<uint32_t>(frameIndex * mFeedbackSliceSize);
+}
+
+VkDescriptorBufferInfo VirtualTextureSystem::GetPageStampsBufferInfo() const {
+    return { mPageStampsBuffer.GetBuffer(), 0, mPageStampsBuffer.GetSize() };
+}
+
+// copies the page plus its border into a (kPageSlotSize x kPageSlotSize) block, wrapping around the edges
+void VirtualTextureSystem::CutPage(const Page& page, uint8_t* dst) const {
+    const Texture& texture = mTextures[page.texture];
+    const uint32_t width = Max(texture.width >> page.mip, 1u);
+    const uint32_t height = Max(texture.height >> page.mip, 1u);
+    const uint8_t* src = texture.mips[page.mip].data();
+
+    const int64_t startX = static_cast<int64_t>(page.x) * kPageSize - kPageBorder;
+    const int64_t startY = static_cast<int64_t>(page.y) * kPageSize - kPageBorder;
+
+    for (uint32_t y = 0; y < kPageSlotSize; ++y) {
+        const int64_t srcY = ((startY + y) % height + height) % height;
+        const uint8_t* srcRow = src + static_cast<size_t>(srcY) * width * 4;
+        for (uint32_t x = 0; x < kPageSlotSize; ++x) {
+            const int64_t srcX = ((startX + x) % width + width) % width;
+            std::memcpy(dst, srcRow + srcX * 4, 4);
+            dst += 4;
+        }
+    }
+}
+
+uint32_t VirtualTextureSystem::GetPageIndex(const Texture& texture, const uint32_t mip, const uint32_t x, const uint32_t y) const {
+    uint32_t index = texture.firstPage;
+    for (uint32_t m = 0; m < mip; ++m) {
+        index += PagesAlong(texture.width, m) * PagesAlong(texture.height, m);
+    }
+    return index + y * PagesAlong(texture.width, mip) + x;
+}
+
+// a never used slot if there is one, otherwise the least recently used one
+uint32_t VirtualTextureSystem::AllocateSlot(const uint32_t frameStamp) {
+    uint32_t slot = ~0u;
+    if (mNumUsedSlots < static_cast<uint32_t>(mSlots.size())) {
+        slot = mNumUsedSlots++;
+    } else if (mLRUTail != ~0u && mSlots[mLRUTail].lastUsed + mEvictionDelay < frameStamp) {
+        // frames still in flight might be reading the recently used ones
+        slot = mLRUTail;
+        this->UnlinkSlot(slot);
+    }
+
+    if (slot != ~0u) {
+        mSlots[slot].lastUsed = frameStamp;
+        this->LinkSlotToHead(slot);
+    }
+
+    return slot;
+}
+
+void VirtualTextureSystem::TouchSlot(const uint32_t slot, const uint32_t frameStamp) {
+    Slot& s = mSlots[slot];
+    if (s.pinned || s.lastUsed >= frameStamp) {
+        return;
+    }
+
+    s.lastUsed = frameStamp;
+    if (mLRUHead != slot) {
+        this->UnlinkSlot(slot);
+        this->LinkSlotToHead(slot);
+    }
+}
+
+void VirtualTextureSystem::UnlinkSlot(const uint32_t slot) {
+    Slot& s = mSlots[slot];
+    if (s.prev != ~0u) {
+        mSlots[s.prev].next = s.next;
+    } else {
+        mLRUHead = s.next;
+    }
+    if (s.next != ~0u) {
+        mSlots[s.next].prev = s.prev;
+    } else {
+        mLRUTail = s.prev;
+    }
+    s.prev = ~0u;
+    s.next = ~0u;
+}
+
+void VirtualTextureSystem::LinkSlotToHead(const uint32_t slot) {
+    Slot& s = mSlots[slot];
+    s.prev = ~0u;
+    s.next = mLRUHead;
+    if (mLRUHead != ~0u) {
+        mSlots[mLRUHead].prev = slot;
+    }
+    mLRUHead = slot;
+    if (mLRUTail == ~0u) {
+        mLRUTail = slot;
+    }
+}
+
+void VirtualTextureSystem::RecordPageUploads(VkCommandBuffer commandBuffer,
+                                             const vulkanhelpers::Buffer& staging,
+                                             const Array<LoadedPage>& pages,
+                                             const Array<uint32_t>& evictedPages,
+                                             const VkImageLayout poolLayout) {
+    const size_t slotBytes = kPageSlotSize * kPageSlotSize * 4;
+
+    uint8_t* stagingMem = reinterpret_cast<uint8_t*>(staging.Map());
+    for (size_t i = 0; i < pages.size(); ++i) {
+        std::memcpy(stagingMem + i * slotBytes, pages[i].texels.data(), slotBytes);
+    }
+    staging.Unmap();
+
+    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // waits for the frames still sampling the pool
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = poolLayout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = mPagePool.GetImage();
+    barrier.subresourceRange = subresourceRange;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    Array<VkBufferImageCopy> regions(pages.size());
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const uint32_t slot = mPages[pages[i].page].slot;
+
+        VkBufferImageCopy& region = regions[i];
+        region.bufferOffset = i * slotBytes;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageOffset = { static_cast<int32_t>((slot % mPoolSizeInPages) * kPageSlotSize),
+                               static_cast<int32_t>((slot / mPoolSizeInPages) * kPageSlotSize),
+                               0 };
+        region.imageExtent = { kPageSlotSize, kPageSlotSize, 1 };
+    }
+
+    vkCmdCopyBufferToImage(commandBuffer, staging.GetBuffer(), mPagePool.GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    // page table goes through the queue as well, so an entry never points at a slot that isn't there yet
+    const uint32_t notResident = kPageNotResident;
+    for (const uint32_t pageIdx : evictedPages) {
+        vkCmdUpdateBuffer(commandBuffer, mPageTableBuffer.GetBuffer(), pageIdx * sizeof(uint32_t), sizeof(uint32_t), &notResident);
+    }
+    for (const LoadedPage& loaded : pages) {
+        const uint32_t slot = mPages[loaded.page].slot;
+        const uint32_t entry = (slot % mPoolSizeInPages) | ((slot / mPoolSizeInPages) << 16);
+        vkCmdUpdateBuffer(commandBuffer, mPageTableBuffer.GetBuffer(), loaded.page * sizeof(uint32_t), sizeof(uint32_t), &entry);
+    }
+
+    VkBufferMemoryBarrier tableBarrier = {};
+    tableBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    tableBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    tableBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    tableBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    tableBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    tableBarrier.buffer = mPageTableBuffer.GetBuffer();
+    tableBarrier.offset = 0;
+    tableBarrier.size = VK_WHOLE_SIZE;
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 1, &tableBarrier, 1, &barrier);
+}
+
+void VirtualTextureSystem::StreamingLoop() {
+    trace::SetThreadName("Texture streaming");
+
+    for (;;) {
+        uint32_t pageIdx;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mRequestsAvailable.wait(lock, [this]() { return mStopping || !mRequests.empty(); });
+            if (mStopping) {
+                return;
+            }
+            pageIdx = mRequests.front();
+            mRequests.pop_front();
+        }
+
+        trace::ScopedEvent event("Cut page");
+
+        // the mip chains never change after Finalize, no need to lock while cutting
+        LoadedPage loaded;
+        loaded.page = pageIdx;
+        loaded.texels.resize(kPageSlotSize * kPageSlotSize * 4);
+        this->CutPage(mPages[pageIdx], loaded.texels.data());
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLoadedPages.push_back(std::move(loaded));
+    }
+}
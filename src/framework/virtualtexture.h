@@ -0,0 +1,143 @@
+#pragma once
+#include "vulkanhelpers.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+class ThreadPool;
+
+// Streams texture pages into a fixed-size physical pool.
+// Shaders append the pages they want to this frame's slice of the feedback buffer (once per page and frame),
+// the CPU side reads the slice back after the frame's fence, a streaming thread cuts the missing pages out of the CPU-side mip chains and the least recently
+// used pages get evicted when the pool is full.
+class VirtualTextureSystem {
+public:
+    static const uint32_t kPageSize = 128;                          // texels, without the border
+    static const uint32_t kPageBorder = 4;                          // enough for bilinear filtering
+    static const uint32_t kPageSlotSize = kPageSize + kPageBorder * 2;
+    static const uint32_t kMaxUploadsPerFrame = 16;
+    static const uint32_t kPageNotResident = ~0u;                   // page table entry, same as SWS_VT_PAGE_NOT_RESIDENT
+    static const uint32_t kMaxFeedbackRequests = 4096;              // per frame, same as SWS_VT_MAX_REQUESTS
+
+    VirtualTextureSystem();
+    ~VirtualTextureSystem();
+
+    // poolSizeInPages - number of page slots along each side of the physical pool
+    // feedbackAlignment - for the feedback slices, the dynamic offset alignment and nonCoherentAtomSize combined
+    bool        Initialize(VkDevice device,
+                           VkCommandPool commandPool,
+                           VkQueue queue,
+                           const uint32_t poolSizeInPages,
+                           const uint32_t framesInFlight,
+                           const VkDeviceSize feedbackAlignment);
+    void        Destroy();
+
+    // takes the top level of an RGBA8 sRGB image, returns the id shaders use to sample it.
+    // Anything else (float HDR, empty) becomes a 1x1 white texture, so the id is always valid
+    uint32_t    AddTexture(vulkanhelpers::ImageData&& data);
+    // builds the mip chains, creates the GPU tables, makes the coarsest mips resident and starts streaming
+    bool        Finalize(ThreadPool* threadPool);
+
+    // reads the frame slot's feedback (its fence must have signaled), queues the missing pages
+    // and uploads whatever the streaming thread has finished, returns true if the resident pages have changed
+    bool        Update(const uint32_t frameIndex, const uint32_t frameStamp);
+    // makes this frame's feedback writes visible to the host, to be recorded after the trace
+    void        RecordFeedbackBarrier(VkCommandBuffer commandBuffer) const;
+
+    const VkDescriptorImageInfo&    GetPoolImageInfo() const;
+    VkDescriptorBufferInfo          GetTexturesBufferInfo() const;
+    VkDescriptorBufferInfo          GetPageTableBufferInfo() const;
+    VkDescriptorBufferInfo          GetFeedbackBufferInfo() const;      // one slice, bound with a dynamic offset
+    uint32_t                        GetFeedbackOffset(const uint32_t frameIndex) const;
+    VkDescriptorBufferInfo          GetPageStampsBufferInfo() const;
+
+private:
+    struct Texture {
+        uint32_t                width;
+        uint32_t                height;
+        uint32_t                numMips;
+        uint32_t                firstPage;      // global index of the first page of the top mip
+        Array<Array<uint8_t>>   mips;
+    };
+
+    // one per virtual page
+    struct Page {
+        uint32_t    texture;
+        uint32_t    mip;
+        uint32_t    x;
+        uint32_t    y;
+        uint32_t    parent;     // same area one mip down, or ~0 for the coarsest page
+        uint32_t    slot;       // ~0 when not resident
+        bool        pending;    // already queued for streaming
+    };
+
+    // one per physical slot, doubly-linked into the LRU list (head is the most recently used)
+    struct Slot {
+        uint32_t    page;
+        uint32_t    lastUsed;
+        uint32_t    prev;
+        uint32_t    next;
+        bool        pinned;
+    };
+
+    struct LoadedPage {
+        uint32_t        page;
+        Array<uint8_t>  texels;
+    };
+
+    struct UploadBatch {
+        vulkanhelpers::Buffer   staging;
+        VkCommandBuffer         commandBuffer;
+        VkFence                 fence;
+    };
+
+    void        CutPage(const Page& page, uint8_t* dst) const;
+    uint32_t    GetPageIndex(const Texture& texture, const uint32_t mip, const uint32_t x, const uint32_t y) const;
+    uint32_t    AllocateSlot(const uint32_t frameStamp);
+    void        TouchSlot(const uint32_t slot, const uint32_t frameStamp);
+    void        UnlinkSlot(const uint32_t slot);
+    void        LinkSlotToHead(const uint32_t slot);
+    void        RecordPageUploads(VkCommandBuffer commandBuffer,
+                                  const vulkanhelpers::Buffer& staging,
+                                  const Array<LoadedPage>& pages,
+                                  const Array<uint32_t>& evictedPages,
+                                  const VkImageLayout poolLayout);
+    void        StreamingLoop();
+
+private:
+    VkDevice                        mDevice;
+    VkCommandPool                   mCommandPool;
+    VkQueue                         mQueue;
+    uint32_t                        mPoolSizeInPages;
+    uint32_t                        mFramesInFlight;
+    uint32_t                        mEvictionDelay;     // frames a page must be unused before eviction
+    VkDeviceSize                    mFeedbackSliceSize;
+
+    Array<Texture>                  mTextures;
+    Array<Page>                     mPages;
+    Array<Slot>                     mSlots;
+    uint32_t                        mLRUHead;
+    uint32_t                        mLRUTail;
+    uint32_t                        mNumUsedSlots;
+
+    vulkanhelpers::Image            mPagePool;
+    VkDescriptorImageInfo           mPoolImageInfo;
+    vulkanhelpers::Buffer           mTexturesBuffer;
+    vulkanhelpers::Buffer           mPageTableBuffer;
+    vulkanhelpers::Buffer           mFeedbackBuffer;
+    uint8_t*                        mFeedback;
+    vulkanhelpers::Buffer           mPageStampsBuffer;
+
+    UploadBatch                     mUploadBatches[2];
+    uint32_t                        mCurrentBatch;
+
+    // streaming thread
+    std::thread                     mStreamingThread;
+    std::mutex                      mMutex;
+    std::condition_variable         mRequestsAvailable;
+    std::deque<uint32_t>            mRequests;
+    std::deque<LoadedPage>          mLoadedPages;
+    bool                            mStopping;
+};
@@ -3,12 +3,57 @@
 // include volk.c for implementation
 #include "volk.c"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+
+static const float sHistogramMinMs = 0.25f;
+static const float sHistogramMaxMs = 1000.0f;
+static const float sHitchFactor = 2.0f;         // a hitch is this many times the moving average...
+static const float sHitchMinMs = 4.0f;          // ...and at least this much longer, so fast frames don't count
+
+static float HistogramBucketScale() {
+    static const float scale = static_cast<float>(FPSMeter::kHistogramSize) / std::log(sHistogramMaxMs / sHistogramMinMs);
+    return scale;
+}
 
 void FPSMeter::Update(const float dt) {
+    const float frameTimeMs = dt * 1000.0f;
+    const float averageMs = this->numHistoryFrames ? this->GetFrameTime() : frameTimeMs;
+
     this->fpsAccumulator += dt - this->fpsHistory[this->historyPointer];
     this->fpsHistory[this->historyPointer] = dt;
     this->historyPointer = (this->historyPointer + 1) % FPSMeter::kFPSHistorySize;
-    this->fps = (this->fpsAccumulator > 0.0f) ? (1.0f / (this->fpsAccumulator / static_cast<float>(FPSMeter::kFPSHistorySize))) : FLT_MAX;
+    this->numHistoryFrames = Min(this->numHistoryFrames + 1, static_cast<size_t>(FPSMeter::kFPSHistorySize));
+    this->fps = (this->fpsAccumulator > 0.0f) ? (1.0f / (this->fpsAccumulator / static_cast<float>(this->numHistoryFrames))) : FLT_MAX;
+
+    const float bucket = (frameTimeMs > sHistogramMinMs) ? std::log(frameTimeMs / sHistogramMinMs) * HistogramBucketScale() : 0.0f;
+    const size_t lastBucket = FPSMeter::kHistogramSize - 1;
+    ++this->histogram[Min(static_cast<size_t>(bucket), lastBucket)];
+
+    this->lastFrameHitch = frameTimeMs > averageMs * sHitchFactor && frameTimeMs - averageMs > sHitchMinMs;
+    if (this->lastFrameHitch) {
+        ++this->numHitches;
+    }
+
+    this->maxFrameTime = Max(this->maxFrameTime, frameTimeMs);
+
+    if (this->csvFile) {
+        std::fprintf(this->csvFile, "%u,%.3f,%d\n", this->csvFrame, frameTimeMs, this->lastFrameHitch ? 1 : 0);
+    }
+    ++this->csvFrame;
+
+    ++this->numFrames;
 }
 
 float FPSMeter::GetFPS() const {
@@ -19,6 +64,61 @@ float FPSMeter::GetFrameTime() const {
     return 1000.0f / this->fps;
 }
 
+float FPSMeter::GetPercentile(const float percent) const {
+    if (!this->numFrames) {
+        return 0.0f;
+    }
+
+    const uint32_t rank = Max(static_cast<uint32_t>(std::ceil(percent * 0.01f * static_cast<float>(this->numFrames))), 1u);
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < FPSMeter::kHistogramSize; ++i) {
+        count += this->histogram[i];
+        if (count >= rank) {
+            // upper edge of the bucket, never past the slowest frame seen
+            const float upperEdge = sHistogramMinMs * std::exp(static_cast<float>(i + 1) / HistogramBucketScale());
+            return Min(upperEdge, this->maxFrameTime);
+        }
+    }
+
+    return this->maxFrameTime;
+}
+
+float FPSMeter::GetMaxFrameTime() const {
+    return this->maxFrameTime;
+}
+
+uint32_t FPSMeter::GetNumHitches() const {
+    return this->numHitches;
+}
+
+void FPSMeter::ResetStats() {
+    std::fill(std::begin(this->histogram), std::end(this->histogram), 0u);
+    this->numFrames = 0;
+    this->numHitches = 0;
+    this->maxFrameTime = 0.0f;
+    this->lastFrameHitch = false;
+}
+
+bool FPSMeter::OpenCSV(const String& fileName) {
+    this->CloseCSV();
+
+    this->csvFile = std::fopen(fileName.c_str(), "w");
+    if (!this->csvFile) {
+        return false;
+    }
+
+    std::fprintf(this->csvFile, "frame,ms,hitch\n");
+    return true;
+}
+
+void FPSMeter::CloseCSV() {
+    if (this->csvFile) {
+        std::fclose(this->csvFile);
+        this->csvFile = nullptr;
+    }
+}
+
 
 
 VulkanApp::VulkanApp()
@@ -26,13 +126,16 @@ VulkanApp::VulkanApp()
     , mWindow(nullptr)
     , mInstance(VK_NULL_HANDLE)
     , mPhysicalDevice(VK_NULL_HANDLE)
+    , mPhysicalDeviceProps({})
     , mDevice(VK_NULL_HANDLE)
     , mSurfaceFormat({})
     , mSurface(VK_NULL_HANDLE)
     , mSwapchain(VK_NULL_HANDLE)
     , mCommandPool(VK_NULL_HANDLE)
-    , mSemaphoreImageAcquired(VK_NULL_HANDLE)
-    , mSemaphoreRenderFinished(VK_NULL_HANDLE)
+    , mPipelineCache(VK_NULL_HANDLE)
+    , mRenderExtent({ 0, 0 })
+    , mFrameIndex(0)
+    , mFrameNumber(0)
     , mGraphicsQueueFamilyIndex(0u)
     , mComputeQueueFamilyIndex(0u)
     , mTransferQueueFamilyIndex(0u)
@@ -46,8 +149,20 @@ VulkanApp::~VulkanApp() {
     this->FreeVulkan();
 }
 
-void VulkanApp::Run() {
-    if (this->Initialize()) {
+void VulkanApp::Run(const int argc, const char** argv) {
+    mCommandLine.clear();
+    for (int i = 1; i < argc; ++i) {
+        mCommandLine.push_back(argv[i]);
+    }
+
+    bool initialized;
+    {
+        startup::ScopedPhase phase("Startup");
+        initialized = this->Initialize();
+    }
+    this->ReportStartup();
+
+    if (initialized) {
         this->Loop();
         this->Shutdown();
         this->FreeResources();
@@ -55,46 +170,58 @@ void VulkanApp::Run() {
 }
 
 bool VulkanApp::Initialize() {
-    if (!glfwInit()) {
+    if (VK_SUCCESS != volkInitialize()) {
         return false;
     }
 
-    if (!glfwVulkanSupported()) {
-        return false;
-    }
+    this->InitializeSettings();
 
-    if (VK_SUCCESS != volkInitialize()) {
-        return false;
+    if (!mSettings.headless) {
+        if (!glfwInit()) {
+            return false;
+        }
+
+        if (!glfwVulkanSupported()) {
+            return false;
+        }
     }
 
-    this->InitializeSettings();
+    mThreadPool.Initialize();
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    GLFWwindow* window = glfwCreateWindow(static_cast<int>(mSettings.resolutionX),
-                                          static_cast<int>(mSettings.resolutionY),
-                                          mSettings.name.c_str(),
-                                          nullptr, nullptr);
-    if (!window) {
-        return false;
+    if (!mSettings.frameTimesCSV.empty()) {
+        mFPSMeter.OpenCSV(mSettings.frameTimesCSV);
     }
 
-    glfwSetWindowUserPointer(window, this);
+    if (!mSettings.headless) {
+        startup::ScopedPhase phase("Create window");
 
-    glfwSetKeyCallback(window, [](GLFWwindow* wnd, int key, int scancode, int action, int mods) {
-        VulkanApp* _this = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(wnd));
-        _this->OnKey(key, scancode, action, mods);
-    });
-    glfwSetMouseButtonCallback(window, [](GLFWwindow* wnd, int button, int action, int mods) {
-        VulkanApp* _this = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(wnd));
-        _this->OnMouseButton(button, action, mods);
-    });
-    glfwSetCursorPosCallback(window, [](GLFWwindow* wnd, double x, double y) {
-        VulkanApp* _this = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(wnd));
-        _this->OnMouseMove(static_cast<float>(x), static_cast<float>(y));
-    });
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        GLFWwindow* window = glfwCreateWindow(static_cast<int>(mSettings.resolutionX),
+                                              static_cast<int>(mSettings.resolutionY),
+                                              mSettings.name.c_str(),
+                                              nullptr, nullptr);
+        if (!window) {
+            return false;
+        }
 
-    mWindow = window;
+        glfwSetWindowUserPointer(window, this);
+
+        glfwSetKeyCallback(window, [](GLFWwindow* wnd, int key, int scancode, int action, int mods) {
+            VulkanApp* _this = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(wnd));
+            _this->OnKey(key, scancode, action, mods);
+        });
+        glfwSetMouseButtonCallback(window, [](GLFWwindow* wnd, int button, int action, int mods) {
+            VulkanApp* _this = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(wnd));
+            _this->OnMouseButton(button, action, mods);
+        });
+        glfwSetCursorPosCallback(window, [](GLFWwindow* wnd, double x, double y) {
+            VulkanApp* _this = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(wnd));
+            _this->OnMouseMove(static_cast<float>(x), static_cast<float>(y));
+        });
+
+        mWindow = window;
+    }
 
     if (!this->InitializeVulkan()) {
         return false;
@@ -105,16 +232,39 @@ bool VulkanApp::Initialize() {
     if (!this->InitializeDevicesAndQueues()) {
         return false;
     }
-    if (!this->InitializeSurface()) {
-        return false;
+
+    if (mSettings.headless) {
+        // RGBA8 storage images are guaranteed to be supported, even by software implementations
+        mSurfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+        mSurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    } else {
+        if (!this->InitializeSurface()) {
+            return false;
+        }
+        if (!this->InitializeSwapchain()) {
+            return false;
+        }
     }
-    if (!this->InitializeSwapchain()) {
+
+    if (!this->InitializeFencesAndCommandPool()) {
         return false;
     }
-    if (!this->InitializeFencesAndCommandPool()) {
+    if (!this->InitializePipelineCache()) {
         return false;
     }
 
+    // the window size is final by now
+    if (!mSettings.renderResolutionX || !mSettings.renderResolutionY) {
+        mSettings.renderResolutionX = mSettings.resolutionX;
+        mSettings.renderResolutionY = mSettings.resolutionY;
+    }
+    mRenderExtent = { mSettings.renderResolutionX, mSettings.renderResolutionY };
+
+    // offline output wants every frame at the full resolution
+    if (mSettings.headless) {
+        mSettings.dynamicResolution = false;
+    }
+
     vulkanhelpers::Initialize(mPhysicalDevice, mDevice, mCommandPool, mGraphicsQueue);
 
     if (!this->InitializeOffscreenImage()) {
@@ -126,14 +276,46 @@ bool VulkanApp::Initialize() {
     if (!this->InitializeSynchronization()) {
         return false;
     }
+    if (mSettings.headless && !this->InitializeReadbackBuffers()) {
+        return false;
+    }
 
-    this->InitApp();
-    this->FillCommandBuffers();
+    // not fatal - without timestamps the scopes just stay empty
+    mGPUProfiler.Initialize(mDevice, mPhysicalDevice, mGraphicsQueueFamilyIndex, mSettings.framesInFlight);
+    if (!mSettings.traceFile.empty() && !(mSettings.supportCalibratedTimestamps && mGPUProfiler.EnableTrace(mPhysicalDevice))) {
+        std::printf("No calibrated timestamps, the trace will only have the CPU side\n");
+    }
 
-    return true;
+    return this->InitApp();
 }
 
 void VulkanApp::Loop() {
+    if (mSettings.headless) {
+        auto prevTime = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < mSettings.headlessFrames; ++i) {
+            const auto curTime = std::chrono::steady_clock::now();
+            const float deltaTime = std::chrono::duration<float>(curTime - prevTime).count();
+            prevTime = curTime;
+
+            this->ProcessFrame(deltaTime);
+        }
+
+        // collect the frames still in flight, oldest first
+        vkDeviceWaitIdle(mDevice);
+        for (uint32_t i = 0; i < mSettings.framesInFlight; ++i) {
+            const uint32_t frameIndex = (mFrameIndex + i) % mSettings.framesInFlight;
+            this->ReadbackFrame(frameIndex);
+            this->CollectGPUTimings(frameIndex, mFrameNumber - mSettings.framesInFlight + i);
+        }
+
+        std::printf("Frame time: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms, %u hitches\n",
+                    mFPSMeter.GetPercentile(50.0f), mFPSMeter.GetPercentile(95.0f), mFPSMeter.GetPercentile(99.0f),
+                    mFPSMeter.GetMaxFrameTime(), mFPSMeter.GetNumHitches());
+        std::printf("%s", mGPUProfiler.GetReport().c_str());
+        this->FinishBenchmark();
+        return;
+    }
+
     glfwSetTime(0.0);
     double curTime, prevTime = 0.0, deltaTime = 0.0;
     while (!glfwWindowShouldClose(mWindow)) {
@@ -144,12 +326,33 @@ void VulkanApp::Loop() {
         this->ProcessFrame(static_cast<float>(deltaTime));
 
         glfwPollEvents();
+
+        if (mBenchmark.IsActive() && mFrameNumber >= mBenchmark.GetTotalFrames()) {
+            break;
+        }
+    }
+
+    if (mBenchmark.IsActive()) {
+        vkDeviceWaitIdle(mDevice);
+        for (uint32_t i = 0; i < mSettings.framesInFlight; ++i) {
+            this->CollectGPUTimings((mFrameIndex + i) % mSettings.framesInFlight, mFrameNumber - mSettings.framesInFlight + i);
+        }
+        this->FinishBenchmark();
     }
 }
 
 void VulkanApp::Shutdown() {
     vkDeviceWaitIdle(mDevice);
 
+    this->SavePipelineCache();
+
+    mThreadPool.Shutdown();
+    mFPSMeter.CloseCSV();
+
+    if (!mSettings.traceFile.empty() && !trace::WriteChromeTrace(mSettings.traceFile)) {
+        std::printf("Failed to write the trace to %s\n", mSettings.traceFile.c_str());
+    }
+
     glfwTerminate();
 }
 
@@ -157,16 +360,131 @@ void VulkanApp::InitializeSettings() {
     mSettings.name = "VulkanApp";
     mSettings.resolutionX = 1280;
     mSettings.resolutionY = 720;
+    mSettings.renderResolutionX = 0;
+    mSettings.renderResolutionY = 0;
     mSettings.surfaceFormat = VK_FORMAT_B8G8R8A8_UNORM;
     mSettings.enableValidation = false;
     mSettings.enableVSync = true;
+    mSettings.framesInFlight = 2;
     mSettings.supportRaytracing = false;
     mSettings.supportDescriptorIndexing = false;
+    mSettings.supportShaderClock = false;
+    mSettings.supportCalibratedTimestamps = false;
+    mSettings.headless = false;
+    mSettings.headlessFrames = 1;
+    mSettings.headlessOutput.clear();
+    mSettings.traceTileSize = 0;
+    mSettings.traceTilesPerFrame = 0;
+    mSettings.dynamicResolution = false;
+    mSettings.targetFrameTimeMs = 1000.0f / 60.0f;
+    mSettings.frameTimesCSV.clear();
+    mSettings.rayStats = false;
+    mSettings.maxBounces = 0;
+    mSettings.shadows = true;
+    mSettings.benchmarkPath.clear();
+    mSettings.benchmarkWarmupFrames = 32;
+    mSettings.benchmarkFrames = 256;
+    mSettings.benchmarkReport = "benchmark.json";
+    mSettings.startupReport = false;
+    mSettings.startupJSON.clear();
+    mSettings.traceFile.clear();
+    mSettings.pipelineCacheFile = "pipeline_cache.bin";
+    mSettings.shaderSourceFolder.clear();
+    mSettings.shaderCompiler = "glslangValidator";
 
     this->InitSettings();
+    this->ParseCommandLine();
+
+    // numbers have to be comparable between runs
+    if (!mSettings.benchmarkPath.empty()) {
+        mSettings.enableVSync = false;
+        mSettings.dynamicResolution = false;
+        mSettings.headlessFrames = mSettings.benchmarkWarmupFrames + mSettings.benchmarkFrames;
+        mBenchmark.Initialize(mSettings.benchmarkWarmupFrames, mSettings.benchmarkFrames);
+    }
+
+    // GPU scopes only make it into the trace with calibrated timestamps
+    if (!mSettings.traceFile.empty()) {
+        mSettings.supportCalibratedTimestamps = true;
+        trace::SetThreadName("Main");
+        trace::Start();
+    }
+}
+
+// command line overrides whatever the app has set
+void VulkanApp::ParseCommandLine() {
+    for (size_t i = 0; i < mCommandLine.size(); ++i) {
+        const String& arg = mCommandLine[i];
+        const bool hasValue = (i + 1) < mCommandLine.size();
+
+        if (arg == "--headless") {
+            mSettings.headless = true;
+        } else if (arg == "--frames" && hasValue) {
+            mSettings.headlessFrames = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--frames-in-flight" && hasValue) {
+            mSettings.framesInFlight = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--output" && hasValue) {
+            mSettings.headlessOutput = mCommandLine[++i];
+        } else if (arg == "--no-validation") {
+            mSettings.enableValidation = false;
+        } else if (arg == "--width" && hasValue) {
+            mSettings.resolutionX = Max(static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10)), 1u);
+        } else if (arg == "--height" && hasValue) {
+            mSettings.resolutionY = Max(static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10)), 1u);
+        } else if (arg == "--render-width" && hasValue) {
+            mSettings.renderResolutionX = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--render-height" && hasValue) {
+            mSettings.renderResolutionY = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--tile-size" && hasValue) {
+            mSettings.traceTileSize = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--tiles-per-frame" && hasValue) {
+            mSettings.traceTilesPerFrame = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--dynamic-res") {
+            mSettings.dynamicResolution = true;
+        } else if (arg == "--target-fps" && hasValue) {
+            const float fps = static_cast<float>(std::strtod(mCommandLine[++i].c_str(), nullptr));
+            if (fps > 0.0f) {
+                mSettings.targetFrameTimeMs = 1000.0f / fps;
+            }
+        } else if (arg == "--shader-clock") {
+            mSettings.supportShaderClock = true;
+        } else if (arg == "--ray-stats") {
+            mSettings.rayStats = true;
+        } else if (arg == "--max-bounces" && hasValue) {
+            mSettings.maxBounces = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--no-shadows") {
+            mSettings.shadows = false;
+        } else if (arg == "--frame-csv" && hasValue) {
+            mSettings.frameTimesCSV = mCommandLine[++i];
+        } else if (arg == "--benchmark" && hasValue) {
+            mSettings.benchmarkPath = mCommandLine[++i];
+        } else if (arg == "--warmup" && hasValue) {
+            mSettings.benchmarkWarmupFrames = static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10));
+        } else if (arg == "--bench-frames" && hasValue) {
+            mSettings.benchmarkFrames = Max(static_cast<uint32_t>(std::strtoul(mCommandLine[++i].c_str(), nullptr, 10)), 1u);
+        } else if (arg == "--report" && hasValue) {
+            mSettings.benchmarkReport = mCommandLine[++i];
+        } else if (arg == "--startup-report") {
+            mSettings.startupReport = true;
+        } else if (arg == "--startup-json" && hasValue) {
+            mSettings.startupJSON = mCommandLine[++i];
+        } else if (arg == "--trace" && hasValue) {
+            mSettings.traceFile = mCommandLine[++i];
+        } else if (arg == "--pipeline-cache" && hasValue) {
+            mSettings.pipelineCacheFile = mCommandLine[++i];
+        } else if (arg == "--no-pipeline-cache") {
+            mSettings.pipelineCacheFile.clear();
+        } else if (arg == "--shader-source" && hasValue) {
+            mSettings.shaderSourceFolder = mCommandLine[++i];
+        } else if (arg == "--glslang" && hasValue) {
+            mSettings.shaderCompiler = mCommandLine[++i];
+        }
+    }
 }
 
 bool VulkanApp::InitializeVulkan() {
+    startup::ScopedPhase phase("Create instance");
+
     VkApplicationInfo appInfo;
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     appInfo.pNext = nullptr;
@@ -176,13 +494,14 @@ bool VulkanApp::InitializeVulkan() {
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.apiVersion = VK_API_VERSION_1_2;
 
-    uint32_t requiredExtensionsCount = 0;
-    const char** requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionsCount);
-
     Array<const char*> extensions;
     Array<const char*> layers;
 
-    extensions.insert(extensions.begin(), requiredExtensions, requiredExtensions + requiredExtensionsCount);
+    if (!mSettings.headless) {
+        uint32_t requiredExtensionsCount = 0;
+        const char** requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionsCount);
+        extensions.insert(extensions.begin(), requiredExtensions, requiredExtensions + requiredExtensionsCount);
+    }
 
     if (mSettings.enableValidation) {
         extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
@@ -209,6 +528,8 @@ bool VulkanApp::InitializeVulkan() {
 }
 
 bool VulkanApp::InitializeDevicesAndQueues() {
+    startup::ScopedPhase phase("Create device");
+
     uint32_t numPhysDevices = 0;
     VkResult error = vkEnumeratePhysicalDevices(mInstance, &numPhysDevices, nullptr);
     if (VK_SUCCESS != error || !numPhysDevices) {
@@ -232,6 +553,8 @@ bool VulkanApp::InitializeDevicesAndQueues() {
     if (mPhysicalDevice == VK_NULL_HANDLE)
         mPhysicalDevice = physDevices[0];
 
+    vkGetPhysicalDeviceProperties(mPhysicalDevice, &mPhysicalDeviceProps);
+
     // find our queues
     const VkQueueFlagBits askingFlags[3] = { VK_QUEUE_GRAPHICS_BIT, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_TRANSFER_BIT };
     uint32_t queuesIndices[3] = { ~0u, ~0u, ~0u };
@@ -312,7 +635,10 @@ bool VulkanApp::InitializeDevicesAndQueues() {
     VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddress = {};
     bufferDeviceAddress.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
 
-    Array<const char*> deviceExtensions({ VK_KHR_SWAPCHAIN_EXTENSION_NAME });
+    Array<const char*> deviceExtensions;
+    if (!mSettings.headless) {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     if (mSettings.supportRaytracing) {
         deviceExtensions.push_back(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
         deviceExtensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
@@ -346,8 +672,60 @@ bool VulkanApp::InitializeDevicesAndQueues() {
         features2.pNext = &descriptorIndexing;
     }
 
+    VkPhysicalDeviceShaderClockFeaturesKHR shaderClock = { };
+    shaderClock.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_CLOCK_FEATURES_KHR;
+
+    // optional extensions are dropped from the settings if the device doesn't have them
+    if (mSettings.supportShaderClock || mSettings.supportCalibratedTimestamps) {
+        uint32_t numExtensions = 0;
+        vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &numExtensions, nullptr);
+        Array<VkExtensionProperties> extensions(numExtensions);
+        vkEnumerateDeviceExtensionProperties(mPhysicalDevice, nullptr, &numExtensions, extensions.data());
+
+        auto hasExtension = [&extensions](const char* name) {
+            for (const VkExtensionProperties& extension : extensions) {
+                if (!std::strcmp(extension.extensionName, name)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        mSettings.supportShaderClock = mSettings.supportShaderClock && hasExtension(VK_KHR_SHADER_CLOCK_EXTENSION_NAME);
+        mSettings.supportCalibratedTimestamps = mSettings.supportCalibratedTimestamps && hasExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    }
+
+    if (mSettings.supportCalibratedTimestamps) {
+        deviceExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    }
+
+    if (mSettings.supportShaderClock) {
+        deviceExtensions.push_back(VK_KHR_SHADER_CLOCK_EXTENSION_NAME);
+
+        shaderClock.pNext = features2.pNext;
+        features2.pNext = &shaderClock;
+    }
+
     vkGetPhysicalDeviceFeatures2(mPhysicalDevice, &features2); // enable all the features our GPU has
 
+    // realtime clock is what the shaders read, the subgroup one alone isn't enough
+    if (mSettings.supportShaderClock && !shaderClock.shaderDeviceClock) {
+        mSettings.supportShaderClock = false;
+
+        features2.pNext = shaderClock.pNext;
+        deviceExtensions.pop_back();
+    }
+
+    // the bindless set is update-after-bind and partially bound, its layout is invalid without these
+    if (mSettings.supportDescriptorIndexing &&
+        !(descriptorIndexing.runtimeDescriptorArray &&
+          descriptorIndexing.descriptorBindingPartiallyBound &&
+          descriptorIndexing.descriptorBindingUpdateUnusedWhilePending &&
+          descriptorIndexing.descriptorBindingStorageBufferUpdateAfterBind)) {
+        std::printf("The device lacks the descriptor indexing features the bindless resources need\n");
+        return false;
+    }
+
     VkDeviceCreateInfo deviceCreateInfo;
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.pNext = &features2;
@@ -388,6 +766,8 @@ bool VulkanApp::InitializeDevicesAndQueues() {
 }
 
 bool VulkanApp::InitializeSurface() {
+    startup::ScopedPhase phase("Create surface");
+
     VkResult error = glfwCreateWindowSurface(mInstance, mWindow, nullptr, &mSurface);
     if (VK_SUCCESS != error) {
         CHECK_VK_ERROR(error, "glfwCreateWindowSurface");
@@ -427,6 +807,8 @@ bool VulkanApp::InitializeSurface() {
 }
 
 bool VulkanApp::InitializeSwapchain() {
+    startup::ScopedPhase phase("Create swapchain");
+
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
     VkResult error = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(mPhysicalDevice, mSurface, &surfaceCapabilities);
     if (VK_SUCCESS != error) {
@@ -525,7 +907,9 @@ bool VulkanApp::InitializeFencesAndCommandPool() {
     fenceCreateInfo.pNext = nullptr;
     fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    mWaitForFrameFences.resize(mSwapchainImages.size());
+    mSettings.framesInFlight = Max(mSettings.framesInFlight, 1u);
+
+    mWaitForFrameFences.resize(mSettings.framesInFlight);
     for (VkFence& fence : mWaitForFrameFences) {
         vkCreateFence(mDevice, &fenceCreateInfo, nullptr, &fence);
     }
@@ -541,7 +925,9 @@ bool VulkanApp::InitializeFencesAndCommandPool() {
 }
 
 bool VulkanApp::InitializeOffscreenImage() {
-    const VkExtent3D extent = { mSettings.resolutionX, mSettings.resolutionY, 1 };
+    startup::ScopedPhase phase("Create offscreen image");
+
+    const VkExtent3D extent = { mSettings.renderResolutionX, mSettings.renderResolutionY, 1 };
     VkResult error = mOffscreenImage.Create(VK_IMAGE_TYPE_2D,
                                             mSurfaceFormat.format,
                                             extent,
@@ -559,7 +945,7 @@ bool VulkanApp::InitializeOffscreenImage() {
 }
 
 bool VulkanApp::InitializeCommandBuffers() {
-    mCommandBuffers.resize(mSwapchainImages.size());
+    mCommandBuffers.resize(mSettings.framesInFlight);
 
     VkCommandBufferAllocateInfo commandBufferAllocateInfo;
     commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -578,46 +964,156 @@ bool VulkanApp::InitializeSynchronization() {
     semaphoreCreatInfo.pNext = nullptr;
     semaphoreCreatInfo.flags = 0;
 
-    VkResult error = vkCreateSemaphore(mDevice, &semaphoreCreatInfo, nullptr, &mSemaphoreImageAcquired);
-    if (VK_SUCCESS != error) {
-        return false;
+    // headless frames have nothing to wait for but the fences
+    mSemaphoresImageAcquired.resize(mSettings.headless ? 0 : mSettings.framesInFlight, VK_NULL_HANDLE);
+    for (VkSemaphore& semaphore : mSemaphoresImageAcquired) {
+        const VkResult error = vkCreateSemaphore(mDevice, &semaphoreCreatInfo, nullptr, &semaphore);
+        if (VK_SUCCESS != error) {
+            return false;
+        }
+    }
+
+    mSemaphoresRenderFinished.resize(mSwapchainImages.size(), VK_NULL_HANDLE);
+    for (VkSemaphore& semaphore : mSemaphoresRenderFinished) {
+        const VkResult error = vkCreateSemaphore(mDevice, &semaphoreCreatInfo, nullptr, &semaphore);
+        if (VK_SUCCESS != error) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool VulkanApp::InitializeReadbackBuffers() {
+    const VkDeviceSize frameSize = static_cast<VkDeviceSize>(mSettings.renderResolutionX) * mSettings.renderResolutionY * sizeof(uint32_t);
+
+    mReadbackBuffers.resize(mSettings.framesInFlight);
+    mReadbackFrameNumbers.resize(mSettings.framesInFlight, ~0u);
+    for (vulkanhelpers::Buffer& buffer : mReadbackBuffers) {
+        const VkResult error = buffer.Create(frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (VK_SUCCESS != error) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool VulkanApp::InitializePipelineCache() {
+    startup::ScopedPhase phase("Load pipeline cache");
+
+    Array<uint8_t> cacheData;
+    if (!mSettings.pipelineCacheFile.empty()) {
+        std::ifstream file(mSettings.pipelineCacheFile, std::ios::in | std::ios::binary);
+        if (file.is_open()) {
+            cacheData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+    }
+
+    // drivers are supposed to reject foreign data themselves, but not all of them do it gracefully
+    if (!cacheData.empty()) {
+        VkPipelineCacheHeaderVersionOne header;
+        bool valid = cacheData.size() >= sizeof(header);
+        if (valid) {
+            std::memcpy(&header, cacheData.data(), sizeof(header));
+            valid = header.headerSize >= sizeof(header) &&
+                    header.headerSize <= cacheData.size() &&
+                    header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                    header.vendorID == mPhysicalDeviceProps.vendorID &&
+                    header.deviceID == mPhysicalDeviceProps.deviceID &&
+                    !std::memcmp(header.pipelineCacheUUID, mPhysicalDeviceProps.pipelineCacheUUID, VK_UUID_SIZE);
+        }
+
+        if (!valid) {
+            std::printf("Pipeline cache %s is from another device or driver, starting with an empty one\n", mSettings.pipelineCacheFile.c_str());
+            cacheData.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo;
+    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.pNext = nullptr;
+    pipelineCacheCreateInfo.flags = 0;
+    pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+    pipelineCacheCreateInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+    VkResult error = vkCreatePipelineCache(mDevice, &pipelineCacheCreateInfo, nullptr, &mPipelineCache);
+    if (VK_SUCCESS != error && !cacheData.empty()) {
+        // the header was fine but the driver still didn't like it
+        pipelineCacheCreateInfo.initialDataSize = 0;
+        pipelineCacheCreateInfo.pInitialData = nullptr;
+        error = vkCreatePipelineCache(mDevice, &pipelineCacheCreateInfo, nullptr, &mPipelineCache);
     }
 
-    error = vkCreateSemaphore(mDevice, &semaphoreCreatInfo, nullptr, &mSemaphoreRenderFinished);
     return (VK_SUCCESS == error);
 }
 
-void VulkanApp::FillCommandBuffers() {
+void VulkanApp::SavePipelineCache() {
+    if (!mPipelineCache || mSettings.pipelineCacheFile.empty()) {
+        return;
+    }
+
+    size_t dataSize = 0;
+    VkResult error = vkGetPipelineCacheData(mDevice, mPipelineCache, &dataSize, nullptr);
+    if (VK_SUCCESS != error || !dataSize) {
+        return;
+    }
+
+    Array<uint8_t> cacheData(dataSize);
+    error = vkGetPipelineCacheData(mDevice, mPipelineCache, &dataSize, cacheData.data());
+    if (VK_SUCCESS != error) {
+        return;
+    }
+
+    // write aside and swap, so a crash halfway never leaves a truncated cache behind
+    const String tempFile = mSettings.pipelineCacheFile + ".tmp";
+    {
+        std::ofstream file(tempFile, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(cacheData.data()), static_cast<std::streamsize>(dataSize));
+        if (!file.good()) {
+            return;
+        }
+    }
+
+    std::error_code errorCode;
+    std::filesystem::rename(tempFile, mSettings.pipelineCacheFile, errorCode);
+    if (errorCode) {
+        std::printf("Failed to save the pipeline cache to %s\n", mSettings.pipelineCacheFile.c_str());
+    }
+}
+
+void VulkanApp::RecordCommandBuffer(const uint32_t frameIndex, const uint32_t imageIndex) {
     VkCommandBufferBeginInfo commandBufferBeginInfo;
     commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     commandBufferBeginInfo.pNext = nullptr;
-    commandBufferBeginInfo.flags = 0;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     commandBufferBeginInfo.pInheritanceInfo = nullptr;
 
     VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-    for (size_t i = 0; i < mCommandBuffers.size(); i++) {
-        const VkCommandBuffer commandBuffer = mCommandBuffers[i];
+    const VkCommandBuffer commandBuffer = mCommandBuffers[frameIndex];
 
-        VkResult error = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-        CHECK_VK_ERROR(error, "vkBeginCommandBuffer");
+    VkResult error = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+    CHECK_VK_ERROR(error, "vkBeginCommandBuffer");
 
-        vulkanhelpers::ImageBarrier(commandBuffer,
-                                    mOffscreenImage.GetImage(),
-                                    subresourceRange,
-                                    0,
-                                    VK_ACCESS_SHADER_WRITE_BIT,
-                                    VK_IMAGE_LAYOUT_UNDEFINED,
-                                    VK_IMAGE_LAYOUT_GENERAL);
+    mGPUProfiler.BeginFrame(commandBuffer, frameIndex);
 
-        this->FillCommandBuffer(commandBuffer, i); // user draw code
+    // keep the previous contents, apps may decide not to render anything new
+    vulkanhelpers::ImageBarrier(commandBuffer,
+                                mOffscreenImage.GetImage(),
+                                subresourceRange,
+                                0,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                mFrameNumber ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+                                VK_IMAGE_LAYOUT_GENERAL);
 
-        vulkanhelpers::ImageBarrier(commandBuffer,
-                                    mSwapchainImages[i],
-                                    subresourceRange,
-                                    0,
-                                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    this->FillCommandBuffer(commandBuffer, frameIndex); // user draw code
+
+    if (mSettings.headless) {
+        const uint32_t readbackScope = mGPUProfiler.BeginScope(commandBuffer, "Readback copy");
 
         vulkanhelpers::ImageBarrier(commandBuffer,
                                     mOffscreenImage.GetImage(),
@@ -627,6 +1123,56 @@ void VulkanApp::FillCommandBuffers() {
                                     VK_IMAGE_LAYOUT_GENERAL,
                                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
+        VkBufferImageCopy copyRegion;
+        copyRegion.bufferOffset = 0;
+        copyRegion.bufferRowLength = 0;     // tightly packed
+        copyRegion.bufferImageHeight = 0;
+        copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copyRegion.imageOffset = { 0, 0, 0 };
+        copyRegion.imageExtent = { mSettings.renderResolutionX, mSettings.renderResolutionY, 1 };
+        vkCmdCopyImageToBuffer(commandBuffer,
+                               mOffscreenImage.GetImage(),
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               mReadbackBuffers[frameIndex].GetBuffer(),
+                               1,
+                               &copyRegion);
+
+        // make the copy visible to the host once the fence signals
+        VkMemoryBarrier memoryBarrier;
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.pNext = nullptr;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        mGPUProfiler.EndScope(commandBuffer, readbackScope);
+
+        error = vkEndCommandBuffer(commandBuffer);
+        CHECK_VK_ERROR(error, "vkEndCommandBuffer");
+        return;
+    }
+
+    const uint32_t presentScope = mGPUProfiler.BeginScope(commandBuffer, "Present copy");
+
+    vulkanhelpers::ImageBarrier(commandBuffer,
+                                mSwapchainImages[imageIndex],
+                                subresourceRange,
+                                0,
+                                VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    vulkanhelpers::ImageBarrier(commandBuffer,
+                                mOffscreenImage.GetImage(),
+                                subresourceRange,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_ACCESS_TRANSFER_READ_BIT,
+                                VK_IMAGE_LAYOUT_GENERAL,
+                                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+    if (mRenderExtent.width == mSettings.resolutionX && mRenderExtent.height == mSettings.resolutionY) {
         VkImageCopy copyRegion;
         copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
         copyRegion.srcOffset = { 0, 0, 0 };
@@ -636,87 +1182,202 @@ void VulkanApp::FillCommandBuffers() {
         vkCmdCopyImage(commandBuffer,
                        mOffscreenImage.GetImage(),
                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       mSwapchainImages[i],
+                       mSwapchainImages[imageIndex],
                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                        1,
                        &copyRegion);
+    } else {
+        // render resolution differs from the window - scale it to fit
+        VkImageBlit blitRegion;
+        blitRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        blitRegion.srcOffsets[0] = { 0, 0, 0 };
+        blitRegion.srcOffsets[1] = { static_cast<int32_t>(mRenderExtent.width), static_cast<int32_t>(mRenderExtent.height), 1 };
+        blitRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        blitRegion.dstOffsets[0] = { 0, 0, 0 };
+        blitRegion.dstOffsets[1] = { static_cast<int32_t>(mSettings.resolutionX), static_cast<int32_t>(mSettings.resolutionY), 1 };
+        vkCmdBlitImage(commandBuffer,
+                       mOffscreenImage.GetImage(),
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       mSwapchainImages[imageIndex],
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1,
+                       &blitRegion,
+                       VK_FILTER_LINEAR);
+    }
 
-        vulkanhelpers::ImageBarrier(commandBuffer,
-                                    mSwapchainImages[i], subresourceRange,
-                                    VK_ACCESS_TRANSFER_WRITE_BIT,
-                                    0,
-                                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    vulkanhelpers::ImageBarrier(commandBuffer,
+                                mSwapchainImages[imageIndex], subresourceRange,
+                                VK_ACCESS_TRANSFER_WRITE_BIT,
+                                0,
+                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
-        error = vkEndCommandBuffer(commandBuffer);
-        CHECK_VK_ERROR(error, "vkEndCommandBuffer");
-    }
+    mGPUProfiler.EndScope(commandBuffer, presentScope);
+
+    error = vkEndCommandBuffer(commandBuffer);
+    CHECK_VK_ERROR(error, "vkEndCommandBuffer");
 }
 
 
 //
 void VulkanApp::ProcessFrame(const float dt) {
+    trace::ScopedEvent frameEvent("Frame");
+
+    // start-up and warm-up frames stay out of the benchmark's percentiles and hitch count
+    if (mBenchmark.IsActive() && mFrameNumber == mSettings.benchmarkWarmupFrames) {
+        mFPSMeter.ResetStats();
+    }
     mFPSMeter.Update(dt);
 
-    uint32_t imageIndex;
-    VkResult error = vkAcquireNextImageKHR(mDevice, mSwapchain, UINT64_MAX, mSemaphoreImageAcquired, VK_NULL_HANDLE, &imageIndex);
+    // wait for the GPU to finish with this frame's resources before touching them again
+    const VkFence fence = mWaitForFrameFences[mFrameIndex];
+    VkResult error;
+    {
+        trace::ScopedEvent event("Wait for frame fence");
+        error = vkWaitForFences(mDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+    }
     if (VK_SUCCESS != error) {
         return;
     }
 
-    const VkFence fence = mWaitForFrameFences[imageIndex];
-    error = vkWaitForFences(mDevice, 1, &fence, VK_TRUE, UINT64_MAX);
-    if (VK_SUCCESS != error) {
-        return;
+    VkSemaphore imageAcquired = VK_NULL_HANDLE;
+    VkSemaphore renderFinished = VK_NULL_HANDLE;
+    uint32_t imageIndex = 0;
+
+    if (mSettings.headless) {
+        // the buffer we are about to reuse holds a finished frame
+        this->ReadbackFrame(mFrameIndex);
+    } else {
+        imageAcquired = mSemaphoresImageAcquired[mFrameIndex];
+
+        trace::ScopedEvent event("Acquire image");
+        error = vkAcquireNextImageKHR(mDevice, mSwapchain, UINT64_MAX, imageAcquired, VK_NULL_HANDLE, &imageIndex);
+        if (VK_SUCCESS != error && VK_SUBOPTIMAL_KHR != error) {
+            return;
+        }
+
+        renderFinished = mSemaphoresRenderFinished[imageIndex];
     }
     vkResetFences(mDevice, 1, &fence);
 
-    this->Update(imageIndex, dt);
+    // the fence says this slot's timestamps are written, so reading them never stalls
+    this->CollectGPUTimings(mFrameIndex, mFrameNumber - mSettings.framesInFlight);
+    mBenchmark.AddFrameTime(mFrameNumber, dt * 1000.0f);
+
+    {
+        trace::ScopedEvent event("Update");
+        this->Update(mFrameIndex, dt);
+    }
+    {
+        trace::ScopedEvent event("Record commands");
+        this->RecordCommandBuffer(mFrameIndex, imageIndex);
+    }
 
     const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
     VkSubmitInfo submitInfo;
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pNext = nullptr;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &mSemaphoreImageAcquired;
+    submitInfo.waitSemaphoreCount = imageAcquired ? 1 : 0;
+    submitInfo.pWaitSemaphores = &imageAcquired;
     submitInfo.pWaitDstStageMask = &waitStageMask;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &mCommandBuffers[imageIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &mSemaphoreRenderFinished;
+    submitInfo.pCommandBuffers = &mCommandBuffers[mFrameIndex];
+    submitInfo.signalSemaphoreCount = renderFinished ? 1 : 0;
+    submitInfo.pSignalSemaphores = &renderFinished;
 
-    error = vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, fence);
+    {
+        trace::ScopedEvent event("Submit");
+        error = vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, fence);
+    }
     if (VK_SUCCESS != error) {
         return;
     }
 
+    if (mSettings.headless) {
+        mReadbackFrameNumbers[mFrameIndex] = mFrameNumber;
+    }
+
+    ++mFrameNumber;
+    mFrameIndex = (mFrameIndex + 1) % mSettings.framesInFlight;
+
+    if (mSettings.headless) {
+        return;
+    }
+
     VkPresentInfoKHR presentInfo;
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.pNext = nullptr;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &mSemaphoreRenderFinished;
+    presentInfo.pWaitSemaphores = &renderFinished;
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &mSwapchain;
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
 
+    trace::ScopedEvent event("Present");
     error = vkQueuePresentKHR(mGraphicsQueue, &presentInfo);
     if (VK_SUCCESS != error) {
         return;
     }
 }
 
+void VulkanApp::ReadbackFrame(const uint32_t frameIndex) {
+    const uint32_t frameNumber = mReadbackFrameNumbers[frameIndex];
+    if (frameNumber == ~0u) {
+        return;
+    }
+
+    trace::ScopedEvent event("Readback");
+
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(mReadbackBuffers[frameIndex].Map());
+    if (pixels) {
+        this->OnFrameReadback(pixels, frameNumber);
+        mReadbackBuffers[frameIndex].Unmap();
+    }
+
+    mReadbackFrameNumbers[frameIndex] = ~0u;
+}
+
+void VulkanApp::CollectGPUTimings(const uint32_t frameIndex, const uint32_t frameNumber) {
+    if (mGPUProfiler.Collect(frameIndex)) {
+        mBenchmark.AddPassTimes(frameNumber, mGPUProfiler);
+    }
+}
+
+void VulkanApp::FinishBenchmark() {
+    if (!mBenchmark.IsActive()) {
+        return;
+    }
+
+    if (!mBenchmark.WriteReport(mSettings.benchmarkReport, mPhysicalDeviceProps.deviceName, mSettings.benchmarkPath, mRenderExtent.width, mRenderExtent.height)) {
+        std::printf("Failed to write the benchmark report to %s\n", mSettings.benchmarkReport.c_str());
+    }
+}
+
+void VulkanApp::ReportStartup() {
+    if (mSettings.startupReport) {
+        std::printf("%s", startup::GetReport().c_str());
+    }
+
+    if (!mSettings.startupJSON.empty() && !startup::WriteJSON(mSettings.startupJSON)) {
+        std::printf("Failed to write the startup timeline to %s\n", mSettings.startupJSON.c_str());
+    }
+}
+
 void VulkanApp::FreeVulkan() {
-    if (mSemaphoreRenderFinished) {
-        vkDestroySemaphore(mDevice, mSemaphoreRenderFinished, nullptr);
-        mSemaphoreRenderFinished = VK_NULL_HANDLE;
+    mReadbackBuffers.clear();
+    mReadbackFrameNumbers.clear();
+
+    for (VkSemaphore& semaphore : mSemaphoresRenderFinished) {
+        vkDestroySemaphore(mDevice, semaphore, nullptr);
     }
+    mSemaphoresRenderFinished.clear();
 
-    if (mSemaphoreImageAcquired) {
-        vkDestroySemaphore(mDevice, mSemaphoreImageAcquired, nullptr);
-        mSemaphoreImageAcquired = VK_NULL_HANDLE;
+    for (VkSemaphore& semaphore : mSemaphoresImageAcquired) {
+        vkDestroySemaphore(mDevice, semaphore, nullptr);
     }
+    mSemaphoresImageAcquired.clear();
 
     if (!mCommandBuffers.empty()) {
         vkFreeCommandBuffers(mDevice, mCommandPool, static_cast<uint32_t>(mCommandBuffers.size()), mCommandBuffers.data());
@@ -751,7 +1412,14 @@ void VulkanApp::FreeVulkan() {
         mSurface = VK_NULL_HANDLE;
     }
 
+    if (mPipelineCache) {
+        vkDestroyPipelineCache(mDevice, mPipelineCache, nullptr);
+        mPipelineCache = VK_NULL_HANDLE;
+    }
+
     if (mDevice) {
+        mGPUProfiler.Destroy();
+        vulkanhelpers::Shutdown();
         vkDestroyDevice(mDevice, nullptr);
         mDevice = VK_NULL_HANDLE;
     }
@@ -767,7 +1435,8 @@ void VulkanApp::FreeVulkan() {
 void VulkanApp::InitSettings() {
 }
 
-void VulkanApp::InitApp() {
+bool VulkanApp::InitApp() {
+    return true;
 }
 
 void VulkanApp::FreeResources() {
@@ -787,3 +1456,11 @@ void VulkanApp::OnKey(const int, const int, const int, const int) {
 
 void VulkanApp::Update(const size_t, const float) {
 }
+
+void VulkanApp::OnFrameReadback(const uint8_t* pixels, const uint32_t frameNumber) {
+    if (!mSettings.headlessOutput.empty() && frameNumber + 1 == mSettings.headlessFrames) {
+        const int width = static_cast<int>(mSettings.renderResolutionX);
+        const int height = static_cast<int>(mSettings.renderResolutionY);
+        stbi_write_png(mSettings.headlessOutput.c_str(), width, height, 4, pixels, width * 4);
+    }
+}
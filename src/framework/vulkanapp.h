@@ -1,31 +1,93 @@
 #include "vulkanhelpers.h"
+#include "threadpool.h"
+#include "gpuprofiler.h"
+#include "benchmark.h"
+#include "startuptimeline.h"
+#include "tracer.h"
 
 #include "GLFW/glfw3.h"
 
+#include <cstdio>
+
 #include "common.h"
 
 struct AppSettings {
     std::string name;
     uint32_t    resolutionX;
     uint32_t    resolutionY;
+    // size of the offscreen image, may be bigger than the window for offline output (0 - same as the window)
+    uint32_t    renderResolutionX;
+    uint32_t    renderResolutionY;
     VkFormat    surfaceFormat;
     bool        enableValidation;
     bool        enableVSync;
+    uint32_t    framesInFlight;     // how many frames the CPU may run ahead of the GPU
     bool        supportRaytracing;
     bool        supportDescriptorIndexing;
+    bool        supportShaderClock;     // dropped if the device doesn't have VK_KHR_shader_clock
+    bool        supportCalibratedTimestamps;    // VK_EXT_calibrated_timestamps, puts the GPU scopes into the trace
+    // no window, no swapchain - frames are read back from the offscreen image
+    bool        headless;
+    uint32_t    headlessFrames;     // how many frames to render before quitting
+    String      headlessOutput;     // if not empty - the last frame gets saved here as PNG
+    // splitting the trace into tiles spread over several frames
+    uint32_t    traceTileSize;      // 0 - one launch for the whole image
+    uint32_t    traceTilesPerFrame; // 0 - all the tiles every frame
+    // shrink the traced area within the render resolution to hold the frame time
+    bool        dynamicResolution;
+    float       targetFrameTimeMs;
+    String      frameTimesCSV;      // if not empty - every frame's time gets streamed here
+    bool        rayStats;           // instrumented shaders count the traced rays
+    // baked into the raygen as specialization constants, each combination is a pipeline of its own
+    uint32_t    maxBounces;         // 0 - up to SWS_MAX_RECURSION
+    bool        shadows;
+    // scripted run along a camera path at fixed resolution, quits when done and writes a JSON report
+    String      benchmarkPath;      // empty - no benchmark
+    uint32_t    benchmarkWarmupFrames;
+    uint32_t    benchmarkFrames;
+    String      benchmarkReport;
+    // timings of the startup phases, as a table on stdout and/or as JSON
+    bool        startupReport;
+    String      startupJSON;
+    String      traceFile;          // if not empty - CPU and GPU scopes get written here in the Chrome trace format
+    String      pipelineCacheFile;  // loaded at startup and saved at exit, empty - pipelines are built from scratch every run
+    // GLSL compiled at runtime and recompiled when edited, empty - the precompiled SPIR-V from _data/shaders
+    String      shaderSourceFolder;
+    String      shaderCompiler;     // glslangValidator, a path or just the name if it's on the PATH
 };
 
 struct FPSMeter {
     static const size_t kFPSHistorySize = 128;
+    static const size_t kHistogramSize = 64;        // log-spaced buckets, from 0.25 ms up to 1 s
 
     float   fpsHistory[kFPSHistorySize] = { 0.0f };
     size_t  historyPointer = 0;
     float   fpsAccumulator = 0.0f;
     float   fps = 0.0f;
+    size_t  numHistoryFrames = 0;   // up to kFPSHistorySize, the average only covers what's been filled
+
+    // every frame since the last reset, averages hide the stutters
+    uint32_t    histogram[kHistogramSize] = { 0 };
+    uint32_t    numFrames = 0;
+    uint32_t    numHitches = 0;     // frames much longer than the moving average
+    float       maxFrameTime = 0.0f;
+    bool        lastFrameHitch = false;
+    FILE*       csvFile = nullptr;
+    uint32_t    csvFrame = 0;       // keeps counting through ResetStats
 
     void    Update(const float dt);
     float   GetFPS() const;
     float   GetFrameTime() const;
+
+    // in ms, accurate to the bucket width (~14%)
+    float   GetPercentile(const float percent) const;
+    float   GetMaxFrameTime() const;
+    uint32_t GetNumHitches() const;
+    // starts the histogram, max and hitches over, the moving average is kept
+    void    ResetStats();
+
+    bool    OpenCSV(const String& fileName);
+    void    CloseCSV();
 };
 
 class VulkanApp {
@@ -33,7 +95,7 @@ public:
     VulkanApp();
     virtual ~VulkanApp();
 
-    void    Run();
+    void    Run(const int argc = 0, const char** argv = nullptr);
 
 protected:
     bool    Initialize();
@@ -41,6 +103,7 @@ protected:
     void    Shutdown();
 
     void    InitializeSettings();
+    void    ParseCommandLine();
     bool    InitializeVulkan();
     bool    InitializeDevicesAndQueues();
     bool    InitializeSurface();
@@ -49,41 +112,63 @@ protected:
     bool    InitializeOffscreenImage();
     bool    InitializeCommandBuffers();
     bool    InitializeSynchronization();
-    void    FillCommandBuffers();
+    bool    InitializeReadbackBuffers();
+    bool    InitializePipelineCache();
+    void    SavePipelineCache();
+    void    RecordCommandBuffer(const uint32_t frameIndex, const uint32_t imageIndex);
 
     //
     void    ProcessFrame(const float dt);
+    void    ReadbackFrame(const uint32_t frameIndex);
+    void    CollectGPUTimings(const uint32_t frameIndex, const uint32_t frameNumber);
+    void    FinishBenchmark();
+    void    ReportStartup();
     void    FreeVulkan();
 
     // to be overriden by subclasses
     virtual void InitSettings();
-    virtual void InitApp();
+    virtual bool InitApp();     // false aborts the start-up
     virtual void FreeResources();
-    virtual void FillCommandBuffer(VkCommandBuffer commandBuffer, const size_t imageIndex);
+    virtual void FillCommandBuffer(VkCommandBuffer commandBuffer, const size_t frameIndex);
 
     virtual void OnMouseMove(const float x, const float y);
     virtual void OnMouseButton(const int button, const int action, const int mods);
     virtual void OnKey(const int key, const int scancode, const int action, const int mods);
-    virtual void Update(const size_t imageIndex, const float dt);
+    virtual void Update(const size_t frameIndex, const float dt);
+    // headless mode only, tightly packed RGBA8 pixels of the offscreen image
+    virtual void OnFrameReadback(const uint8_t* pixels, const uint32_t frameNumber);
 
 protected:
     AppSettings             mSettings;
+    Array<String>           mCommandLine;
     GLFWwindow*             mWindow;
 
     VkInstance              mInstance;
     VkPhysicalDevice        mPhysicalDevice;
+    VkPhysicalDeviceProperties mPhysicalDeviceProps;
     VkDevice                mDevice;
     VkSurfaceFormatKHR      mSurfaceFormat;
     VkSurfaceKHR            mSurface;
     VkSwapchainKHR          mSwapchain;
     Array<VkImage>          mSwapchainImages;
     Array<VkImageView>      mSwapchainImageViews;
-    Array<VkFence>          mWaitForFrameFences;
     VkCommandPool           mCommandPool;
     vulkanhelpers::Image    mOffscreenImage;
+    VkPipelineCache         mPipelineCache;
+    VkExtent2D              mRenderExtent;      // part of the offscreen image the app renders to
+
+    // per frame in flight
+    Array<VkFence>          mWaitForFrameFences;
     Array<VkCommandBuffer>  mCommandBuffers;
-    VkSemaphore             mSemaphoreImageAcquired;
-    VkSemaphore             mSemaphoreRenderFinished;
+    Array<VkSemaphore>      mSemaphoresImageAcquired;
+    uint32_t                mFrameIndex;
+    // per swapchain image, presentation may still be waiting on it after the frame's fence signals
+    Array<VkSemaphore>      mSemaphoresRenderFinished;
+    uint32_t                mFrameNumber;
+
+    // headless readback ring, one buffer per frame in flight
+    Array<vulkanhelpers::Buffer>    mReadbackBuffers;
+    Array<uint32_t>                 mReadbackFrameNumbers;  // frame each buffer holds, ~0u if none
 
     uint32_t                mGraphicsQueueFamilyIndex;
     uint32_t                mComputeQueueFamilyIndex;
@@ -97,4 +182,11 @@ protected:
 
     // FPS meter
     FPSMeter                mFPSMeter;
+
+    // GPU timings of named scopes, one slot per frame in flight
+    GPUProfiler             mGPUProfiler;
+    Benchmark               mBenchmark;
+
+    // workers for the heavy CPU-side jobs (texture decoding etc.)
+    ThreadPool              mThreadPool;
 };
@@ -1,8 +1,15 @@
 #include "vulkanhelpers.h"
+#include "threadpool.h"
+#include "startuptimeline.h"
+#include "tracer.h"
 #include <string>
 #include <vector>
 #include <fstream>
 #include <cstring> // for memcpy
+#include <cmath>
+#include <mutex>
+#include <unordered_map>
+#include <thread>
 
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -17,6 +24,11 @@
 
 namespace vulkanhelpers {
 
+namespace __details {
+    static std::mutex                               sSamplerCacheMutex;
+    static std::unordered_map<uint32_t, VkSampler>  sSamplerCache;
+} // namespace __details
+
 void Initialize(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool commandPool, VkQueue transferQueue) {
     __details::sPhysDevice = physicalDevice;
     __details::sDevice = device;
@@ -26,6 +38,14 @@ void Initialize(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &__details::sPhysicalDeviceMemoryProperties);
 }
 
+void Shutdown() {
+    std::lock_guard<std::mutex> lock(__details::sSamplerCacheMutex);
+    for (auto& it : __details::sSamplerCache) {
+        vkDestroySampler(__details::sDevice, it.second, nullptr);
+    }
+    __details::sSamplerCache.clear();
+}
+
 uint32_t GetMemoryType(VkMemoryRequirements& memoryRequiriments, VkMemoryPropertyFlags memoryProperties) {
     uint32_t result = 0;
     for (uint32_t memoryTypeIndex = 0; memoryTypeIndex < VK_MAX_MEMORY_TYPES; ++memoryTypeIndex) {
@@ -66,12 +86,133 @@ void ImageBarrier(VkCommandBuffer commandBuffer,
                          &imageMemoryBarrier);
 }
 
+VkSampler GetSampler(VkFilter magFilter, VkFilter minFilter, VkSamplerMipmapMode mipmapMode, VkSamplerAddressMode addressMode) {
+    const uint32_t key = (static_cast<uint32_t>(magFilter) << 24) |
+                         (static_cast<uint32_t>(minFilter) << 16) |
+                         (static_cast<uint32_t>(mipmapMode) << 8) |
+                          static_cast<uint32_t>(addressMode);
+
+    std::lock_guard<std::mutex> lock(__details::sSamplerCacheMutex);
+
+    auto it = __details::sSamplerCache.find(key);
+    if (it != __details::sSamplerCache.end()) {
+        return it->second;
+    }
+
+    VkSamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.pNext = nullptr;
+    samplerCreateInfo.flags = 0;
+    samplerCreateInfo.magFilter = magFilter;
+    samplerCreateInfo.minFilter = minFilter;
+    samplerCreateInfo.mipmapMode = mipmapMode;
+    samplerCreateInfo.addressModeU = addressMode;
+    samplerCreateInfo.addressModeV = addressMode;
+    samplerCreateInfo.addressModeW = addressMode;
+    samplerCreateInfo.mipLodBias = 0;
+    samplerCreateInfo.anisotropyEnable = VK_FALSE;
+    samplerCreateInfo.maxAnisotropy = 1;
+    samplerCreateInfo.compareEnable = VK_FALSE;
+    samplerCreateInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerCreateInfo.minLod = 0;
+    samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+    samplerCreateInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    if (VK_SUCCESS != vkCreateSampler(__details::sDevice, &samplerCreateInfo, nullptr, &sampler)) {
+        return VK_NULL_HANDLE;
+    }
+
+    __details::sSamplerCache[key] = sampler;
+    return sampler;
+}
+
+// waits until the operation has no more work to hand out, any thread may call it
+static void JoinDeferredOperation(VkDeferredOperationKHR operation) {
+    VkResult result = vkDeferredOperationJoinKHR(__details::sDevice, operation);
+    while (VK_THREAD_IDLE_KHR == result) {
+        std::this_thread::yield();
+        result = vkDeferredOperationJoinKHR(__details::sDevice, operation);
+    }
+}
+
+VkResult CreateRayTracingPipelines(VkPipelineCache cache, const uint32_t count, const VkRayTracingPipelineCreateInfoKHR* createInfos, VkPipeline* pipelines, ThreadPool* threadPool) {
+    for (uint32_t i = 0; i < count; ++i) {
+        pipelines[i] = VK_NULL_HANDLE;
+    }
+
+    const size_t numThreads = threadPool ? threadPool->GetNumThreads() : 0;
+    Array<VkResult> results(count, VK_SUCCESS);
+
+    if (numThreads < 2 || !vkCreateDeferredOperationKHR) {
+        if (threadPool && count > 1) {
+            threadPool->ParallelFor(count, [&](const size_t i) {
+                results[i] = vkCreateRayTracingPipelinesKHR(__details::sDevice, VK_NULL_HANDLE, cache, 1, &createInfos[i], nullptr, &pipelines[i]);
+            });
+        } else {
+            for (uint32_t i = 0; i < count; ++i) {
+                results[i] = vkCreateRayTracingPipelinesKHR(__details::sDevice, VK_NULL_HANDLE, cache, 1, &createInfos[i], nullptr, &pipelines[i]);
+            }
+        }
+    } else {
+        // every pipeline gets its own operation so they don't serialize on each other
+        Array<VkDeferredOperationKHR> operations(count, VK_NULL_HANDLE);
+        for (uint32_t i = 0; i < count; ++i) {
+            results[i] = vkCreateDeferredOperationKHR(__details::sDevice, nullptr, &operations[i]);
+            if (VK_SUCCESS == results[i]) {
+                results[i] = vkCreateRayTracingPipelinesKHR(__details::sDevice, operations[i], cache, 1, &createInfos[i], nullptr, &pipelines[i]);
+            }
+        }
+
+        // the driver tells how many threads are worth it, the calling thread joins as one of them
+        for (uint32_t i = 0; i < count; ++i) {
+            if (VK_OPERATION_DEFERRED_KHR != results[i]) {
+                continue;
+            }
+
+            const size_t maxConcurrency = static_cast<size_t>(vkGetDeferredOperationMaxConcurrencyKHR(__details::sDevice, operations[i]));
+            const size_t numJoiners = Min(maxConcurrency, numThreads);
+            const VkDeferredOperationKHR operation = operations[i];
+            for (size_t j = 1; j < numJoiners; ++j) {
+                threadPool->Enqueue([operation]() {
+                    JoinDeferredOperation(operation);
+                });
+            }
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (VK_OPERATION_DEFERRED_KHR == results[i]) {
+                JoinDeferredOperation(operations[i]);
+            }
+        }
+        threadPool->Wait();
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (VK_OPERATION_DEFERRED_KHR == results[i] || VK_OPERATION_NOT_DEFERRED_KHR == results[i]) {
+                results[i] = vkGetDeferredOperationResultKHR(__details::sDevice, operations[i]);
+            }
+            if (VK_NULL_HANDLE != operations[i]) {
+                vkDestroyDeferredOperationKHR(__details::sDevice, operations[i], nullptr);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (VK_SUCCESS != results[i]) {
+            return results[i];
+        }
+    }
+    return VK_SUCCESS;
+}
+
 
 
 Buffer::Buffer()
     : mBuffer(VK_NULL_HANDLE)
     , mMemory(VK_NULL_HANDLE)
     , mSize(0)
+    , mMemoryProperties(0)
 {
 }
 Buffer::~Buffer() {
@@ -103,6 +244,7 @@ VkResult Buffer::Create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPro
         memoryAllocateInfo.pNext = nullptr;
         memoryAllocateInfo.allocationSize = memoryRequirements.size;
         memoryAllocateInfo.memoryTypeIndex = GetMemoryType(memoryRequirements, memoryProperties);
+        mMemoryProperties = __details::sPhysicalDeviceMemoryProperties.memoryTypes[memoryAllocateInfo.memoryTypeIndex].propertyFlags;
 
         VkMemoryAllocateFlagsInfo allocationFlags = {};
         allocationFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
@@ -159,6 +301,36 @@ void Buffer::Unmap() const {
     vkUnmapMemory(__details::sDevice, mMemory);
 }
 
+VkResult Buffer::Flush(VkDeviceSize size, VkDeviceSize offset) const {
+    if (mMemoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+        return VK_SUCCESS;
+    }
+
+    VkMappedMemoryRange range;
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.pNext = nullptr;
+    range.memory = mMemory;
+    range.offset = offset;
+    range.size = size;
+
+    return vkFlushMappedMemoryRanges(__details::sDevice, 1, &range);
+}
+
+VkResult Buffer::Invalidate(VkDeviceSize size, VkDeviceSize offset) const {
+    if (mMemoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
+        return VK_SUCCESS;
+    }
+
+    VkMappedMemoryRange range;
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.pNext = nullptr;
+    range.memory = mMemory;
+    range.offset = offset;
+    range.size = size;
+
+    return vkInvalidateMappedMemoryRanges(__details::sDevice, 1, &range);
+}
+
 bool Buffer::UploadData(const void* data, VkDeviceSize size, VkDeviceSize offset) const {
     bool result = false;
 
@@ -179,6 +351,10 @@ VkDeviceSize Buffer::GetSize() const {
     return mSize;
 }
 
+VkMemoryPropertyFlags Buffer::GetMemoryProperties() const {
+    return mMemoryProperties;
+}
+
 
 
 Image::Image()
@@ -199,7 +375,8 @@ VkResult Image::Create(VkImageType imageType,
                        VkExtent3D extent,
                        VkImageTiling tiling,
                        VkImageUsageFlags usage,
-                       VkMemoryPropertyFlags memoryProperties) {
+                       VkMemoryPropertyFlags memoryProperties,
+                       uint32_t mipLevels) {
     VkResult result = VK_SUCCESS;
 
     mFormat = format;
@@ -209,7 +386,7 @@ VkResult Image::Create(VkImageType imageType,
     imageCreateInfo.imageType = imageType;
     imageCreateInfo.format = format;
     imageCreateInfo.extent = extent;
-    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.mipLevels = mipLevels;
     imageCreateInfo.arrayLayers = 1;
     imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageCreateInfo.tiling = tiling;
@@ -226,6 +403,7 @@ VkResult Image::Create(VkImageType imageType,
         memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
         memoryAllocateInfo.allocationSize = memoryRequirements.size;
         memoryAllocateInfo.memoryTypeIndex = GetMemoryType(memoryRequirements, memoryProperties);
+        mMemoryProperties = __details::sPhysicalDeviceMemoryProperties.memoryTypes[memoryAllocateInfo.memoryTypeIndex].propertyFlags;
 
         result = vkAllocateMemory(__details::sDevice, &memoryAllocateInfo, nullptr, &mMemory);
         if (VK_SUCCESS != result) {
@@ -247,10 +425,8 @@ VkResult Image::Create(VkImageType imageType,
 }
 
 void Image::Destroy() {
-    if (mSampler) {
-        vkDestroySampler(__details::sDevice, mSampler, nullptr);
-        mSampler = VK_NULL_HANDLE;
-    }
+    // the sampler belongs to the cache
+    mSampler = VK_NULL_HANDLE;
     if (mImageView) {
         vkDestroyImageView(__details::sDevice, mImageView, nullptr);
         mImageView = VK_NULL_HANDLE;
@@ -265,8 +441,53 @@ void Image::Destroy() {
     }
 }
 
-bool Image::Load(const char* fileName) {
-    int width, height, channels;
+bool Image::Load(const char* fileName, const HDRFormat hdrFormat) {
+    ImageLoader loader;
+    loader.Add(this, fileName, hdrFormat);
+    return loader.LoadAll(nullptr);
+}
+
+VkResult Image::CreateImageView(VkImageViewType viewType, VkFormat format, VkImageSubresourceRange subresourceRange) {
+    VkImageViewCreateInfo imageViewCreateInfo;
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.pNext = nullptr;
+    imageViewCreateInfo.viewType = viewType;
+    imageViewCreateInfo.format = format;
+    imageViewCreateInfo.subresourceRange = subresourceRange;
+    imageViewCreateInfo.image = mImage;
+    imageViewCreateInfo.flags = 0;
+    imageViewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+
+    return vkCreateImageView(__details::sDevice, &imageViewCreateInfo, nullptr, &mImageView);
+}
+
+VkResult Image::CreateSampler(VkFilter magFilter, VkFilter minFilter, VkSamplerMipmapMode mipmapMode, VkSamplerAddressMode addressMode) {
+    // shared with all the other images using the same settings
+    mSampler = GetSampler(magFilter, minFilter, mipmapMode, addressMode);
+    return mSampler ? VK_SUCCESS : VK_ERROR_INITIALIZATION_FAILED;
+}
+
+// getters
+VkFormat Image::GetFormat() const {
+    return mFormat;
+}
+
+VkImage Image::GetImage() const {
+    return mImage;
+}
+
+VkImageView Image::GetImageView() const {
+    return mImageView;
+}
+
+VkSampler Image::GetSampler() const {
+    return mSampler;
+}
+
+
+
+bool ImageData::Decode(const char* fileName, const HDRFormat hdrFormat) {
+    int w, h, channels;
     bool textureHDR = false;
     stbi_uc* imageData = nullptr;
 
@@ -275,165 +496,283 @@ bool Image::Load(const char* fileName) {
 
     if (extension == "hdr") {
         textureHDR = true;
-        imageData = reinterpret_cast<stbi_uc*>(stbi_loadf(fileName, &width, &height, &channels, STBI_rgb_alpha));
+        imageData = reinterpret_cast<stbi_uc*>(stbi_loadf(fileName, &w, &h, &channels, STBI_rgb_alpha));
     } else {
-        imageData = stbi_load(fileName, &width, &height, &channels, STBI_rgb_alpha);
+        imageData = stbi_load(fileName, &w, &h, &channels, STBI_rgb_alpha);
     }
 
-    if (imageData) {
-        const int bpp = textureHDR ? sizeof(float[4]) : sizeof(uint8_t[4]);
-        VkDeviceSize imageSize = static_cast<VkDeviceSize>(width * height * bpp);
+    if (!imageData) {
+        return false;
+    }
 
-        Buffer stagingBuffer;
-        VkResult error = stagingBuffer.Create(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        if (VK_SUCCESS == error && stagingBuffer.UploadData(imageData, imageSize)) {
-            stbi_image_free(imageData);
+    width = static_cast<uint32_t>(w);
+    height = static_cast<uint32_t>(h);
+    mipLevels = 1;
 
-            VkExtent3D imageExtent {
-                static_cast<uint32_t>(width),
-                static_cast<uint32_t>(height),
-                1
-            };
+    const size_t numTexels = static_cast<size_t>(width) * height;
 
-            const VkFormat fmt = textureHDR ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R8G8B8A8_SRGB;
+    if (!textureHDR) {
+        format = VK_FORMAT_R8G8B8A8_SRGB;
+        pixels.resize(numTexels * sizeof(uint8_t[4]));
+        std::memcpy(pixels.data(), imageData, pixels.size());
+    } else {
+        // full float HDR is rarely needed, so by default we go for the compact formats
+        const float* hdrData = reinterpret_cast<const float*>(imageData);
+        switch (hdrFormat) {
+            case HDRFormat::Float32:
+                format = VK_FORMAT_R32G32B32A32_SFLOAT;
+                pixels.resize(numTexels * sizeof(float[4]));
+                std::memcpy(pixels.data(), hdrData, pixels.size());
+            break;
+
+            case HDRFormat::Float16:
+                format = VK_FORMAT_R16G16B16A16_SFLOAT;
+                pixels.resize(numTexels * sizeof(uint16_t[4]));
+                ConvertRGBA32FToRGBA16F(hdrData, reinterpret_cast<uint16_t*>(pixels.data()), numTexels);
+            break;
+
+            case HDRFormat::RGB9E5:
+                format = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+                pixels.resize(numTexels * sizeof(uint32_t));
+                ConvertRGBA32FToRGB9E5(hdrData, reinterpret_cast<uint32_t*>(pixels.data()), numTexels);
+            break;
+        }
+    }
+
+    stbi_image_free(imageData);
+
+    return true;
+}
 
-            error = this->Create(VK_IMAGE_TYPE_2D, fmt, imageExtent, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-            if (VK_SUCCESS != error) {
-                return false;
-            }
 
-            VkCommandBufferAllocateInfo allocInfo = {};
-            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            allocInfo.commandPool = __details::sCommandPool;
-            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            allocInfo.commandBufferCount = 1;
 
-            VkCommandBuffer commandBuffer;
-            error = vkAllocateCommandBuffers(__details::sDevice, &allocInfo, &commandBuffer);
-            if (VK_SUCCESS != error) {
-                return false;
+void ImageData::ReadTexel(const uint32_t x, const uint32_t y, float* rgba) const {
+    const size_t idx = static_cast<size_t>(y) * width + x;
+
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_SRGB: {
+            const uint8_t* texel = pixels.data() + idx * 4;
+            for (int i = 0; i < 3; ++i) {
+                const float c = static_cast<float>(texel[i]) / 255.0f;
+                rgba[i] = (c <= 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f);
             }
+            rgba[3] = static_cast<float>(texel[3]) / 255.0f;
+        } break;
 
-            VkCommandBufferBeginInfo beginInfo = {};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        case VK_FORMAT_R32G32B32A32_SFLOAT: {
+            std::memcpy(rgba, pixels.data() + idx * sizeof(float[4]), sizeof(float[4]));
+        } break;
 
-            error = vkBeginCommandBuffer(commandBuffer, &beginInfo);
-            if (VK_SUCCESS != error) {
-                vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
-                return false;
+        case VK_FORMAT_R16G16B16A16_SFLOAT: {
+            const uint16_t* texel = reinterpret_cast<const uint16_t*>(pixels.data()) + idx * 4;
+            for (int i = 0; i < 4; ++i) {
+                rgba[i] = HalfToFloat(texel[i]);
             }
+        } break;
 
-            VkImageMemoryBarrier barrier = {};
-            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-            barrier.image = mImage;
-            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32: {
+            RGB9E5ToRGB(reinterpret_cast<const uint32_t*>(pixels.data())[idx], rgba);
+            rgba[3] = 1.0f;
+        } break;
 
-            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        default:
+            rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+        break;
+    }
+}
 
-            VkBufferImageCopy region = {};
-            region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-            region.imageExtent = imageExtent;
 
-            vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.GetBuffer(), mImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+size_t ImageData::GetTexelSize() const {
+    switch (format) {
+        case VK_FORMAT_R32G32B32A32_SFLOAT: return sizeof(float[4]);
+        case VK_FORMAT_R16G16B16A16_SFLOAT: return sizeof(uint16_t[4]);
+        default:                            return sizeof(uint32_t);
+    }
+}
 
-            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+size_t ImageData::GetMipOffset(const uint32_t level) const {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; ++i) {
+        offset += static_cast<size_t>(Max(width >> i, 1u)) * Max(height >> i, 1u) * this->GetTexelSize();
+    }
+    return offset;
+}
 
-            error = vkEndCommandBuffer(commandBuffer);
-            if (VK_SUCCESS != error) {
-                vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
-                return false;
-            }
 
-            VkSubmitInfo submitInfo = {};
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &commandBuffer;
 
-            error = vkQueueSubmit(__details::sTransferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-            if (VK_SUCCESS != error) {
-                vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
-                return false;
-            }
+ImageLoader::ImageLoader() {
+}
+
+void ImageLoader::Add(Image* image, const String& fileName, const HDRFormat hdrFormat) {
+    mItems.push_back({ image, fileName, hdrFormat, {}, false });
+}
+
+void ImageLoader::Add(Image* image, ImageData&& data) {
+    mItems.push_back({ image, String(), HDRFormat::Float16, std::move(data), true });
+}
+
+bool ImageLoader::LoadAll(ThreadPool* threadPool) {
+    if (mItems.empty()) {
+        return true;
+    }
+
+    // decoding is the heaviest part, so spread it across the workers
+    auto decodeItem = [this](const size_t i) {
+        Item& item = mItems[i];
+        if (!item.decoded) {
+            trace::ScopedEvent event("Decode image");
+            item.decoded = item.data.Decode(item.fileName.c_str(), item.hdrFormat);
+        }
+    };
+
+    ThreadPool::ParallelFor(threadPool, mItems.size(), decodeItem);
+
+    // all the images share one staging buffer
+    Array<VkDeviceSize> offsets(mItems.size(), 0);
+    VkDeviceSize stagingSize = 0;
+    for (size_t i = 0; i < mItems.size(); ++i) {
+        if (mItems[i].decoded) {
+            offsets[i] = stagingSize;
+            stagingSize += (mItems[i].data.pixels.size() + 15) & ~VkDeviceSize(15);
+        }
+    }
+
+    if (!stagingSize) {
+        return false;
+    }
+
+    Buffer stagingBuffer;
+    VkResult error = stagingBuffer.Create(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    uint8_t* stagingMem = static_cast<uint8_t*>(stagingBuffer.Map());
+    if (!stagingMem) {
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; i < mItems.size(); ++i) {
+        Item& item = mItems[i];
+        if (!item.decoded) {
+            result = false;
+            continue;
+        }
+
+        std::memcpy(stagingMem + offsets[i], item.data.pixels.data(), item.data.pixels.size());
+        item.data.pixels = Array<uint8_t>(); // free the memory right away
+
+        const VkExtent3D imageExtent { item.data.width, item.data.height, 1 };
+        error = item.image->Create(VK_IMAGE_TYPE_2D, item.data.format, imageExtent, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, item.data.mipLevels);
+        if (VK_SUCCESS != error) {
+            item.decoded = false;
+            result = false;
+        }
+    }
+
+    stagingBuffer.Unmap();
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = __details::sCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    error = vkAllocateCommandBuffers(__details::sDevice, &allocInfo, &commandBuffer);
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    error = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (VK_SUCCESS != error) {
+        vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
+        return false;
+    }
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+    Array<VkImageMemoryBarrier> barriers;
+    for (const Item& item : mItems) {
+        if (item.decoded) {
+            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, item.data.mipLevels, 0, 1 };
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.image = item.image->GetImage();
+            barriers.push_back(barrier);
+        }
+    }
 
-            error = vkQueueWaitIdle(__details::sTransferQueue);
-            if (VK_SUCCESS != error) {
-                vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
-                return false;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    for (size_t i = 0; i < mItems.size(); ++i) {
+        const Item& item = mItems[i];
+        if (item.decoded) {
+            Array<VkBufferImageCopy> regions(item.data.mipLevels, VkBufferImageCopy{});
+            for (uint32_t level = 0; level < item.data.mipLevels; ++level) {
+                VkBufferImageCopy& region = regions[level];
+                region.bufferOffset = offsets[i] + item.data.GetMipOffset(level);
+                region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+                region.imageExtent = { Max(item.data.width >> level, 1u), Max(item.data.height >> level, 1u), 1 };
             }
 
-            vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
-        } else {
-            stbi_image_free(imageData);
+            vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.GetBuffer(), item.image->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
         }
     }
 
-    return true;
-}
+    for (VkImageMemoryBarrier& b : barriers) {
+        b.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        b.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        b.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        b.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
 
-VkResult Image::CreateImageView(VkImageViewType viewType, VkFormat format, VkImageSubresourceRange subresourceRange) {
-    VkImageViewCreateInfo imageViewCreateInfo;
-    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    imageViewCreateInfo.pNext = nullptr;
-    imageViewCreateInfo.viewType = viewType;
-    imageViewCreateInfo.format = format;
-    imageViewCreateInfo.subresourceRange = subresourceRange;
-    imageViewCreateInfo.image = mImage;
-    imageViewCreateInfo.flags = 0;
-    imageViewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
 
-    return vkCreateImageView(__details::sDevice, &imageViewCreateInfo, nullptr, &mImageView);
-}
+    error = vkEndCommandBuffer(commandBuffer);
+    if (VK_SUCCESS != error) {
+        vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
+        return false;
+    }
 
-VkResult Image::CreateSampler(VkFilter magFilter, VkFilter minFilter, VkSamplerMipmapMode mipmapMode, VkSamplerAddressMode addressMode) {
-    VkSamplerCreateInfo samplerCreateInfo;
-    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerCreateInfo.pNext = nullptr;
-    samplerCreateInfo.flags = 0;
-    samplerCreateInfo.magFilter = magFilter;
-    samplerCreateInfo.minFilter = minFilter;
-    samplerCreateInfo.mipmapMode = mipmapMode;
-    samplerCreateInfo.addressModeU = addressMode;
-    samplerCreateInfo.addressModeV = addressMode;
-    samplerCreateInfo.addressModeW = addressMode;
-    samplerCreateInfo.mipLodBias = 0;
-    samplerCreateInfo.anisotropyEnable = VK_FALSE;
-    samplerCreateInfo.maxAnisotropy = 1;
-    samplerCreateInfo.compareEnable = VK_FALSE;
-    samplerCreateInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-    samplerCreateInfo.minLod = 0;
-    samplerCreateInfo.maxLod = 0;
-    samplerCreateInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-    return vkCreateSampler(__details::sDevice, &samplerCreateInfo, nullptr, &mSampler);
-}
+    VkFence fence = VK_NULL_HANDLE;
+    error = vkCreateFence(__details::sDevice, &fenceCreateInfo, nullptr, &fence);
+    if (VK_SUCCESS != error) {
+        vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
+        return false;
+    }
 
-// getters
-VkFormat Image::GetFormat() const {
-    return mFormat;
-}
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
 
-VkImage Image::GetImage() const {
-    return mImage;
-}
+    error = vkQueueSubmit(__details::sTransferQueue, 1, &submitInfo, fence);
+    if (VK_SUCCESS == error) {
+        startup::ScopedGPUWait gpuWait;
+        error = vkWaitForFences(__details::sDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+    }
 
-VkImageView Image::GetImageView() const {
-    return mImageView;
-}
+    vkDestroyFence(__details::sDevice, fence, nullptr);
+    vkFreeCommandBuffers(__details::sDevice, __details::sCommandPool, 1, &commandBuffer);
 
-VkSampler Image::GetSampler() const {
-    return mSampler;
+    mItems.clear();
+
+    return result && (VK_SUCCESS == error);
 }
 
 
@@ -458,20 +797,24 @@ bool Shader::LoadFromFile(const char* fileName) {
         std::vector<char> bytecode(fileSize);
         bytecode.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
-        VkShaderModuleCreateInfo shaderModuleCreateInfo;
-        shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        shaderModuleCreateInfo.pNext = nullptr;
-        shaderModuleCreateInfo.codeSize = bytecode.size();
-        shaderModuleCreateInfo.pCode = reinterpret_cast<uint32_t*>(bytecode.data());
-        shaderModuleCreateInfo.flags = 0;
-
-        const VkResult error = vkCreateShaderModule(__details::sDevice, &shaderModuleCreateInfo, nullptr, &mModule);
-        result = (VK_SUCCESS == error);
+        result = this->LoadFromMemory(bytecode.data(), bytecode.size());
     }
 
     return result;
 }
 
+bool Shader::LoadFromMemory(const void* bytecode, const size_t size) {
+    VkShaderModuleCreateInfo shaderModuleCreateInfo;
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.pNext = nullptr;
+    shaderModuleCreateInfo.codeSize = size;
+    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(bytecode);
+    shaderModuleCreateInfo.flags = 0;
+
+    const VkResult error = vkCreateShaderModule(__details::sDevice, &shaderModuleCreateInfo, nullptr, &mModule);
+    return (VK_SUCCESS == error);
+}
+
 void Shader::Destroy() {
     if (mModule) {
         vkDestroyShaderModule(__details::sDevice, mModule, nullptr);
@@ -479,7 +822,7 @@ void Shader::Destroy() {
     }
 }
 
-VkPipelineShaderStageCreateInfo Shader::GetShaderStage(VkShaderStageFlagBits stage) {
+VkPipelineShaderStageCreateInfo Shader::GetShaderStage(VkShaderStageFlagBits stage, const VkSpecializationInfo* specialization) const {
     return VkPipelineShaderStageCreateInfo {
         /*sType*/ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
         /*pNext*/ nullptr,
@@ -487,7 +830,7 @@ VkPipelineShaderStageCreateInfo Shader::GetShaderStage(VkShaderStageFlagBits sta
         /*stage*/ stage,
         /*module*/ mModule,
         /*pName*/ "main",
-        /*pSpecializationInfo*/ nullptr
+        /*pSpecializationInfo*/ specialization
     };
 }
 
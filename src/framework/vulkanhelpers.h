@@ -3,8 +3,13 @@
 #include "vulkan/vulkan.h"
 #include "volk.h"
 
+#include "common.h"
+#include "imageconvert.h"
+
 #include <cassert>
 
+class ThreadPool;
+
 #define CHECK_VK_ERROR(_error, _message) do {   \
     if (VK_SUCCESS != error) {                  \
         assert(false && _message);              \
@@ -23,6 +28,8 @@ namespace vulkanhelpers {
     } // namespace __details
 
     void     Initialize(VkPhysicalDevice physicalDevice, VkDevice device, VkCommandPool commandPool, VkQueue transferQueue);
+    // releases the shared objects (cached samplers), must be called before the device is destroyed
+    void     Shutdown();
     uint32_t GetMemoryType(VkMemoryRequirements& memoryRequiriments, VkMemoryPropertyFlags memoryProperties);
     void     ImageBarrier(VkCommandBuffer commandBuffer,
                           VkImage image,
@@ -31,6 +38,11 @@ namespace vulkanhelpers {
                           VkAccessFlags dstAccessMask,
                           VkImageLayout oldLayout,
                           VkImageLayout newLayout);
+    // samplers are shared, every unique combination is created once and lives until Shutdown
+    VkSampler GetSampler(VkFilter magFilter, VkFilter minFilter, VkSamplerMipmapMode mipmapMode, VkSamplerAddressMode addressMode);
+    // creates the pipelines concurrently, each as a deferred operation joined by the pool workers and the calling thread,
+    // falls back to one plain create per worker if deferred host operations aren't available. Returns the first failure
+    VkResult  CreateRayTracingPipelines(VkPipelineCache cache, const uint32_t count, const VkRayTracingPipelineCreateInfoKHR* createInfos, VkPipeline* pipelines, ThreadPool* threadPool);
 
 
     class Buffer {
@@ -43,17 +55,23 @@ namespace vulkanhelpers {
 
         void*           Map(VkDeviceSize size = UINT64_MAX, VkDeviceSize offset = 0) const;
         void            Unmap() const;
+        // no-ops for coherent memory, otherwise the range has to be nonCoherentAtomSize aligned
+        VkResult        Flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
+        VkResult        Invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
 
         bool            UploadData(const void* data, VkDeviceSize size, VkDeviceSize offset = 0) const;
 
         // getters
         VkBuffer        GetBuffer() const;
         VkDeviceSize    GetSize() const;
+        // flags of the memory type actually picked, may lack some of the requested ones
+        VkMemoryPropertyFlags GetMemoryProperties() const;
 
     private:
-        VkBuffer        mBuffer;
-        VkDeviceMemory  mMemory;
-        VkDeviceSize    mSize;
+        VkBuffer                mBuffer;
+        VkDeviceMemory          mMemory;
+        VkDeviceSize            mSize;
+        VkMemoryPropertyFlags   mMemoryProperties;
     };
 
 
@@ -67,10 +85,11 @@ namespace vulkanhelpers {
                            VkExtent3D extent,
                            VkImageTiling tiling,
                            VkImageUsageFlags usage,
-                           VkMemoryPropertyFlags memoryProperties);
+                           VkMemoryPropertyFlags memoryProperties,
+                           uint32_t mipLevels = 1);
 
         void        Destroy();
-        bool        Load(const char* fileName);
+        bool        Load(const char* fileName, const HDRFormat hdrFormat = HDRFormat::Float16);
         VkResult    CreateImageView(VkImageViewType viewType, VkFormat format, VkImageSubresourceRange subresourceRange);
         VkResult    CreateSampler(VkFilter magFilter, VkFilter minFilter, VkSamplerMipmapMode mipmapMode, VkSamplerAddressMode addressMode);
 
@@ -89,15 +108,57 @@ namespace vulkanhelpers {
     };
 
 
+    // CPU-side decoded image, ready to be copied to the GPU
+    struct ImageData {
+        uint32_t        width;
+        uint32_t        height;
+        uint32_t        mipLevels;
+        VkFormat        format;
+        Array<uint8_t>  pixels;     // all the mips, one after another
+
+        bool            Decode(const char* fileName, const HDRFormat hdrFormat = HDRFormat::Float16);
+        // returns linear RGBA of the top mip regardless of the storage format
+        void            ReadTexel(const uint32_t x, const uint32_t y, float* rgba) const;
+
+        size_t          GetTexelSize() const;
+        size_t          GetMipOffset(const uint32_t level) const;
+    };
+
+
+    // decodes a batch of images on the thread pool and uploads all of them with a single submission
+    class ImageLoader {
+    public:
+        ImageLoader();
+        ~ImageLoader() = default;
+
+        void        Add(Image* image, const String& fileName, const HDRFormat hdrFormat = HDRFormat::Float16);
+        void        Add(Image* image, ImageData&& data);
+        bool        LoadAll(ThreadPool* threadPool);
+
+    private:
+        struct Item {
+            Image*      image;
+            String      fileName;
+            HDRFormat   hdrFormat;
+            ImageData   data;
+            bool        decoded;
+        };
+
+        Array<Item> mItems;
+    };
+
+
     class Shader {
     public:
         Shader();
         ~Shader();
 
         bool    LoadFromFile(const char* fileName);
+        bool    LoadFromMemory(const void* bytecode, const size_t size);
         void    Destroy();
 
-        VkPipelineShaderStageCreateInfo GetShaderStage(VkShaderStageFlagBits stage);
+        // specialization has to outlive the pipeline creation
+        VkPipelineShaderStageCreateInfo GetShaderStage(VkShaderStageFlagBits stage, const VkSpecializationInfo* specialization = nullptr) const;
 
     private:
         VkShaderModule  mModule;
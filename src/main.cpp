@@ -2,5 +2,5 @@
 
 int main(int argc, const char** argv) {
     RtxApp app;
-    app.Run();
+    app.Run(argc, argv);
 }
@@ -1,5 +1,10 @@
 #include "rtxApp.h"
+#include "framework/envmap.h"
+#include "framework/startuptimeline.h"
 #include <filesystem>
+#include <cstring> // for memcpy
+#include <cstddef> // for offsetof
+#include <cmath>
 
 #include "shared_with_shaders.h"
 
@@ -8,6 +13,7 @@
 
 
 static const String sShadersFolder = "_data/shaders/";
+static const String sShaderCacheFolder = "_data/shaders/cache/";
 static const String sScenesFolder = "_data/scenes/";
 static const String sEnvsFolder = "_data/envs/";
 
@@ -15,15 +21,71 @@ static const float sMoveSpeed = 2.0f;
 static const float sAccelMult = 5.0f;
 static const float sRotateSpeed = 0.25f;
 
+static const float sTitleUpdateInterval = 0.25f;  // seconds
+static const float sShaderWatchInterval = 0.5f;   // seconds
+
+// environment maps are only ever sampled as RGB, so the shared-exponent format is enough
+static const HDRFormat sEnvHDRFormat = HDRFormat::RGB9E5;
+
 static const vec3 sSunPos = vec3(0.4f, 0.45f, 0.55f);
 static const float sAmbientLight = 0.1f;
+static const float sEnvLightIntensity = 1.0f;
+
+// 32x32 pages of 136x136 texels, ~72 MB of RGBA8 no matter how many textures the scene has
+static const uint32_t sVTPoolSizeInPages = 32;
+
+// once reached the image is considered converged and we stop tracing until something changes
+static const uint32_t sAccumTargetSamples = 1024;
+
+// dynamic resolution: share of the frame time the trace may take, the rest is for everything else
+static const float sTraceTimeBudget = 0.8f;
+static const float sMinResolutionScale = 0.5f;
+
+// GPU profiler scopes
+static const String sTraceScopeName = "Trace rays";
+static const String sBuildBLASScopeName = "Build BLAS";
+static const String sBuildTLASScopeName = "Build TLAS";
+
+// bindless array capacity, plenty of room for dynamic scenes
+static const uint32_t sMaxBindlessBuffers = 16384;
+
+// weight of the newest frame in the Mrays/s readout
+static const float sRaysPerSecondSmoothing = 0.1f;
+
+// cost heatmap ramp tops, in traces per pixel or in shader clock ticks
+static const float sHeatmapTracesScale = static_cast<float>(SWS_MAX_RECURSION + 2);
+static const float sHeatmapClockScale = 100000.0f;
+
+// pipeline variant keys: the bounce count in the low byte, the feature bits above it
+static const uint32_t sVariantBouncesMask = 0xFFu;
+static const uint32_t sVariantShadowsBit = 1u << 8;
+static const uint32_t sVariantDebugViewsBit = 1u << 9;
+static const uint32_t sVariantShaderClockBit = 1u << 10;
+
+// the raygen specialization constants, as laid out in ray_gen.glsl
+struct RaygenSpecialization {
+    uint32_t    maxBounces;
+    VkBool32    shadows;
+    VkBool32    debugViews;
+};
+static const uint32_t sNumRaygenSpecializationEntries = 3;
+static const VkSpecializationMapEntry sRaygenSpecializationEntries[sNumRaygenSpecializationEntries] = {
+    { SWS_SC_MAX_BOUNCES, offsetof(RaygenSpecialization, maxBounces), sizeof(uint32_t) },
+    { SWS_SC_SHADOWS, offsetof(RaygenSpecialization, shadows), sizeof(VkBool32) },
+    { SWS_SC_DEBUG_VIEWS, offsetof(RaygenSpecialization, debugViews), sizeof(VkBool32) },
+};
+
+// only the raygen traces, the hit and miss shaders never do
+static const uint32_t sMaxRayRecursionDepth = 1;
+
+static const char* sRayStatsCounterNames[SWS_RAY_STATS_DEPTHS] = { "primaryRays", "secondaryRays", "shadowRays", nullptr };
 
 
 
 RtxApp::RtxApp()
     : VulkanApp()
     , mRTPipelineLayout(VK_NULL_HANDLE)
-    , mRTPipeline(VK_NULL_HANDLE)
+    , mPipelineKey(0)
     , mRTDescriptorPool(VK_NULL_HANDLE)
     , mWKeyDown(false)
     , mAKeyDown(false)
@@ -31,6 +93,18 @@ RtxApp::RtxApp()
     , mDKeyDown(false)
     , mShiftDown(false)
     , mLMBDown(false)
+    , mFrameStamp(0)
+    , mTitleUpdateTime(0.0f)
+    , mShaderWatchTime(0.0f)
+    , mCameraSliceSize(0)
+    , mEnvLighting(true)
+    , mCostHeatmap(false)
+    , mHeatmapScale(0.0f)
+    , mAccumFrame(0)
+    , mAccumReset(true)
+    , mAccumDiscard(true)
+    , mRayStatsSliceSize(0)
+    , mMraysPerSecond(0.0f)
 {
 }
 RtxApp::~RtxApp() {
@@ -48,13 +122,45 @@ void RtxApp::InitSettings() {
     mSettings.resolutionY = 1080;
 }
 
-void RtxApp::InitApp() {
-    this->LoadSceneGeometry();
+bool RtxApp::InitApp() {
+    startup::ScopedPhase phase("Init app");
+
+    // before anything heavy, a mistyped path must not turn into a report of a camera that never moved
+    if (!mSettings.benchmarkPath.empty() && !mCameraPath.Load(mSettings.benchmarkPath)) {
+        std::printf("Failed to load the benchmark camera path %s\n", mSettings.benchmarkPath.c_str());
+        return false;
+    }
+
+    if (!mBindless.Initialize(mDevice, mPhysicalDevice, sMaxBindlessBuffers, mSettings.framesInFlight, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR)) {
+        std::printf("Failed to create the bindless resources set\n");
+        return false;
+    }
+
+    if (!this->LoadSceneGeometry()) {
+        return false;
+    }
     this->CreateScene();
     this->CreateCamera();
+    this->CreateAccumulationImage();
+    this->CreateRayStats();
     this->CreateDescriptorSetsLayouts();
+    if (!mSettings.shaderSourceFolder.empty()) {
+        mShaderCompiler.Initialize(mSettings.shaderSourceFolder, sShaderCacheFolder, mSettings.shaderCompiler);
+    }
     this->CreateRaytracingPipelineAndSBT();
     this->UpdateDescriptorSets();
+
+    mBindless.Flush(mFrameStamp);
+
+    mTileScheduler.Initialize(mRenderExtent.width, mRenderExtent.height, mSettings.traceTileSize, TileScheduler::Order::CenterFirst);
+    mDynamicResolution.Initialize(mSettings.renderResolutionX, mSettings.renderResolutionY, mSettings.targetFrameTimeMs * sTraceTimeBudget, sMinResolutionScale);
+
+    mBenchmark.SetRaysPass(sTraceScopeName);
+    mBenchmark.SetVariant("maxBounces=" + std::to_string(this->GetPipelineKey(false) & sVariantBouncesMask) + (mSettings.shadows ? " shadows=on" : " shadows=off"));
+
+    mHeatmapScale = mSettings.supportShaderClock ? sHeatmapClockScale : sHeatmapTracesScale;
+
+    return true;
 }
 
 void RtxApp::FreeResources() {
@@ -63,6 +169,11 @@ void RtxApp::FreeResources() {
     }
     mScene.meshes.clear();
     mScene.materials.clear();
+    mScene.meshesBuffer.Destroy();
+    mScene.materialsBuffer.Destroy();
+
+    mVirtualTextures.Destroy();
+    mBindless.Destroy();
 
     if (mScene.topLevelAS.accelerationStructure) {
         vkDestroyAccelerationStructureKHR(mDevice, mScene.topLevelAS.accelerationStructure, nullptr);
@@ -74,64 +185,116 @@ void RtxApp::FreeResources() {
         mRTDescriptorPool = VK_NULL_HANDLE;
     }
 
-    mSBT.Destroy();
-
-    if (mRTPipeline) {
-        vkDestroyPipeline(mDevice, mRTPipeline, nullptr);
-        mRTPipeline = VK_NULL_HANDLE;
-    }
+    this->FreeRaytracingPipelines();
 
     if (mRTPipelineLayout) {
         vkDestroyPipelineLayout(mDevice, mRTPipelineLayout, nullptr);
         mRTPipelineLayout = VK_NULL_HANDLE;
     }
 
+    // the resources set layout belongs to the registry
+    mRTDescriptorSetsLayouts[SWS_RESOURCES_SET] = VK_NULL_HANDLE;
     for (VkDescriptorSetLayout& dsl : mRTDescriptorSetsLayouts) {
-        vkDestroyDescriptorSetLayout(mDevice, dsl, nullptr);
+        if (dsl) {
+            vkDestroyDescriptorSetLayout(mDevice, dsl, nullptr);
+        }
     }
     mRTDescriptorSetsLayouts.clear();
 }
 
-void RtxApp::FillCommandBuffer(VkCommandBuffer commandBuffer, const size_t imageIndex) {
+void RtxApp::FillCommandBuffer(VkCommandBuffer commandBuffer, const size_t frameIndex) {
+    // converged - the offscreen image already holds the final picture,
+    // no pipeline - a shader reload compiled but the driver refused the pipeline, the next edit tries again
+    const auto variant = mPipelines.find(mPipelineKey);
+    if (mFrameTiles.empty() || variant == mPipelines.end() || VK_NULL_HANDLE == variant->second.pipeline) {
+        return;
+    }
+
+    const uint32_t traceScope = mGPUProfiler.BeginScope(commandBuffer, sTraceScopeName);
+
+    // previous frame's samples must land before we blend into them
+    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vulkanhelpers::ImageBarrier(commandBuffer,
+                                mAccumImage.GetImage(),
+                                subresourceRange,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                mAccumDiscard ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL,
+                                VK_IMAGE_LAYOUT_GENERAL);
+    mAccumDiscard = false;
+
+    const SBTHelper& sbt = variant->second.sbt;
+
     vkCmdBindPipeline(commandBuffer,
                       VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
-                      mRTPipeline);
+                      variant->second.pipeline);
+    vkCmdSetRayTracingPipelineStackSizeKHR(commandBuffer, variant->second.stackSize);
+
+    // each frame in flight uses its own slices of the uniform, ray stats and feedback buffers, in set and binding order
+    const uint32_t dynamicOffsets[3] = {
+        static_cast<uint32_t>(frameIndex * mCameraSliceSize),
+        static_cast<uint32_t>(frameIndex * mRayStatsSliceSize),
+        mVirtualTextures.GetFeedbackOffset(static_cast<uint32_t>(frameIndex))
+    };
 
     vkCmdBindDescriptorSets(commandBuffer,
                             VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
                             mRTPipelineLayout, 0,
                             static_cast<uint32_t>(mRTDescriptorSets.size()), mRTDescriptorSets.data(),
-                            0, 0);
+                            3, dynamicOffsets);
 
     VkStridedDeviceAddressRegionKHR raygenRegion = {
-        mSBT.GetSBTAddress() + mSBT.GetRaygenOffset(),
-        mSBT.GetGroupsStride(),
-        mSBT.GetRaygenSize()
+        sbt.GetSBTAddress() + sbt.GetRaygenOffset(),
+        sbt.GetGroupsStride(),
+        sbt.GetRaygenSize()
     };
 
     VkStridedDeviceAddressRegionKHR missRegion = {
-        mSBT.GetSBTAddress() + mSBT.GetMissGroupsOffset(),
-        mSBT.GetGroupsStride(),
-        mSBT.GetMissGroupsSize()
+        sbt.GetSBTAddress() + sbt.GetMissGroupsOffset(),
+        sbt.GetGroupsStride(),
+        sbt.GetMissGroupsSize()
     };
 
     VkStridedDeviceAddressRegionKHR hitRegion = {
-        mSBT.GetSBTAddress() + mSBT.GetHitGroupsOffset(),
-        mSBT.GetGroupsStride(),
-        mSBT.GetHitGroupsSize()
+        sbt.GetSBTAddress() + sbt.GetHitGroupsOffset(),
+        sbt.GetGroupsStride(),
+        sbt.GetHitGroupsSize()
     };
 
     VkStridedDeviceAddressRegionKHR callableRegion = {};
 
-    vkCmdTraceRaysKHR(commandBuffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, mSettings.resolutionX, mSettings.resolutionY, 1u);
+    for (const TileScheduler::Tile& tile : mFrameTiles) {
+        TraceTileParams tileParams;
+        tileParams.tileOffsetAndRenderSize = uvec4(tile.x, tile.y, mRenderExtent.width, mRenderExtent.height);
+
+        vkCmdPushConstants(commandBuffer, mRTPipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(TraceTileParams), &tileParams);
+        vkCmdTraceRaysKHR(commandBuffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, tile.width, tile.height, 1u);
+    }
+
+    mGPUProfiler.EndScope(commandBuffer, traceScope);
+
+    // counters get read on the CPU once this frame's fence signals
+    if (mSettings.rayStats) {
+        VkMemoryBarrier memoryBarrier = {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                             VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    mVirtualTextures.RecordFeedbackBarrier(commandBuffer);
 }
 
 void RtxApp::OnMouseMove(const float x, const float y) {
     vec2 newPos(x, y);
     vec2 delta = mCursorPos - newPos;
 
-    if (mLMBDown) {
+    if (mLMBDown && (delta.x != 0.0f || delta.y != 0.0f)) {
         mCamera.Rotate(delta.x * sRotateSpeed, delta.y * sRotateSpeed);
+        mAccumReset = true;
     }
 
     mCursorPos = newPos;
@@ -153,6 +316,12 @@ void RtxApp::OnKey(const int key, const int scancode, const int action, const in
             case GLFW_KEY_S: mSKeyDown = true; break;
             case GLFW_KEY_D: mDKeyDown = true; break;
 
+            case GLFW_KEY_L: mEnvLighting = !mEnvLighting; mAccumReset = true; break;
+
+            case GLFW_KEY_H: mCostHeatmap = !mCostHeatmap; mAccumReset = true; break;
+            case GLFW_KEY_LEFT_BRACKET: mHeatmapScale *= 0.5f; mAccumReset = mCostHeatmap; break;
+            case GLFW_KEY_RIGHT_BRACKET: mHeatmapScale *= 2.0f; mAccumReset = mCostHeatmap; break;
+
             case GLFW_KEY_LEFT_SHIFT:
             case GLFW_KEY_RIGHT_SHIFT:
                 mShiftDown = true;
@@ -173,26 +342,126 @@ void RtxApp::OnKey(const int key, const int scancode, const int action, const in
     }
 }
 
-void RtxApp::Update(const size_t, const float dt) {
-    // Update FPS text
-    String frameStats = ToString(mFPSMeter.GetFPS(), 1) + " FPS (" + ToString(mFPSMeter.GetFrameTime(), 1) + " ms)";
-    String fullTitle = mSettings.name + "  " + frameStats;
-    glfwSetWindowTitle(mWindow, fullTitle.c_str());
+void RtxApp::Update(const size_t frameIndex, const float dt) {
+    // Update FPS text, a few times a second is plenty and it goes through the window system
+    mTitleUpdateTime += dt;
+    if (mWindow && mTitleUpdateTime >= sTitleUpdateInterval) {
+        mTitleUpdateTime = 0.0f;
+
+        char title[256];
+        int length = std::snprintf(title, sizeof(title), "%s  %.1f FPS (%.1f ms, p99 %.1f ms, %u hitches), GPU trace %.2f ms",
+                                   mSettings.name.c_str(),
+                                   mFPSMeter.GetFPS(), mFPSMeter.GetFrameTime(), mFPSMeter.GetPercentile(99.0f), mFPSMeter.GetNumHitches(),
+                                   mGPUProfiler.GetAvgMs(sTraceScopeName));
+        if (mSettings.rayStats && length > 0 && static_cast<size_t>(length) < sizeof(title)) {
+            length += std::snprintf(title + length, sizeof(title) - length, ", %.0f Mrays/s", mMraysPerSecond);
+        }
+        if (mCostHeatmap && length > 0 && static_cast<size_t>(length) < sizeof(title)) {
+            std::snprintf(title + length, sizeof(title) - length, ", heatmap up to %.0f %s", mHeatmapScale, mSettings.supportShaderClock ? "ticks" : "traces");
+        }
+        glfwSetWindowTitle(mWindow, title);
+    }
     /////////////////
 
 
-    UniformParams* params = reinterpret_cast<UniformParams*>(mCameraBuffer.Map());
+    // the heatmap and the normal view are different variants, a combination not seen before gets built here
+    mPipelineKey = this->GetPipelineKey(mCostHeatmap);
+    if (mPipelines.find(mPipelineKey) == mPipelines.end() && !this->CreateRaytracingPipelines({ mPipelineKey })) {
+        std::printf("Failed to create the raytracing pipeline variant %x\n", mPipelineKey);
+    }
+
+    if (mShaderCompiler.IsEnabled()) {
+        mShaderWatchTime += dt;
+        if (mShaderWatchTime >= sShaderWatchInterval) {
+            mShaderWatchTime = 0.0f;
+            if (mShaderCompiler.CheckForChanges()) {
+                this->ReloadShaders();
+            }
+        }
+    }
+
+    // stamps start at 1, zero in the feedback means "never requested"
+    ++mFrameStamp;
+    // sharper pages make the old samples stale
+    if (mVirtualTextures.Update(static_cast<uint32_t>(frameIndex), mFrameStamp)) {
+        mAccumReset = true;
+    }
+    mBindless.Flush(mFrameStamp);
+
+    // the profiler has collected this frame slot's timings after its fence wait
+    this->ReadRayStats(frameIndex);
+
+    if (mSettings.dynamicResolution && mDynamicResolution.Update(mGPUProfiler.GetLastMs(sTraceScopeName))) {
+        mRenderExtent = { mDynamicResolution.GetWidth(), mDynamicResolution.GetHeight() };
+        mTileScheduler.Initialize(mRenderExtent.width, mRenderExtent.height, mSettings.traceTileSize, TileScheduler::Order::CenterFirst);
+        mAccumReset = true;
+    }
+
+    UniformParams* params = reinterpret_cast<UniformParams*>(mCameraBuffer.Map(sizeof(UniformParams), frameIndex * mCameraSliceSize));
 
     params->sunPosAndAmbient = vec4(sSunPos, sAmbientLight);
+    params->envLightParams = vec4(mEnvLighting ? 1.0f : 0.0f, sEnvLightIntensity, 0.0f, 0.0f);
+    params->debugParams = vec4(mCostHeatmap ? 1.0f : 0.0f, mHeatmapScale, 0.0f, 0.0f);
+    params->vtParams = vec4(static_cast<float>(mFrameStamp), Deg2Rad(mCamera.GetFovY()) / static_cast<float>(mRenderExtent.height), 0.0f, 0.0f);
 
     this->UpdateCameraParams(params, dt);
 
+    // a sample is done once every tile of the pass has been traced
+    if (mAccumReset) {
+        mAccumFrame = 0;
+        mAccumReset = false;
+        mAccumDiscard = true;
+        mTileScheduler.Restart();
+    } else if (mTileScheduler.IsPassComplete() && mAccumFrame < sAccumTargetSamples) {
+        ++mAccumFrame;
+        mTileScheduler.Restart();
+    }
+    params->accumParams = vec4(static_cast<float>(mAccumFrame), 0.0f, 0.0f, 0.0f);
+
+    mFrameTiles.clear();
+    if (mAccumFrame < sAccumTargetSamples) {
+        mTileScheduler.NextTiles(mSettings.traceTilesPerFrame, mFrameTiles);
+    }
+
+    // one primary ray per traced pixel, the instrumented shaders give the exact numbers later
+    if (!mSettings.rayStats) {
+        uint64_t numRays = 0;
+        for (const TileScheduler::Tile& tile : mFrameTiles) {
+            numRays += static_cast<uint64_t>(tile.width) * tile.height;
+        }
+        mBenchmark.AddRays(mFrameNumber, numRays);
+    }
+
     mCameraBuffer.Unmap();
 }
 
 
 
-void RtxApp::LoadSceneGeometry() {
+// MTL illumination models: 3 and 5 reflect, 4, 6, 7 and 9 refract, the rest is diffuse
+static uint32_t GetMaterialType(const tinyobj::material_t& material) {
+    switch (material.illum) {
+        case 3:
+        case 5:
+            return SWS_MATERIAL_MIRROR;
+        case 4:
+        case 6:
+        case 7:
+        case 9:
+            return SWS_MATERIAL_DIELECTRIC;
+        default:
+            return SWS_MATERIAL_LAMBERT;
+    }
+}
+
+// faces without a material (-1) or with a broken id get the default one, appended after the MTL's
+static uint32_t GetFaceMaterial(const tinyobj::shape_t& shape, const size_t face, const uint32_t defaultMaterial) {
+    const int id = shape.mesh.material_ids[face];
+    return (id >= 0 && static_cast<uint32_t>(id) < defaultMaterial) ? static_cast<uint32_t>(id) : defaultMaterial;
+}
+
+bool RtxApp::LoadSceneGeometry() {
+    startup::ScopedPhase phase("Load scene geometry");
+
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -207,18 +476,47 @@ void RtxApp::LoadSceneGeometry() {
 
     const bool result = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, fileName.c_str(), baseDir.c_str(), true);
     if (result) {
-        mScene.meshes.resize(shapes.size());
-        mScene.materials.resize(materials.size());
+        // plain white lambert, for the faces the MTL doesn't cover
+        const uint32_t defaultMaterial = static_cast<uint32_t>(materials.size());
+        auto getMaterialType = [&materials](const uint32_t material) {
+            return (material < materials.size()) ? GetMaterialType(materials[material]) : static_cast<uint32_t>(SWS_MATERIAL_LAMBERT);
+        };
+
+        // the hit group is picked per instance, so a shape mixing material types becomes one mesh per type
+        struct ShapePart {
+            size_t          shape;
+            Array<uint32_t> faces;
+        };
+        Array<ShapePart> parts;
+        for (size_t shapeIdx = 0; shapeIdx < shapes.size(); ++shapeIdx) {
+            const tinyobj::shape_t& shape = shapes[shapeIdx];
+
+            Array<uint32_t> facesByType[SWS_NUM_MATERIAL_TYPES];
+            for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); ++f) {
+                facesByType[getMaterialType(GetFaceMaterial(shape, f, defaultMaterial))].push_back(static_cast<uint32_t>(f));
+            }
+            for (Array<uint32_t>& faces : facesByType) {
+                if (!faces.empty()) {
+                    parts.push_back({ shapeIdx, std::move(faces) });
+                }
+            }
+        }
 
-        for (size_t meshIdx = 0; meshIdx < shapes.size(); ++meshIdx) {
+        mScene.meshes.resize(parts.size());
+        mScene.materials.resize(materials.size() + 1);
+
+        for (size_t meshIdx = 0; meshIdx < parts.size(); ++meshIdx) {
             RTMesh& mesh = mScene.meshes[meshIdx];
-            const tinyobj::shape_t& shape = shapes[meshIdx];
+            const tinyobj::shape_t& shape = shapes[parts[meshIdx].shape];
+            const Array<uint32_t>& shapeFaces = parts[meshIdx].faces;
 
-            const size_t numFaces = shape.mesh.num_face_vertices.size();
+            const size_t numFaces = shapeFaces.size();
             const size_t numVertices = numFaces * 3;
 
             mesh.numVertices = static_cast<uint32_t>(numVertices);
             mesh.numFaces = static_cast<uint32_t>(numFaces);
+            // all the triangles share the type, the first one's material shades the instance
+            mesh.material = GetFaceMaterial(shape, shapeFaces[0], defaultMaterial);
 
             const size_t positionsBufferSize = numVertices * sizeof(vec3);
             const size_t indicesBufferSize = numFaces * 3 * sizeof(uint32_t);
@@ -247,38 +545,7 @@ void RtxApp::LoadSceneGeometry() {
             uint32_t* faces = reinterpret_cast<uint32_t*>(mesh.faces.Map());
             uint32_t* matIDs = reinterpret_cast<uint32_t*>(mesh.matIDs.Map());
 
-            size_t vIdx = 0;
-            for (size_t f = 0; f < numFaces; ++f) {
-                assert(shape.mesh.num_face_vertices[f] == 3);
-                for (size_t j = 0; j < 3; ++j, ++vIdx) {
-                    const tinyobj::index_t& i = shape.mesh.indices[vIdx];
-
-                    vec3& pos = positions[vIdx];
-                    vec4& normal = attribs[vIdx].normal;
-                    vec4& uv = attribs[vIdx].uv;
-
-                    pos.x = attrib.vertices[3 * i.vertex_index + 0];
-                    pos.y = attrib.vertices[3 * i.vertex_index + 1];
-                    pos.z = attrib.vertices[3 * i.vertex_index + 2];
-                    normal.x = attrib.normals[3 * i.normal_index + 0];
-                    normal.y = attrib.normals[3 * i.normal_index + 1];
-                    normal.z = attrib.normals[3 * i.normal_index + 2];
-                    uv.x = attrib.texcoords[2 * i.texcoord_index + 0];
-                    uv.y = attrib.texcoords[2 * i.texcoord_index + 1];
-                }
-
-                const uint32_t a = static_cast<uint32_t>(3 * f + 0);
-                const uint32_t b = static_cast<uint32_t>(3 * f + 1);
-                const uint32_t c = static_cast<uint32_t>(3 * f + 2);
-                indices[a] = a;
-                indices[b] = b;
-                indices[c] = c;
-                faces[4 * f + 0] = a;
-                faces[4 * f + 1] = b;
-                faces[4 * f + 2] = c;
-
-                matIDs[f] = static_cast<uint32_t>(shape.mesh.material_ids[f]);
-            }
+            ConvertOBJShape(attrib, shape, shapeFaces, defaultMaterial, positions, attribs, indices, faces, matIDs);
 
             mesh.matIDs.Unmap();
             mesh.indices.Unmap();
@@ -287,67 +554,182 @@ void RtxApp::LoadSceneGeometry() {
             mesh.positions.Unmap();
         }
 
-        VkImageSubresourceRange subresourceRange = {};
-        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        subresourceRange.baseMipLevel = 0;
-        subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-        subresourceRange.baseArrayLayer = 0;
-        subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-
-        for (size_t i = 0; i < materials.size(); ++i) {
-            const tinyobj::material_t& srcMat = materials[i];
-            RTMaterial& dstMat = mScene.materials[i];
-
-            String fullTexturePath = baseDir + "/" + srcMat.diffuse_texname;
-            if (dstMat.texture.Load(fullTexturePath.c_str())) {
-                dstMat.texture.CreateImageView(VK_IMAGE_VIEW_TYPE_2D, dstMat.texture.GetFormat(), subresourceRange);
-                dstMat.texture.CreateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+        // decode all the textures in parallel, they get streamed to the GPU on demand
+        Array<vulkanhelpers::ImageData> texturesData(mScene.materials.size());
+        mThreadPool.ParallelFor(mScene.materials.size(), [&](const size_t i) {
+            vulkanhelpers::ImageData& data = texturesData[i];
+            if (i == defaultMaterial || materials[i].diffuse_texname.empty() || !data.Decode((baseDir + "/" + materials[i].diffuse_texname).c_str())) {
+                // plain white for the untextured ones
+                data.width = 1;
+                data.height = 1;
+                data.mipLevels = 1;
+                data.format = VK_FORMAT_R8G8B8A8_SRGB;
+                data.pixels.assign(4, 0xFF);
             }
+        });
+
+        // the feedback slices are bound with dynamic offsets and invalidated one at a time
+        const VkDeviceSize feedbackAlignment = Max(mPhysicalDeviceProps.limits.minStorageBufferOffsetAlignment, mPhysicalDeviceProps.limits.nonCoherentAtomSize);
+        if (!mVirtualTextures.Initialize(mDevice, mCommandPool, mGraphicsQueue, sVTPoolSizeInPages, mSettings.framesInFlight, feedbackAlignment)) {
+            std::printf("Failed to create the virtual texture pool\n");
+            return false;
+        }
+        for (size_t i = 0; i < mScene.materials.size(); ++i) {
+            RTMaterial& material = mScene.materials[i];
+            material.virtualTexture = mVirtualTextures.AddTexture(std::move(texturesData[i]));
+            material.type = getMaterialType(static_cast<uint32_t>(i));
+            material.ior = (i < materials.size()) ? Max(materials[i].ior, 1.0f) : 1.0f;
+        }
+        // every texture pins a page, the pool must have room for all of them
+        if (!mVirtualTextures.Finalize(&mThreadPool)) {
+            std::printf("Failed to set up the virtual textures of %zu materials\n", mScene.materials.size());
+            return false;
         }
-    }
 
-    // prepare shader resources infos
-    const size_t numMeshes = mScene.meshes.size();
-    const size_t numMaterials = mScene.materials.size();
+        VkResult error = mScene.materialsBuffer.Create(Max(mScene.materials.size(), static_cast<size_t>(1)) * sizeof(MaterialParams), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        CHECK_VK_ERROR(error, "mScene.materialsBuffer.Create");
 
-    mScene.matIDsBufferInfos.resize(numMeshes);
-    mScene.attribsBufferInfos.resize(numMeshes);
-    mScene.facesBufferInfos.resize(numMeshes);
-    for (size_t i = 0; i < numMeshes; ++i) {
-        const RTMesh& mesh = mScene.meshes[i];
-        VkDescriptorBufferInfo& matIDsInfo = mScene.matIDsBufferInfos[i];
-        VkDescriptorBufferInfo& attribsInfo = mScene.attribsBufferInfos[i];
-        VkDescriptorBufferInfo& facesInfo = mScene.facesBufferInfos[i];
+        MaterialParams* materialParams = reinterpret_cast<MaterialParams*>(mScene.materialsBuffer.Map());
+        for (size_t i = 0; i < mScene.materials.size(); ++i) {
+            const RTMaterial& material = mScene.materials[i];
+            materialParams[i].info = uvec4(material.type, material.virtualTexture, 0u, 0u);
+            materialParams[i].params = vec4(material.ior, 0.0f, 0.0f, 0.0f);
+        }
+        mScene.materialsBuffer.Unmap();
 
-        matIDsInfo.buffer = mesh.matIDs.GetBuffer();
-        matIDsInfo.offset = 0;
-        matIDsInfo.range = mesh.matIDs.GetSize();
+        // register the shader resources, shaders find them through the per-mesh slots
+        error = mScene.meshesBuffer.Create(Max(mScene.meshes.size(), static_cast<size_t>(1)) * sizeof(uint32_t[4]), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        CHECK_VK_ERROR(error, "mScene.meshesBuffer.Create");
 
-        attribsInfo.buffer = mesh.attribs.GetBuffer();
-        attribsInfo.offset = 0;
-        attribsInfo.range = mesh.attribs.GetSize();
+        uint32_t* meshSlots = reinterpret_cast<uint32_t*>(mScene.meshesBuffer.Map());
+        for (size_t i = 0; i < mScene.meshes.size(); ++i) {
+            RTMesh& mesh = mScene.meshes[i];
 
-        facesInfo.buffer = mesh.faces.GetBuffer();
-        facesInfo.offset = 0;
-        facesInfo.range = mesh.faces.GetSize();
+            mesh.matIDsSlot = mBindless.RegisterBuffer({ mesh.matIDs.GetBuffer(), 0, mesh.matIDs.GetSize() });
+            mesh.attribsSlot = mBindless.RegisterBuffer({ mesh.attribs.GetBuffer(), 0, mesh.attribs.GetSize() });
+            mesh.facesSlot = mBindless.RegisterBuffer({ mesh.faces.GetBuffer(), 0, mesh.faces.GetSize() });
+
+            meshSlots[4 * i + 0] = mesh.matIDsSlot;
+            meshSlots[4 * i + 1] = mesh.attribsSlot;
+            meshSlots[4 * i + 2] = mesh.facesSlot;
+            meshSlots[4 * i + 3] = mesh.material;
+        }
+        mScene.meshesBuffer.Unmap();
+    } else {
+        std::printf("Failed to load the scene %s: %s\n", fileName.c_str(), error.c_str());
     }
 
-    mScene.texturesInfos.resize(numMaterials);
-    for (size_t i = 0; i < numMaterials; ++i) {
-        const RTMaterial& mat = mScene.materials[i];
-        VkDescriptorImageInfo& textureInfo = mScene.texturesInfos[i];
+    return result;
+}
+
+void ConvertOBJShape(const tinyobj::attrib_t& attrib,
+                     const tinyobj::shape_t& shape,
+                     const Array<uint32_t>& shapeFaces,
+                     const uint32_t defaultMaterial,
+                     vec3* positions,
+                     VertexAttribute* attribs,
+                     uint32_t* indices,
+                     uint32_t* faces,
+                     uint32_t* matIDs) {
+    const size_t numFaces = shapeFaces.size();
+
+    size_t vIdx = 0;
+    for (size_t f = 0; f < numFaces; ++f) {
+        // triangulated on load, so the face's vertices are at 3 * face
+        const size_t srcFace = shapeFaces[f];
+        assert(shape.mesh.num_face_vertices[srcFace] == 3);
+        for (size_t j = 0; j < 3; ++j, ++vIdx) {
+            const tinyobj::index_t& i = shape.mesh.indices[3 * srcFace + j];
+
+            vec3& pos = positions[vIdx];
+            vec4& normal = attribs[vIdx].normal;
+            vec4& uv = attribs[vIdx].uv;
+
+            pos.x = attrib.vertices[3 * i.vertex_index + 0];
+            pos.y = attrib.vertices[3 * i.vertex_index + 1];
+            pos.z = attrib.vertices[3 * i.vertex_index + 2];
+            normal.x = attrib.normals[3 * i.normal_index + 0];
+            normal.y = attrib.normals[3 * i.normal_index + 1];
+            normal.z = attrib.normals[3 * i.normal_index + 2];
+            uv.x = attrib.texcoords[2 * i.texcoord_index + 0];
+            uv.y = attrib.texcoords[2 * i.texcoord_index + 1];
+        }
 
-        textureInfo.sampler = mat.texture.GetSampler();
-        textureInfo.imageView = mat.texture.GetImageView();
-        textureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        const uint32_t a = static_cast<uint32_t>(3 * f + 0);
+        const uint32_t b = static_cast<uint32_t>(3 * f + 1);
+        const uint32_t c = static_cast<uint32_t>(3 * f + 2);
+        indices[a] = a;
+        indices[b] = b;
+        indices[c] = c;
+        faces[4 * f + 0] = a;
+        faces[4 * f + 1] = b;
+        faces[4 * f + 2] = c;
+
+        // texel density of the triangle for the mip selection, 0.5 * log2(uv area / world area)
+        const vec3 e0 = positions[b] - positions[a];
+        const vec3 e1 = positions[c] - positions[a];
+        const vec2 t0 = vec2(attribs[b].uv) - vec2(attribs[a].uv);
+        const vec2 t1 = vec2(attribs[c].uv) - vec2(attribs[a].uv);
+        const float worldArea = glm::length(glm::cross(e0, e1));
+        const float uvArea = std::abs(t0.x * t1.y - t0.y * t1.x);
+        const float lodConstant = (worldArea > 0.0f && uvArea > 0.0f) ? 0.5f * std::log2(uvArea / worldArea) : 0.0f;
+        std::memcpy(&faces[4 * f + 3], &lodConstant, sizeof(float));
+
+        matIDs[f] = GetFaceMaterial(shape, srcFace, defaultMaterial);
     }
 }
 
 void RtxApp::CreateScene() {
-    mScene.BuildBLAS(mDevice, mCommandPool, mGraphicsQueue);
-    mScene.BuildTLAS(mDevice, mCommandPool, mGraphicsQueue);
+    startup::ScopedPhase phase("Create scene");
 
-    mEnvTexture.Load((sEnvsFolder + "studio_garden_2k.jpg").c_str());
+    {
+        startup::ScopedPhase buildPhase("Build BLAS");
+        mScene.BuildBLAS(mDevice, mCommandPool, mGraphicsQueue, mGPUProfiler);
+    }
+    {
+        startup::ScopedPhase buildPhase("Build TLAS");
+        mScene.BuildTLAS(mDevice, mCommandPool, mGraphicsQueue, mGPUProfiler);
+    }
+
+    startup::ScopedPhase envPhase("Load environment map");
+
+    // we need the pixels on the CPU side as well to build the importance sampling tables
+    vulkanhelpers::ImageData envData;
+    EnvMapDistribution envDistribution = {};
+#if SWS_ENV_MAPPING == SWS_ENV_MAPPING_OCTAHEDRAL
+    // keep full precision for the resampling, the octahedral map is compressed afterwards
+    const HDRFormat decodeFormat = HDRFormat::Float32;
+#else
+    const HDRFormat decodeFormat = sEnvHDRFormat;
+#endif
+    if (envData.Decode((sEnvsFolder + "studio_garden_2k.jpg").c_str(), decodeFormat)) {
+        envDistribution.Build(envData, &mThreadPool);
+
+#if SWS_ENV_MAPPING == SWS_ENV_MAPPING_OCTAHEDRAL
+        // same texel count as a (width / 2) square, which covers the sphere far more evenly than lat-long
+        uint32_t octSize = 1;
+        while (octSize < envData.width / 2) {
+            octSize <<= 1;
+        }
+
+        vulkanhelpers::ImageData octData;
+        if (ConvertLatLongToOctahedral(envData, octSize, sEnvHDRFormat, octData, &mThreadPool)) {
+            envData = std::move(octData);
+        }
+#endif
+
+        vulkanhelpers::ImageLoader imageLoader;
+        imageLoader.Add(&mEnvTexture, std::move(envData));
+        imageLoader.LoadAll(nullptr);
+    }
+
+    // shaders always expect the header, even for the empty tables
+    VkResult error = mEnvCdfBuffer.Create(envDistribution.GetGPUDataSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    CHECK_VK_ERROR(error, "mEnvCdfBuffer.Create");
+
+    void* cdfMem = mEnvCdfBuffer.Map();
+    envDistribution.WriteGPUData(cdfMem);
+    mEnvCdfBuffer.Unmap();
 
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -357,7 +739,11 @@ void RtxApp::CreateScene() {
     subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
 
     mEnvTexture.CreateImageView(VK_IMAGE_VIEW_TYPE_2D, mEnvTexture.GetFormat(), subresourceRange);
+#if SWS_ENV_MAPPING == SWS_ENV_MAPPING_OCTAHEDRAL
+    mEnvTexture.CreateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+#else
     mEnvTexture.CreateSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+#endif
 
     mEnvTextureDescInfo.sampler = mEnvTexture.GetSampler();
     mEnvTextureDescInfo.imageView = mEnvTexture.GetImageView();
@@ -365,32 +751,113 @@ void RtxApp::CreateScene() {
 }
 
 void RtxApp::CreateCamera() {
-    VkResult error = mCameraBuffer.Create(sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    startup::ScopedPhase phase("Create camera");
+
+    // one slice per frame in flight, so we never write what the GPU is still reading
+    const VkDeviceSize alignment = Max<VkDeviceSize>(mPhysicalDeviceProps.limits.minUniformBufferOffsetAlignment, 1);
+    mCameraSliceSize = ((sizeof(UniformParams) + alignment - 1) / alignment) * alignment;
+
+    VkResult error = mCameraBuffer.Create(mCameraSliceSize * mSettings.framesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     CHECK_VK_ERROR(error, "mCameraBuffer.Create");
 
-    mCamera.SetViewport({ 0, 0, static_cast<int>(mSettings.resolutionX), static_cast<int>(mSettings.resolutionY) });
+    mCamera.SetViewport({ 0, 0, static_cast<int>(mSettings.renderResolutionX), static_cast<int>(mSettings.renderResolutionY) });
     mCamera.SetViewPlanes(0.1f, 100.0f);
     mCamera.SetFovY(45.0f);
     mCamera.LookAt(vec3(0.25f, 3.20f, 6.15f), vec3(0.25f, 2.75f, 5.25f));
 }
 
-void RtxApp::UpdateCameraParams(UniformParams* params, const float dt) {
-    vec2 moveDelta(0.0f, 0.0f);
-    if (mWKeyDown) {
-        moveDelta.y += 1.0f;
+void RtxApp::CreateAccumulationImage() {
+    // running average of all the samples so far, kept in linear space
+    const VkExtent3D extent = { mSettings.renderResolutionX, mSettings.renderResolutionY, 1 };
+    VkResult error = mAccumImage.Create(VK_IMAGE_TYPE_2D,
+                                        VK_FORMAT_R32G32B32A32_SFLOAT,
+                                        extent,
+                                        VK_IMAGE_TILING_OPTIMAL,
+                                        VK_IMAGE_USAGE_STORAGE_BIT,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    CHECK_VK_ERROR(error, "mAccumImage.Create");
+
+    VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    error = mAccumImage.CreateImageView(VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, range);
+    CHECK_VK_ERROR(error, "mAccumImage.CreateImageView");
+}
+
+void RtxApp::CreateRayStats() {
+    // always there so the descriptors stay the same, only the instrumented shaders write it
+    const VkDeviceSize alignment = Max<VkDeviceSize>(mPhysicalDeviceProps.limits.minStorageBufferOffsetAlignment, 1);
+    mRayStatsSliceSize = ((sizeof(uint32_t) * SWS_RAY_STATS_NUM_COUNTERS + alignment - 1) / alignment) * alignment;
+
+    VkResult error = mRayStatsBuffer.Create(mRayStatsSliceSize * mSettings.framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    CHECK_VK_ERROR(error, "mRayStatsBuffer.Create");
+
+    void* mem = mRayStatsBuffer.Map();
+    if (mem) {
+        std::memset(mem, 0, mRayStatsBuffer.GetSize());
+        mRayStatsBuffer.Unmap();
     }
-    if (mSKeyDown) {
-        moveDelta.y -= 1.0f;
+}
+
+void RtxApp::ReadRayStats(const size_t frameIndex) {
+    // this slot was last traced framesInFlight frames ago
+    if (!mSettings.rayStats || mFrameNumber < mSettings.framesInFlight) {
+        return;
     }
-    if (mAKeyDown) {
-        moveDelta.x -= 1.0f;
+
+    uint32_t* counters = reinterpret_cast<uint32_t*>(mRayStatsBuffer.Map(mRayStatsSliceSize, frameIndex * mRayStatsSliceSize));
+    if (!counters) {
+        return;
     }
-    if (mDKeyDown) {
-        moveDelta.x += 1.0f;
+
+    const uint32_t tracedFrame = mFrameNumber - mSettings.framesInFlight;
+    const uint64_t numRays = static_cast<uint64_t>(counters[SWS_RAY_STATS_PRIMARY]) + counters[SWS_RAY_STATS_SECONDARY] + counters[SWS_RAY_STATS_SHADOW];
+
+    if (mBenchmark.IsMeasuredFrame(tracedFrame)) {
+        mBenchmark.AddRays(tracedFrame, numRays);
+        for (uint32_t i = 0; i < SWS_RAY_STATS_DEPTHS; ++i) {
+            if (sRayStatsCounterNames[i]) {
+                mBenchmark.AddCounter(tracedFrame, sRayStatsCounterNames[i], counters[i]);
+            }
+        }
+        for (uint32_t i = 0; i < SWS_MAX_RECURSION; ++i) {
+            mBenchmark.AddCounter(tracedFrame, "pathDepth" + std::to_string(i + 1), counters[SWS_RAY_STATS_DEPTHS + i]);
+        }
     }
 
-    moveDelta *= sMoveSpeed * dt * (mShiftDown ? sAccelMult : 1.0f);
-    mCamera.Move(moveDelta.x, moveDelta.y);
+    std::memset(counters, 0, sizeof(uint32_t) * SWS_RAY_STATS_NUM_COUNTERS);
+    mRayStatsBuffer.Unmap();
+
+    // the trace time of the very same frame was collected along with the fence wait
+    const float traceMs = mGPUProfiler.GetLastMs(sTraceScopeName);
+    if (numRays && traceMs > 0.0f) {
+        const float mraysPerSecond = static_cast<float>(static_cast<double>(numRays) / (static_cast<double>(traceMs) * 1000.0));
+        mMraysPerSecond = (mMraysPerSecond > 0.0f) ? Lerp(mMraysPerSecond, mraysPerSecond, sRaysPerSecondSmoothing) : mraysPerSecond;
+    }
+}
+
+void RtxApp::UpdateCameraParams(UniformParams* params, const float dt) {
+    if (mBenchmark.IsActive()) {
+        this->UpdateBenchmarkCamera();
+    } else {
+        vec2 moveDelta(0.0f, 0.0f);
+        if (mWKeyDown) {
+            moveDelta.y += 1.0f;
+        }
+        if (mSKeyDown) {
+            moveDelta.y -= 1.0f;
+        }
+        if (mAKeyDown) {
+            moveDelta.x -= 1.0f;
+        }
+        if (mDKeyDown) {
+            moveDelta.x += 1.0f;
+        }
+
+        if (moveDelta.x != 0.0f || moveDelta.y != 0.0f) {
+            moveDelta *= sMoveSpeed * dt * (mShiftDown ? sAccelMult : 1.0f);
+            mCamera.Move(moveDelta.x, moveDelta.y);
+            mAccumReset = true;
+        }
+    }
 
     params->camPos = vec4(mCamera.GetPosition(), 0.0f);
     params->camDir = vec4(mCamera.GetDirection(), 0.0f);
@@ -399,9 +866,24 @@ void RtxApp::UpdateCameraParams(UniformParams* params, const float dt) {
     params->camNearFarFov = vec4(mCamera.GetNearPlane(), mCamera.GetFarPlane(), Deg2Rad(mCamera.GetFovY()), 0.0f);
 }
 
+void RtxApp::UpdateBenchmarkCamera() {
+    // driven by the frame number, not the clock, so every run renders the exact same views
+    // warm-up frames sit at the start of the path
+    const uint32_t warmupFrames = mSettings.benchmarkWarmupFrames;
+    const uint32_t measuredFrame = (mFrameNumber > warmupFrames) ? (mFrameNumber - warmupFrames) : 0;
+    const float progress = (mSettings.benchmarkFrames > 1) ? static_cast<float>(measuredFrame) / static_cast<float>(mSettings.benchmarkFrames - 1) : 0.0f;
+
+    vec3 position = mCamera.GetPosition();
+    vec3 target = position + mCamera.GetDirection();
+    mCameraPath.Sample(Min(progress, 1.0f) * mCameraPath.GetDuration(), position, target);
+    mCamera.LookAt(position, target);
+
+    // every frame traces a fresh first sample of the whole image, so the workload doesn't depend on convergence
+    mAccumReset = true;
+}
+
 void RtxApp::CreateDescriptorSetsLayouts() {
-    const uint32_t numMeshes = static_cast<uint32_t>(mScene.meshes.size());
-    const uint32_t numMaterials = static_cast<uint32_t>(mScene.materials.size());
+    startup::ScopedPhase phase("Create descriptor set layouts");
 
     mRTDescriptorSetsLayouts.resize(SWS_NUM_SETS);
 
@@ -409,6 +891,10 @@ void RtxApp::CreateDescriptorSetsLayouts() {
     //  binding 0  ->  AS
     //  binding 1  ->  output image
     //  binding 2  ->  Camera data
+    //  binding 3  ->  per-mesh bindless slots
+    //  binding 4  ->  accumulation image
+    //  binding 5  ->  ray statistics counters
+    //  binding 6  ->  materials
 
     VkDescriptorSetLayoutBinding accelerationStructureLayoutBinding;
     accelerationStructureLayoutBinding.binding = SWS_SCENE_AS_BINDING;
@@ -426,15 +912,39 @@ void RtxApp::CreateDescriptorSetsLayouts() {
 
     VkDescriptorSetLayoutBinding camdataBufferBinding;
     camdataBufferBinding.binding = SWS_CAMDATA_BINDING;
-    camdataBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    camdataBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     camdataBufferBinding.descriptorCount = 1;
-    camdataBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    camdataBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
     camdataBufferBinding.pImmutableSamplers = nullptr;
 
+    VkDescriptorSetLayoutBinding meshesBufferBinding;
+    meshesBufferBinding.binding = SWS_MESHES_BINDING;
+    meshesBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    meshesBufferBinding.descriptorCount = 1;
+    meshesBufferBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    meshesBufferBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding accumImageLayoutBinding = resultImageLayoutBinding;
+    accumImageLayoutBinding.binding = SWS_ACCUM_IMAGE_BINDING;
+
+    VkDescriptorSetLayoutBinding rayStatsBufferBinding;
+    rayStatsBufferBinding.binding = SWS_RAY_STATS_BINDING;
+    rayStatsBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    rayStatsBufferBinding.descriptorCount = 1;
+    rayStatsBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    rayStatsBufferBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding materialsBufferBinding = meshesBufferBinding;
+    materialsBufferBinding.binding = SWS_MATERIALS_BINDING;
+
     std::vector<VkDescriptorSetLayoutBinding> bindings({
         accelerationStructureLayoutBinding,
         resultImageLayoutBinding,
-        camdataBufferBinding
+        camdataBufferBinding,
+        meshesBufferBinding,
+        accumImageLayoutBinding,
+        rayStatsBufferBinding,
+        materialsBufferBinding
     });
 
     VkDescriptorSetLayoutCreateInfo set0LayoutInfo;
@@ -448,138 +958,340 @@ void RtxApp::CreateDescriptorSetsLayouts() {
     CHECK_VK_ERROR(error, "vkCreateDescriptorSetLayout");
 
     // Second set:
-    //  binding 0 .. N  ->  per-face material IDs for our meshes  (N = num meshes)
-
-    const VkDescriptorBindingFlags flag = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
-
-    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlags;
-    bindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
-    bindingFlags.pNext = nullptr;
-    bindingFlags.pBindingFlags = &flag;
-    bindingFlags.bindingCount = 1;
-
-    VkDescriptorSetLayoutBinding ssboBinding;
-    ssboBinding.binding = 0;
-    ssboBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    ssboBinding.descriptorCount = numMeshes;
-    ssboBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-    ssboBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutCreateInfo set1LayoutInfo;
-    set1LayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    set1LayoutInfo.pNext = &bindingFlags;
-    set1LayoutInfo.flags = 0;
-    set1LayoutInfo.bindingCount = 1;
-    set1LayoutInfo.pBindings = &ssboBinding;
-
-    error = vkCreateDescriptorSetLayout(mDevice, &set1LayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_MATIDS_SET]);
-    CHECK_VK_ERROR(error, L"vkCreateDescriptorSetLayout");
+    //  bindless storage buffers, owned by the registry
 
-    // Third set:
-    //  binding 0 .. N  ->  vertex attributes for our meshes  (N = num meshes)
-    //   (re-using second's set info)
+    mRTDescriptorSetsLayouts[SWS_RESOURCES_SET] = mBindless.GetLayout();
 
-    error = vkCreateDescriptorSetLayout(mDevice, &set1LayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_ATTRIBS_SET]);
+    // Third set:
+    //  binding 0 ->  virtual textures page pool
+    //  binding 1 ->  virtual textures info
+    //  binding 2 ->  virtual textures page table
+    //  binding 3 ->  virtual textures feedback
+    //  binding 4 ->  virtual textures page stamps
+
+    VkDescriptorSetLayoutBinding vtPoolBinding;
+    vtPoolBinding.binding = SWS_VT_POOL_BINDING;
+    vtPoolBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    vtPoolBinding.descriptorCount = 1;
+    vtPoolBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    vtPoolBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding vtTexturesBinding;
+    vtTexturesBinding.binding = SWS_VT_TEXTURES_BINDING;
+    vtTexturesBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    vtTexturesBinding.descriptorCount = 1;
+    vtTexturesBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+    vtTexturesBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding vtPageTableBinding = vtTexturesBinding;
+    vtPageTableBinding.binding = SWS_VT_PAGE_TABLE_BINDING;
+
+    VkDescriptorSetLayoutBinding vtFeedbackBinding = vtTexturesBinding;
+    vtFeedbackBinding.binding = SWS_VT_FEEDBACK_BINDING;
+    vtFeedbackBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+    VkDescriptorSetLayoutBinding vtPageStampsBinding = vtTexturesBinding;
+    vtPageStampsBinding.binding = SWS_VT_PAGE_STAMPS_BINDING;
+
+    const VkDescriptorSetLayoutBinding vtBindings[5] = { vtPoolBinding, vtTexturesBinding, vtPageTableBinding, vtFeedbackBinding, vtPageStampsBinding };
+
+    VkDescriptorSetLayoutCreateInfo vtSetLayoutInfo;
+    vtSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vtSetLayoutInfo.pNext = nullptr;
+    vtSetLayoutInfo.flags = 0;
+    vtSetLayoutInfo.bindingCount = 5;
+    vtSetLayoutInfo.pBindings = vtBindings;
+
+    error = vkCreateDescriptorSetLayout(mDevice, &vtSetLayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_TEXTURES_SET]);
     CHECK_VK_ERROR(error, L"vkCreateDescriptorSetLayout");
 
     // Fourth set:
-    //  binding 0 .. N  ->  faces info (indices) for our meshes  (N = num meshes)
-    //   (re-using second's set info)
-
-    error = vkCreateDescriptorSetLayout(mDevice, &set1LayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_FACES_SET]);
-    CHECK_VK_ERROR(error, L"vkCreateDescriptorSetLayout");
-
-    // Fifth set:
-    //  binding 0 .. N  ->  textures (N = num materials)
-    
-    VkDescriptorSetLayoutBinding textureBinding;
-    textureBinding.binding = 0;
-    textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    textureBinding.descriptorCount = numMaterials;
-    textureBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-    textureBinding.pImmutableSamplers = nullptr;
-
-    set1LayoutInfo.pBindings = &textureBinding;
-
-    error = vkCreateDescriptorSetLayout(mDevice, &set1LayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_TEXTURES_SET]);
-    CHECK_VK_ERROR(error, L"vkCreateDescriptorSetLayout");
-
-    // Sixth set:
     //  binding 0 ->  env texture
+    //  binding 1 ->  env importance sampling tables
 
     VkDescriptorSetLayoutBinding envBinding;
-    envBinding.binding = 0;
+    envBinding.binding = SWS_ENV_TEXTURE_BINDING;
     envBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     envBinding.descriptorCount = 1;
-    envBinding.stageFlags = VK_SHADER_STAGE_MISS_BIT_KHR;
+    envBinding.stageFlags = VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_RAYGEN_BIT_KHR;
     envBinding.pImmutableSamplers = nullptr;
 
-    set1LayoutInfo.pBindings = &envBinding;
+    VkDescriptorSetLayoutBinding envCdfBinding;
+    envCdfBinding.binding = SWS_ENV_CDF_BINDING;
+    envCdfBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    envCdfBinding.descriptorCount = 1;
+    envCdfBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    envCdfBinding.pImmutableSamplers = nullptr;
 
-    error = vkCreateDescriptorSetLayout(mDevice, &set1LayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_ENVS_SET]);
+    const VkDescriptorSetLayoutBinding envBindings[2] = { envBinding, envCdfBinding };
+
+    VkDescriptorSetLayoutCreateInfo envSetLayoutInfo;
+    envSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    envSetLayoutInfo.pNext = nullptr;
+    envSetLayoutInfo.flags = 0;
+    envSetLayoutInfo.bindingCount = 2;
+    envSetLayoutInfo.pBindings = envBindings;
+
+    error = vkCreateDescriptorSetLayout(mDevice, &envSetLayoutInfo, nullptr, &mRTDescriptorSetsLayouts[SWS_ENVS_SET]);
     CHECK_VK_ERROR(error, L"vkCreateDescriptorSetLayout");
 }
 
 void RtxApp::CreateRaytracingPipelineAndSBT() {
+    startup::ScopedPhase phase("Create raytracing pipeline and SBT");
+
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = SWS_NUM_SETS;
     pipelineLayoutCreateInfo.pSetLayouts = mRTDescriptorSetsLayouts.data();
 
+    VkPushConstantRange tileParamsRange;
+    tileParamsRange.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    tileParamsRange.offset = 0;
+    tileParamsRange.size = sizeof(TraceTileParams);
+
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &tileParamsRange;
+
     VkResult error = vkCreatePipelineLayout(mDevice, &pipelineLayoutCreateInfo, nullptr, &mRTPipelineLayout);
     CHECK_VK_ERROR(error, "vkCreatePipelineLayout");
 
 
-    vulkanhelpers::Shader rayGenShader, rayChitShader, rayMissShader, shadowChit, shadowMiss;
-    rayGenShader.LoadFromFile((sShadersFolder + "ray_gen.bin").c_str());
-    rayChitShader.LoadFromFile((sShadersFolder + "ray_chit.bin").c_str());
-    rayMissShader.LoadFromFile((sShadersFolder + "ray_miss.bin").c_str());
-    shadowChit.LoadFromFile((sShadersFolder + "shadow_ray_chit.bin").c_str());
-    shadowMiss.LoadFromFile((sShadersFolder + "shadow_ray_miss.bin").c_str());
+    // the normal view and the heatmap up front, toggling between them shouldn't hitch
+    const uint32_t mainKey = this->GetPipelineKey(false);
+    const uint32_t heatmapKey = this->GetPipelineKey(true);
+    if (!this->CreateRaytracingPipelines({ mainKey, heatmapKey })) {
+        std::printf("Failed to create the raytracing pipelines\n");
+    }
+    mPipelineKey = mainKey;
+}
+
+uint32_t RtxApp::GetPipelineKey(const bool debugViews) const {
+    uint32_t key = (mSettings.maxBounces > 0) ? Min(mSettings.maxBounces, static_cast<uint32_t>(SWS_MAX_RECURSION)) : SWS_MAX_RECURSION;
+    if (mSettings.shadows) {
+        key |= sVariantShadowsBit;
+    }
+    if (debugViews) {
+        key |= sVariantDebugViewsBit;
+        // reading the clock costs on every hit, so only the heatmap variant pays for it
+        if (mSettings.supportShaderClock) {
+            key |= sVariantShaderClockBit;
+        }
+    }
+    return key;
+}
+
+bool RtxApp::CreateRaytracingPipelines(const Array<uint32_t>& keys) {
+    bool needRayGen = false, needClockRayGen = false;
+    for (const uint32_t key : keys) {
+        needRayGen = needRayGen || !(key & sVariantShaderClockBit);
+        needClockRayGen = needClockRayGen || (key & sVariantShaderClockBit);
+    }
 
-    mSBT.Initialize(2, 2, mRTProps.shaderGroupHandleSize, mRTProps.shaderGroupBaseAlignment);
+    vulkanhelpers::Shader rayGenShader, clockRayGenShader, rayMissShader, shadowChit, shadowMiss;
+    vulkanhelpers::Shader materialChitShaders[SWS_NUM_MATERIAL_TYPES];
+    String rayGenName = "ray_gen";
+    Array<String> rayGenDefines;
+    if (mSettings.rayStats) {
+        rayGenName += "_stats";
+        rayGenDefines.push_back("RAY_STATS");
+    }
 
-    mSBT.SetRaygenStage(rayGenShader.GetShaderStage(VK_SHADER_STAGE_RAYGEN_BIT_KHR));
+    Array<String> clockRayGenDefines = rayGenDefines;
+    clockRayGenDefines.push_back("SHADER_CLOCK");
 
-    mSBT.AddStageToHitGroup({ rayChitShader.GetShaderStage(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) }, SWS_PRIMARY_HIT_SHADERS_IDX);
-    mSBT.AddStageToHitGroup({ shadowChit.GetShaderStage(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) }, SWS_SHADOW_HIT_SHADERS_IDX);
+    bool loaded = true;
+    if (needRayGen) {
+        loaded = this->LoadShader(rayGenShader, "ray_gen.glsl", VK_SHADER_STAGE_RAYGEN_BIT_KHR, rayGenDefines, rayGenName + ".bin") && loaded;
+    }
+    if (needClockRayGen) {
+        loaded = this->LoadShader(clockRayGenShader, "ray_gen.glsl", VK_SHADER_STAGE_RAYGEN_BIT_KHR, clockRayGenDefines, rayGenName + "_clock.bin") && loaded;
+    }
+    loaded = this->LoadShader(materialChitShaders[SWS_MATERIAL_LAMBERT], "ray_chit.glsl", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, {}, "ray_chit.bin") && loaded;
+    loaded = this->LoadShader(materialChitShaders[SWS_MATERIAL_MIRROR], "ray_chit_mirror.glsl", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, {}, "ray_chit_mirror.bin") && loaded;
+    loaded = this->LoadShader(materialChitShaders[SWS_MATERIAL_DIELECTRIC], "ray_chit_dielectric.glsl", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, {}, "ray_chit_dielectric.bin") && loaded;
+    loaded = this->LoadShader(rayMissShader, "ray_miss.glsl", VK_SHADER_STAGE_MISS_BIT_KHR, {}, "ray_miss.bin") && loaded;
+    loaded = this->LoadShader(shadowChit, "shadow_ray_chit.glsl", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, {}, "shadow_ray_chit.bin") && loaded;
+    loaded = this->LoadShader(shadowMiss, "shadow_ray_miss.glsl", VK_SHADER_STAGE_MISS_BIT_KHR, {}, "shadow_ray_miss.bin") && loaded;
+    if (!loaded) {
+        // an empty entry for the ones never built, so Update doesn't try again every frame
+        for (const uint32_t key : keys) {
+            mPipelines[key];
+        }
+        return false;
+    }
 
-    mSBT.AddStageToMissGroup(rayMissShader.GetShaderStage(VK_SHADER_STAGE_MISS_BIT_KHR), SWS_PRIMARY_MISS_SHADERS_IDX);
-    mSBT.AddStageToMissGroup(shadowMiss.GetShaderStage(VK_SHADER_STAGE_MISS_BIT_KHR), SWS_SHADOW_MISS_SHADERS_IDX);
+    // the variants only differ in the raygen, every one gets the same hit and miss groups
+    auto fillSBT = [&](SBTHelper& sbt, const VkPipelineShaderStageCreateInfo& raygenStage) {
+        sbt.Initialize(SWS_NUM_MATERIAL_TYPES * SWS_NUM_RAY_TYPES, 2, mRTProps.shaderGroupHandleSize, mRTProps.shaderGroupBaseAlignment);
 
+        sbt.SetRaygenStage(raygenStage);
 
-    VkRayTracingPipelineCreateInfoKHR rayPipelineInfo = {};
-    rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
-    rayPipelineInfo.stageCount = mSBT.GetNumStages();
-    rayPipelineInfo.pStages = mSBT.GetStages();
-    rayPipelineInfo.groupCount = mSBT.GetNumGroups();
-    rayPipelineInfo.pGroups = mSBT.GetGroups();
-    rayPipelineInfo.maxPipelineRayRecursionDepth = 1;
-    rayPipelineInfo.layout = mRTPipelineLayout;
+        // a pair per material type, shadows don't care what they hit
+        for (uint32_t type = 0; type < SWS_NUM_MATERIAL_TYPES; ++type) {
+            const uint32_t firstGroup = type * SWS_NUM_RAY_TYPES;
+            sbt.AddStageToHitGroup({ materialChitShaders[type].GetShaderStage(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) }, firstGroup + SWS_PRIMARY_HIT_SHADERS_IDX);
+            sbt.AddStageToHitGroup({ shadowChit.GetShaderStage(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) }, firstGroup + SWS_SHADOW_HIT_SHADERS_IDX);
+        }
 
-    error = vkCreateRayTracingPipelinesKHR(mDevice, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rayPipelineInfo, VK_NULL_HANDLE, &mRTPipeline);
-    CHECK_VK_ERROR(error, "vkCreateRayTracingPipelinesKHR");
+        sbt.AddStageToMissGroup(rayMissShader.GetShaderStage(VK_SHADER_STAGE_MISS_BIT_KHR), SWS_PRIMARY_MISS_SHADERS_IDX);
+        sbt.AddStageToMissGroup(shadowMiss.GetShaderStage(VK_SHADER_STAGE_MISS_BIT_KHR), SWS_SHADOW_MISS_SHADERS_IDX);
+    };
 
-    mSBT.CreateSBT(mDevice, mRTPipeline);
+    // the stack size is worked out from the compiled shaders and set when the pipeline is bound
+    const VkDynamicState stackSizeState = VK_DYNAMIC_STATE_RAY_TRACING_PIPELINE_STACK_SIZE_KHR;
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 1;
+    dynamicState.pDynamicStates = &stackSizeState;
+
+    auto makePipelineInfo = [&](const SBTHelper& sbt) {
+        VkRayTracingPipelineCreateInfoKHR rayPipelineInfo = {};
+        rayPipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
+        rayPipelineInfo.stageCount = sbt.GetNumStages();
+        rayPipelineInfo.pStages = sbt.GetStages();
+        rayPipelineInfo.groupCount = sbt.GetNumGroups();
+        rayPipelineInfo.pGroups = sbt.GetGroups();
+        rayPipelineInfo.maxPipelineRayRecursionDepth = sMaxRayRecursionDepth;
+        rayPipelineInfo.pDynamicState = &dynamicState;
+        rayPipelineInfo.layout = mRTPipelineLayout;
+        return rayPipelineInfo;
+    };
+
+    // the stages point into these, they have to stay put until the pipelines are created
+    const size_t numVariants = keys.size();
+    Array<RaygenSpecialization> specializationData(numVariants);
+    Array<VkSpecializationInfo> specializationInfos(numVariants);
+    Array<VkRayTracingPipelineCreateInfoKHR> pipelineInfos(numVariants);
+    Array<RTPipeline*> variants(numVariants);
+
+    // built aside, the running pipelines stay untouched until their replacement exists
+    std::unordered_map<uint32_t, RTPipeline> built;
+
+    for (size_t i = 0; i < numVariants; ++i) {
+        const uint32_t key = keys[i];
+
+        specializationData[i].maxBounces = key & sVariantBouncesMask;
+        specializationData[i].shadows = (key & sVariantShadowsBit) ? VK_TRUE : VK_FALSE;
+        specializationData[i].debugViews = (key & sVariantDebugViewsBit) ? VK_TRUE : VK_FALSE;
+
+        specializationInfos[i].mapEntryCount = sNumRaygenSpecializationEntries;
+        specializationInfos[i].pMapEntries = sRaygenSpecializationEntries;
+        specializationInfos[i].dataSize = sizeof(RaygenSpecialization);
+        specializationInfos[i].pData = &specializationData[i];
+
+        RTPipeline& variant = built[key];
+
+        const vulkanhelpers::Shader& raygen = (key & sVariantShaderClockBit) ? clockRayGenShader : rayGenShader;
+        fillSBT(variant.sbt, raygen.GetShaderStage(VK_SHADER_STAGE_RAYGEN_BIT_KHR, &specializationInfos[i]));
+        pipelineInfos[i] = makePipelineInfo(variant.sbt);
+        variants[i] = &variant;
+    }
+
+    // independent pipelines compile side by side, the driver splits each one further over the workers
+    Array<VkPipeline> pipelines(numVariants, VK_NULL_HANDLE);
+    VkResult error;
+    {
+        startup::ScopedPhase compilePhase("Compile raytracing pipelines");
+        error = vulkanhelpers::CreateRayTracingPipelines(mPipelineCache, static_cast<uint32_t>(numVariants), pipelineInfos.data(), pipelines.data(), &mThreadPool);
+    }
+
+    // the ones that did compile replace the old ones even if another failed
+    for (size_t i = 0; i < numVariants; ++i) {
+        const uint32_t key = keys[i];
+        if (!pipelines[i]) {
+            // the old one keeps running, or an empty entry so Update doesn't try again every frame
+            mPipelines[key];
+            continue;
+        }
+
+        variants[i]->pipeline = pipelines[i];
+        variants[i]->sbt.CreateSBT(mDevice, pipelines[i]);
+        variants[i]->stackSize = variants[i]->sbt.GetPipelineStackSize(mDevice, pipelines[i], sMaxRayRecursionDepth);
+
+        const auto old = mPipelines.find(key);
+        if (old != mPipelines.end()) {
+            this->FreeRaytracingPipeline(old->second);
+            mPipelines.erase(old);
+        }
+        // the node moves over as is, the SBT buffer never gets copied
+        mPipelines.insert(built.extract(key));
+    }
+
+    return VK_SUCCESS == error;
+}
+
+void RtxApp::FreeRaytracingPipeline(RTPipeline& variant) {
+    variant.sbt.Destroy();
+
+    if (variant.pipeline) {
+        vkDestroyPipeline(mDevice, variant.pipeline, nullptr);
+        variant.pipeline = VK_NULL_HANDLE;
+    }
+}
+
+void RtxApp::FreeRaytracingPipelines() {
+    for (auto& it : mPipelines) {
+        this->FreeRaytracingPipeline(it.second);
+    }
+    mPipelines.clear();
+}
+
+// the sources if they're there, the precompiled binary otherwise
+bool RtxApp::LoadShader(vulkanhelpers::Shader& shader, const String& sourceName, const VkShaderStageFlagBits stage, const Array<String>& defines, const String& binaryName) {
+    if (mShaderCompiler.IsEnabled()) {
+        Array<uint32_t> spirv;
+        if (mShaderCompiler.Compile(sourceName, stage, defines, spirv)) {
+            return shader.LoadFromMemory(spirv.data(), spirv.size() * sizeof(uint32_t));
+        }
+        // on startup there's still something to show, a reload keeps the running pipelines instead
+        if (!mPipelines.empty()) {
+            return false;
+        }
+        std::printf("Falling back to the precompiled %s\n", binaryName.c_str());
+    }
+
+    return shader.LoadFromFile((sShadersFolder + binaryName).c_str());
+}
+
+void RtxApp::ReloadShaders() {
+    // nothing is in flight while the pipelines and SBTs get swapped
+    vkDeviceWaitIdle(mDevice);
+
+    // every variant built so far, the rest still get built when first needed
+    Array<uint32_t> keys;
+    keys.reserve(mPipelines.size());
+    for (const auto& it : mPipelines) {
+        keys.push_back(it.first);
+    }
+
+    if (this->CreateRaytracingPipelines(keys)) {
+        std::printf("Shaders reloaded\n");
+        mAccumReset = true;
+    } else if (mPipelines[mPipelineKey].pipeline) {
+        std::printf("Shader reload failed, keeping the old pipelines\n");
+    } else {
+        std::printf("Failed to create the raytracing pipelines, nothing gets traced until the shaders are fixed\n");
+    }
 }
 
 void RtxApp::UpdateDescriptorSets() {
-    const uint32_t numMeshes = static_cast<uint32_t>(mScene.meshes.size());
-    const uint32_t numMaterials = static_cast<uint32_t>(mScene.materials.size());
+    startup::ScopedPhase phase("Update descriptor sets");
 
     std::vector<VkDescriptorPoolSize> poolSizes({
         { VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },       // top-level AS
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },                    // output image
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },                   // Camera data
-        //
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, numMeshes * 3 },       // per-face material IDs for each mesh
-                                                                    // vertex attribs for each mesh
-                                                                    // faces buffer for each mesh
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 },                    // output image and accumulation image
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },           // Camera data
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },                   // per-mesh bindless slots
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },                   // materials
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },           // ray statistics
         //
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, numMaterials },// textures for each material
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },           // virtual textures page pool
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },                   // virtual textures info, page table and page stamps
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },           // virtual textures feedback
 
         //
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }            // environment texture
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },           // environment texture
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 }                    // environment importance sampling tables
     });
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo;
@@ -593,33 +1305,30 @@ void RtxApp::UpdateDescriptorSets() {
     VkResult error = vkCreateDescriptorPool(mDevice, &descriptorPoolCreateInfo, nullptr, &mRTDescriptorPool);
     CHECK_VK_ERROR(error, "vkCreateDescriptorPool");
 
-    mRTDescriptorSets.resize(SWS_NUM_SETS);
-
-    Array<uint32_t> variableDescriptorCounts({
-        1,
-        numMeshes,      // per-face material IDs for each mesh
-        numMeshes,      // vertex attribs for each mesh
-        numMeshes,      // faces buffer for each mesh
-        numMaterials,   // textures for each material
-        1,              // environment texture
-    });
-
-    VkDescriptorSetVariableDescriptorCountAllocateInfo variableDescriptorCountInfo;
-    variableDescriptorCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
-    variableDescriptorCountInfo.pNext = nullptr;
-    variableDescriptorCountInfo.descriptorSetCount = SWS_NUM_SETS;
-    variableDescriptorCountInfo.pDescriptorCounts = variableDescriptorCounts.data(); // actual number of descriptors
+    // the resources set comes from the bindless registry, the rest are ours
+    const uint32_t appSets[3] = { SWS_SCENE_AS_SET, SWS_TEXTURES_SET, SWS_ENVS_SET };
+    VkDescriptorSetLayout appSetsLayouts[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        appSetsLayouts[i] = mRTDescriptorSetsLayouts[appSets[i]];
+    }
 
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
     descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptorSetAllocateInfo.pNext = &variableDescriptorCountInfo;
+    descriptorSetAllocateInfo.pNext = nullptr;
     descriptorSetAllocateInfo.descriptorPool = mRTDescriptorPool;
-    descriptorSetAllocateInfo.descriptorSetCount = SWS_NUM_SETS;
-    descriptorSetAllocateInfo.pSetLayouts = mRTDescriptorSetsLayouts.data();
+    descriptorSetAllocateInfo.descriptorSetCount = 3;
+    descriptorSetAllocateInfo.pSetLayouts = appSetsLayouts;
 
-    error = vkAllocateDescriptorSets(mDevice, &descriptorSetAllocateInfo, mRTDescriptorSets.data());
+    VkDescriptorSet appDescriptorSets[3];
+    error = vkAllocateDescriptorSets(mDevice, &descriptorSetAllocateInfo, appDescriptorSets);
     CHECK_VK_ERROR(error, "vkAllocateDescriptorSets");
 
+    mRTDescriptorSets.resize(SWS_NUM_SETS);
+    for (uint32_t i = 0; i < 3; ++i) {
+        mRTDescriptorSets[appSets[i]] = appDescriptorSets[i];
+    }
+    mRTDescriptorSets[SWS_RESOURCES_SET] = mBindless.GetSet();
+
     ///////////////////////////////////////////////////////////
 
     VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo;
@@ -661,10 +1370,22 @@ void RtxApp::UpdateDescriptorSets() {
 
     ///////////////////////////////////////////////////////////
 
+    VkDescriptorImageInfo descriptorAccumImageInfo;
+    descriptorAccumImageInfo.sampler = VK_NULL_HANDLE;
+    descriptorAccumImageInfo.imageView = mAccumImage.GetImageView();
+    descriptorAccumImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet accumImageWrite = resultImageWrite;
+    accumImageWrite.dstSet = mRTDescriptorSets[SWS_ACCUM_IMAGE_SET];
+    accumImageWrite.dstBinding = SWS_ACCUM_IMAGE_BINDING;
+    accumImageWrite.pImageInfo = &descriptorAccumImageInfo;
+
+    ///////////////////////////////////////////////////////////
+
     VkDescriptorBufferInfo camdataBufferInfo;
     camdataBufferInfo.buffer = mCameraBuffer.GetBuffer();
     camdataBufferInfo.offset = 0;
-    camdataBufferInfo.range = mCameraBuffer.GetSize();
+    camdataBufferInfo.range = sizeof(UniformParams);
 
     VkWriteDescriptorSet camdataBufferWrite;
     camdataBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -673,66 +1394,99 @@ void RtxApp::UpdateDescriptorSets() {
     camdataBufferWrite.dstBinding = SWS_CAMDATA_BINDING;
     camdataBufferWrite.dstArrayElement = 0;
     camdataBufferWrite.descriptorCount = 1;
-    camdataBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    camdataBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     camdataBufferWrite.pImageInfo = nullptr;
     camdataBufferWrite.pBufferInfo = &camdataBufferInfo;
     camdataBufferWrite.pTexelBufferView = nullptr;
 
     ///////////////////////////////////////////////////////////
 
-    VkWriteDescriptorSet matIDsBufferWrite;
-    matIDsBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    matIDsBufferWrite.pNext = nullptr;
-    matIDsBufferWrite.dstSet = mRTDescriptorSets[SWS_MATIDS_SET];
-    matIDsBufferWrite.dstBinding = 0;
-    matIDsBufferWrite.dstArrayElement = 0;
-    matIDsBufferWrite.descriptorCount = numMeshes;
-    matIDsBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    matIDsBufferWrite.pImageInfo = nullptr;
-    matIDsBufferWrite.pBufferInfo = mScene.matIDsBufferInfos.data();
-    matIDsBufferWrite.pTexelBufferView = nullptr;
+    VkDescriptorBufferInfo meshesBufferInfo;
+    meshesBufferInfo.buffer = mScene.meshesBuffer.GetBuffer();
+    meshesBufferInfo.offset = 0;
+    meshesBufferInfo.range = mScene.meshesBuffer.GetSize();
+
+    VkWriteDescriptorSet meshesBufferWrite;
+    meshesBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    meshesBufferWrite.pNext = nullptr;
+    meshesBufferWrite.dstSet = mRTDescriptorSets[SWS_MESHES_SET];
+    meshesBufferWrite.dstBinding = SWS_MESHES_BINDING;
+    meshesBufferWrite.dstArrayElement = 0;
+    meshesBufferWrite.descriptorCount = 1;
+    meshesBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    meshesBufferWrite.pImageInfo = nullptr;
+    meshesBufferWrite.pBufferInfo = &meshesBufferInfo;
+    meshesBufferWrite.pTexelBufferView = nullptr;
 
     ///////////////////////////////////////////////////////////
 
-    VkWriteDescriptorSet attribsBufferWrite;
-    attribsBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    attribsBufferWrite.pNext = nullptr;
-    attribsBufferWrite.dstSet = mRTDescriptorSets[SWS_ATTRIBS_SET];
-    attribsBufferWrite.dstBinding = 0;
-    attribsBufferWrite.dstArrayElement = 0;
-    attribsBufferWrite.descriptorCount = numMeshes;
-    attribsBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    attribsBufferWrite.pImageInfo = nullptr;
-    attribsBufferWrite.pBufferInfo = mScene.attribsBufferInfos.data();
-    attribsBufferWrite.pTexelBufferView = nullptr;
+    VkDescriptorBufferInfo materialsBufferInfo;
+    materialsBufferInfo.buffer = mScene.materialsBuffer.GetBuffer();
+    materialsBufferInfo.offset = 0;
+    materialsBufferInfo.range = mScene.materialsBuffer.GetSize();
+
+    VkWriteDescriptorSet materialsBufferWrite = meshesBufferWrite;
+    materialsBufferWrite.dstSet = mRTDescriptorSets[SWS_MATERIALS_SET];
+    materialsBufferWrite.dstBinding = SWS_MATERIALS_BINDING;
+    materialsBufferWrite.pBufferInfo = &materialsBufferInfo;
 
     ///////////////////////////////////////////////////////////
 
-    VkWriteDescriptorSet facesBufferWrite;
-    facesBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    facesBufferWrite.pNext = nullptr;
-    facesBufferWrite.dstSet = mRTDescriptorSets[SWS_FACES_SET];
-    facesBufferWrite.dstBinding = 0;
-    facesBufferWrite.dstArrayElement = 0;
-    facesBufferWrite.descriptorCount = numMeshes;
-    facesBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    facesBufferWrite.pImageInfo = nullptr;
-    facesBufferWrite.pBufferInfo = mScene.facesBufferInfos.data();
-    facesBufferWrite.pTexelBufferView = nullptr;
+    VkDescriptorBufferInfo rayStatsBufferInfo;
+    rayStatsBufferInfo.buffer = mRayStatsBuffer.GetBuffer();
+    rayStatsBufferInfo.offset = 0;
+    rayStatsBufferInfo.range = sizeof(uint32_t) * SWS_RAY_STATS_NUM_COUNTERS;
+
+    VkWriteDescriptorSet rayStatsBufferWrite = meshesBufferWrite;
+    rayStatsBufferWrite.dstSet = mRTDescriptorSets[SWS_RAY_STATS_SET];
+    rayStatsBufferWrite.dstBinding = SWS_RAY_STATS_BINDING;
+    rayStatsBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    rayStatsBufferWrite.pBufferInfo = &rayStatsBufferInfo;
 
     ///////////////////////////////////////////////////////////
 
-    VkWriteDescriptorSet texturesBufferWrite;
-    texturesBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    texturesBufferWrite.pNext = nullptr;
-    texturesBufferWrite.dstSet = mRTDescriptorSets[SWS_TEXTURES_SET];
-    texturesBufferWrite.dstBinding = 0;
-    texturesBufferWrite.dstArrayElement = 0;
-    texturesBufferWrite.descriptorCount = numMaterials;
-    texturesBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    texturesBufferWrite.pImageInfo = mScene.texturesInfos.data();
-    texturesBufferWrite.pBufferInfo = nullptr;
-    texturesBufferWrite.pTexelBufferView = nullptr;
+    const VkDescriptorBufferInfo vtBufferInfos[2] = {
+        mVirtualTextures.GetTexturesBufferInfo(),
+        mVirtualTextures.GetPageTableBufferInfo()
+    };
+    const VkDescriptorBufferInfo vtFeedbackBufferInfo = mVirtualTextures.GetFeedbackBufferInfo();
+    const VkDescriptorBufferInfo vtPageStampsBufferInfo = mVirtualTextures.GetPageStampsBufferInfo();
+
+    VkWriteDescriptorSet vtPoolWrite;
+    vtPoolWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    vtPoolWrite.pNext = nullptr;
+    vtPoolWrite.dstSet = mRTDescriptorSets[SWS_TEXTURES_SET];
+    vtPoolWrite.dstBinding = SWS_VT_POOL_BINDING;
+    vtPoolWrite.dstArrayElement = 0;
+    vtPoolWrite.descriptorCount = 1;
+    vtPoolWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    vtPoolWrite.pImageInfo = &mVirtualTextures.GetPoolImageInfo();
+    vtPoolWrite.pBufferInfo = nullptr;
+    vtPoolWrite.pTexelBufferView = nullptr;
+
+    // bindings 1 and 2 are consecutive storage buffers, one write covers both
+    VkWriteDescriptorSet vtBuffersWrite;
+    vtBuffersWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    vtBuffersWrite.pNext = nullptr;
+    vtBuffersWrite.dstSet = mRTDescriptorSets[SWS_TEXTURES_SET];
+    vtBuffersWrite.dstBinding = SWS_VT_TEXTURES_BINDING;
+    vtBuffersWrite.dstArrayElement = 0;
+    vtBuffersWrite.descriptorCount = 2;
+    vtBuffersWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    vtBuffersWrite.pImageInfo = nullptr;
+    vtBuffersWrite.pBufferInfo = vtBufferInfos;
+    vtBuffersWrite.pTexelBufferView = nullptr;
+
+    VkWriteDescriptorSet vtFeedbackWrite = vtBuffersWrite;
+    vtFeedbackWrite.dstBinding = SWS_VT_FEEDBACK_BINDING;
+    vtFeedbackWrite.descriptorCount = 1;
+    vtFeedbackWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    vtFeedbackWrite.pBufferInfo = &vtFeedbackBufferInfo;
+
+    VkWriteDescriptorSet vtPageStampsWrite = vtBuffersWrite;
+    vtPageStampsWrite.dstBinding = SWS_VT_PAGE_STAMPS_BINDING;
+    vtPageStampsWrite.descriptorCount = 1;
+    vtPageStampsWrite.pBufferInfo = &vtPageStampsBufferInfo;
 
     ///////////////////////////////////////////////////////////
 
@@ -740,7 +1494,7 @@ void RtxApp::UpdateDescriptorSets() {
     envTexturesWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     envTexturesWrite.pNext = nullptr;
     envTexturesWrite.dstSet = mRTDescriptorSets[SWS_ENVS_SET];
-    envTexturesWrite.dstBinding = 0;
+    envTexturesWrite.dstBinding = SWS_ENV_TEXTURE_BINDING;
     envTexturesWrite.dstArrayElement = 0;
     envTexturesWrite.descriptorCount = 1;
     envTexturesWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -750,27 +1504,48 @@ void RtxApp::UpdateDescriptorSets() {
 
     ///////////////////////////////////////////////////////////
 
+    VkDescriptorBufferInfo envCdfBufferInfo;
+    envCdfBufferInfo.buffer = mEnvCdfBuffer.GetBuffer();
+    envCdfBufferInfo.offset = 0;
+    envCdfBufferInfo.range = mEnvCdfBuffer.GetSize();
+
+    VkWriteDescriptorSet envCdfBufferWrite;
+    envCdfBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    envCdfBufferWrite.pNext = nullptr;
+    envCdfBufferWrite.dstSet = mRTDescriptorSets[SWS_ENVS_SET];
+    envCdfBufferWrite.dstBinding = SWS_ENV_CDF_BINDING;
+    envCdfBufferWrite.dstArrayElement = 0;
+    envCdfBufferWrite.descriptorCount = 1;
+    envCdfBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    envCdfBufferWrite.pImageInfo = nullptr;
+    envCdfBufferWrite.pBufferInfo = &envCdfBufferInfo;
+    envCdfBufferWrite.pTexelBufferView = nullptr;
+
+    ///////////////////////////////////////////////////////////
+
     Array<VkWriteDescriptorSet> descriptorWrites({
         accelerationStructureWrite,
         resultImageWrite,
+        accumImageWrite,
         camdataBufferWrite,
+        meshesBufferWrite,
+        materialsBufferWrite,
+        rayStatsBufferWrite,
         //
-        matIDsBufferWrite,
-        //
-        attribsBufferWrite,
-        //
-        facesBufferWrite,
-        //
-        texturesBufferWrite,
+        vtPoolWrite,
+        vtBuffersWrite,
+        vtFeedbackWrite,
+        vtPageStampsWrite,
         //
-        envTexturesWrite
+        envTexturesWrite,
+        envCdfBufferWrite
     });
 
     vkUpdateDescriptorSets(mDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, VK_NULL_HANDLE);
 }
 
 
-void RTScene::BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
+void RTScene::BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue, GPUProfiler& profiler) {
     const size_t numMeshes = meshes.size();
 
     Array<VkAccelerationStructureGeometryKHR> geometries(numMeshes, VkAccelerationStructureGeometryKHR{});
@@ -837,6 +1612,10 @@ void RTScene::BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
+    // waited on right below, so the setup slot can be collected straight away
+    profiler.BeginFrame(commandBuffer, profiler.GetSetupSlot());
+    const uint32_t buildScope = profiler.BeginScope(commandBuffer, sBuildBLASScopeName);
+
     VkMemoryBarrier memoryBarrier = {};
     memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
     memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
@@ -874,6 +1653,8 @@ void RTScene::BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
             0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
     }
 
+    profiler.EndScope(commandBuffer, buildScope);
+
     vkEndCommandBuffer(commandBuffer);
 
     VkSubmitInfo submitInfo = {};
@@ -882,10 +1663,15 @@ void RTScene::BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
     submitInfo.pCommandBuffers = &commandBuffer;
 
     vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-    error = vkQueueWaitIdle(queue);
+    {
+        startup::ScopedGPUWait gpuWait;
+        error = vkQueueWaitIdle(queue);
+    }
     CHECK_VK_ERROR(error, "vkQueueWaitIdle");
     vkFreeCommandBuffers(device, cmdPool, 1, &commandBuffer);
 
+    profiler.Collect(profiler.GetSetupSlot());
+
     // get handles
     for (size_t i = 0; i < numMeshes; ++i) {
         RTMesh& mesh = meshes[i];
@@ -897,7 +1683,7 @@ void RTScene::BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
     }
 }
 
-void RTScene::BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
+void RTScene::BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue, GPUProfiler& profiler) {
     const VkTransformMatrixKHR transform = {
         1.0f, 0.0f, 0.0f, 0.0f,
         0.0f, 1.0f, 0.0f, 0.0f,
@@ -915,7 +1701,9 @@ void RTScene::BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
         instance.transform = transform;
         instance.instanceCustomIndex = static_cast<uint32_t>(i);
         instance.mask = 0xff;
-        instance.instanceShaderBindingTableRecordOffset = 0;
+        // every material type has its own pair of hit groups
+        const uint32_t materialType = (mesh.material < materials.size()) ? materials[mesh.material].type : SWS_MATERIAL_LAMBERT;
+        instance.instanceShaderBindingTableRecordOffset = materialType * SWS_NUM_RAY_TYPES;
         instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
         instance.accelerationStructureReference = mesh.blas.handle;
     }
@@ -994,8 +1782,13 @@ void RTScene::BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
 
     const VkAccelerationStructureBuildRangeInfoKHR* ranges[1] = { &range };
 
+    profiler.BeginFrame(commandBuffer, profiler.GetSetupSlot());
+    const uint32_t buildScope = profiler.BeginScope(commandBuffer, sBuildTLASScopeName);
+
     vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, ranges);
 
+    profiler.EndScope(commandBuffer, buildScope);
+
     vkEndCommandBuffer(commandBuffer);
 
     VkSubmitInfo submitInfo = {};
@@ -1004,10 +1797,15 @@ void RTScene::BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue) {
     submitInfo.pCommandBuffers = &commandBuffer;
 
     vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-    error = vkQueueWaitIdle(queue);
+    {
+        startup::ScopedGPUWait gpuWait;
+        error = vkQueueWaitIdle(queue);
+    }
     CHECK_VK_ERROR(error, "vkQueueWaitIdle");
     vkFreeCommandBuffers(device, cmdPool, 1, &commandBuffer);
 
+    profiler.Collect(profiler.GetSetupSlot());
+
     VkAccelerationStructureDeviceAddressInfoKHR addressInfo = {};
     addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
     addressInfo.accelerationStructure = topLevelAS.accelerationStructure;
@@ -1218,3 +2016,33 @@ bool SBTHelper::CreateSBT(VkDevice device, VkPipeline rtPipeline) {
 VkDeviceAddress SBTHelper::GetSBTAddress() const {
     return vulkanhelpers::GetBufferDeviceAddress(mSBTBuffer).deviceAddress;
 }
+
+uint32_t SBTHelper::GetPipelineStackSize(VkDevice device, VkPipeline rtPipeline, const uint32_t maxRecursionDepth) const {
+    const VkDeviceSize raygenSize = vkGetRayTracingShaderGroupStackSizeKHR(device, rtPipeline, 0, VK_SHADER_GROUP_SHADER_GENERAL_KHR);
+
+    VkDeviceSize closestHitSize = 0, anyHitSize = 0, missSize = 0;
+    for (uint32_t i = 0; i < mNumHitGroups; ++i) {
+        const uint32_t group = 1 + i;   // group 0 is always for raygen, then go hit groups
+        if (mGroups[group].closestHitShader != VK_SHADER_UNUSED_KHR) {
+            closestHitSize = Max(closestHitSize, vkGetRayTracingShaderGroupStackSizeKHR(device, rtPipeline, group, VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR));
+        }
+        if (mGroups[group].anyHitShader != VK_SHADER_UNUSED_KHR) {
+            anyHitSize = Max(anyHitSize, vkGetRayTracingShaderGroupStackSizeKHR(device, rtPipeline, group, VK_SHADER_GROUP_SHADER_ANY_HIT_KHR));
+        }
+    }
+    for (uint32_t i = 0; i < mNumMissGroups; ++i) {
+        const uint32_t group = 1 + mNumHitGroups + i;
+        missSize = Max(missSize, vkGetRayTracingShaderGroupStackSizeKHR(device, rtPipeline, group, VK_SHADER_GROUP_SHADER_GENERAL_KHR));
+    }
+
+    // the spec's formula without callables and intersection shaders: the first level may be any of them,
+    // any-hit runs while the trace is traversing, the deeper levels are closest hit or miss
+    const VkDeviceSize firstLevel = Max(Max(closestHitSize, missSize), anyHitSize);
+    const VkDeviceSize deeperLevels = Max(closestHitSize, missSize);
+    VkDeviceSize stackSize = raygenSize;
+    if (maxRecursionDepth > 0) {
+        stackSize += firstLevel + static_cast<VkDeviceSize>(maxRecursionDepth - 1) * deeperLevels;
+    }
+
+    return static_cast<uint32_t>(stackSize);
+}
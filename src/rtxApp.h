@@ -2,6 +2,16 @@
 
 #include "framework/vulkanapp.h"
 #include "framework/camera.h"
+#include "framework/camerapath.h"
+#include "framework/virtualtexture.h"
+#include "framework/bindlessregistry.h"
+#include "framework/tilescheduler.h"
+#include "framework/dynamicresolution.h"
+#include "framework/shadercompiler.h"
+
+#include "tiny_obj_loader.h"
+
+#include <unordered_map>
 
 struct RTAccelerationStructure {
     vulkanhelpers::Buffer                   buffer;
@@ -19,11 +29,21 @@ struct RTMesh {
     vulkanhelpers::Buffer       faces;
     vulkanhelpers::Buffer       matIDs;
 
+    // bindless slots of the buffers above
+    uint32_t                    matIDsSlot;
+    uint32_t                    attribsSlot;
+    uint32_t                    facesSlot;
+
+    // picks the instance's hit group, the triangles keep their own materials for the textures
+    uint32_t                    material;
+
     RTAccelerationStructure     blas;
 };
 
 struct RTMaterial {
-    vulkanhelpers::Image        texture;
+    uint32_t                    virtualTexture;
+    uint32_t                    type;           // SWS_MATERIAL_*
+    float                       ior;
 };
 
 struct RTScene {
@@ -32,15 +52,28 @@ struct RTScene {
     RTAccelerationStructure         topLevelAS;
 
     // shader resources stuff
-    Array<VkDescriptorBufferInfo>   matIDsBufferInfos;
-    Array<VkDescriptorBufferInfo>   attribsBufferInfos;
-    Array<VkDescriptorBufferInfo>   facesBufferInfos;
-    Array<VkDescriptorImageInfo>    texturesInfos;
+    vulkanhelpers::Buffer           meshesBuffer;   // bindless slots for every mesh
+    vulkanhelpers::Buffer           materialsBuffer;
 
-    void    BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue);
-    void    BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue);
+    void    BuildBLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue, GPUProfiler& profiler);
+    void    BuildTLAS(VkDevice device, VkCommandPool cmdPool, VkQueue queue, GPUProfiler& profiler);
 };
 
+struct VertexAttribute;
+
+// flattens the given faces of an OBJ shape into the layout the shaders read, every face gets 3 vertices of its own
+// positions, attribs and indices take numFaces * 3 entries, faces numFaces * 4 and matIDs numFaces
+// faces without a valid material get defaultMaterial
+void    ConvertOBJShape(const tinyobj::attrib_t& attrib,
+                        const tinyobj::shape_t& shape,
+                        const Array<uint32_t>& shapeFaces,
+                        const uint32_t defaultMaterial,
+                        vec3* positions,
+                        VertexAttribute* attribs,
+                        uint32_t* indices,
+                        uint32_t* faces,
+                        uint32_t* matIDs);
+
 
 class SBTHelper {
 public:
@@ -70,6 +103,9 @@ public:
     bool        CreateSBT(VkDevice device, VkPipeline rtPipeline);
     VkDeviceAddress GetSBTAddress() const;
 
+    // what the pipeline needs with maxRecursionDepth levels of traces, for vkCmdSetRayTracingPipelineStackSizeKHR
+    uint32_t    GetPipelineStackSize(VkDevice device, VkPipeline rtPipeline, const uint32_t maxRecursionDepth) const;
+
 private:
     uint32_t                                    mShaderHandleSize;
     uint32_t                                    mShaderGroupAlignment;
@@ -82,6 +118,13 @@ private:
     vulkanhelpers::Buffer                       mSBTBuffer;
 };
 
+// one specialization of the raygen, with the SBT pointing into it
+struct RTPipeline {
+    VkPipeline                              pipeline = VK_NULL_HANDLE;
+    SBTHelper                               sbt;
+    uint32_t                                stackSize = 0;  // set as dynamic state, the driver's default assumes the worst case
+};
+
 
 class RtxApp : public VulkanApp {
 public:
@@ -90,40 +133,84 @@ public:
 
 protected:
     virtual void InitSettings() override;
-    virtual void InitApp() override;
+    virtual bool InitApp() override;
     virtual void FreeResources() override;
-    virtual void FillCommandBuffer(VkCommandBuffer commandBuffer, const size_t imageIndex) override;
+    virtual void FillCommandBuffer(VkCommandBuffer commandBuffer, const size_t frameIndex) override;
 
     virtual void OnMouseMove(const float x, const float y) override;
     virtual void OnMouseButton(const int button, const int action, const int mods) override;
     virtual void OnKey(const int key, const int scancode, const int action, const int mods) override;
-    virtual void Update(const size_t imageIndex, const float dt) override;
+    virtual void Update(const size_t frameIndex, const float dt) override;
 
 private:
-    void LoadSceneGeometry();
+    bool LoadSceneGeometry();
     void CreateScene();
     void CreateCamera();
+    void CreateAccumulationImage();
+    void CreateRayStats();
+    void ReadRayStats(const size_t frameIndex);
     void UpdateCameraParams(struct UniformParams* params, const float dt);
+    void UpdateBenchmarkCamera();
     void CreateDescriptorSetsLayouts();
     void CreateRaytracingPipelineAndSBT();
+    // packs the specialization the current settings need, debugViews - the variant with the cost heatmap compiled in
+    uint32_t GetPipelineKey(const bool debugViews) const;
+    // (re)builds the given variants and their SBTs over the existing layout, the old ones are only replaced if every shader loads
+    bool CreateRaytracingPipelines(const Array<uint32_t>& keys);
+    void FreeRaytracingPipeline(RTPipeline& variant);
+    void FreeRaytracingPipelines();
+    bool LoadShader(vulkanhelpers::Shader& shader, const String& sourceName, const VkShaderStageFlagBits stage, const Array<String>& defines, const String& binaryName);
+    void ReloadShaders();
     void UpdateDescriptorSets();
 
 private:
     Array<VkDescriptorSetLayout>    mRTDescriptorSetsLayouts;
     VkPipelineLayout                mRTPipelineLayout;
-    VkPipeline                      mRTPipeline;
+    // variants built so far by their key, a failed build stays in as a null pipeline until the next reload
+    std::unordered_map<uint32_t, RTPipeline> mPipelines;
+    uint32_t                        mPipelineKey;       // the variant this frame is traced with
     VkDescriptorPool                mRTDescriptorPool;
     Array<VkDescriptorSet>          mRTDescriptorSets;
-
-    SBTHelper                       mSBT;
+    BindlessRegistry                mBindless;
 
     RTScene                         mScene;
+    VirtualTextureSystem            mVirtualTextures;
+    uint32_t                        mFrameStamp;
+    float                           mTitleUpdateTime;   // seconds since the window title was last set
+    ShaderCompiler                  mShaderCompiler;
+    float                           mShaderWatchTime;   // seconds since the shader sources were last checked
     vulkanhelpers::Image            mEnvTexture;
     VkDescriptorImageInfo           mEnvTextureDescInfo;
+    vulkanhelpers::Buffer           mEnvCdfBuffer;
+    bool                            mEnvLighting;
+
+    // debug views
+    bool                            mCostHeatmap;
+    float                           mHeatmapScale;      // cost at the top of the ramp
+
+    // progressive accumulation
+    vulkanhelpers::Image            mAccumImage;
+    uint32_t                        mAccumFrame;
+    bool                            mAccumReset;
+    bool                            mAccumDiscard;      // first tiles of a restarted pass, old contents are garbage
+
+    // tiles traced this frame
+    TileScheduler                   mTileScheduler;
+    Array<TileScheduler::Tile>      mFrameTiles;
+
+    // follows the profiled trace time
+    DynamicResolution               mDynamicResolution;
+
+    // ray counters of the instrumented shaders, a slice per frame in flight
+    vulkanhelpers::Buffer           mRayStatsBuffer;
+    VkDeviceSize                    mRayStatsSliceSize;
+    float                           mMraysPerSecond;    // smoothed over the recent frames
 
     // camera a& user input
     Camera                          mCamera;
+    CameraPath                      mCameraPath;        // benchmark only
     vulkanhelpers::Buffer           mCameraBuffer;
+    VkDeviceSize                    mCameraSliceSize;
     bool                            mWKeyDown;
     bool                            mAKeyDown;
     bool                            mSKeyDown;
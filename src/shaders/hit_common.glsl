@@ -0,0 +1,56 @@
+// included by the primary ray closest hit shaders, everything they need to know about the surface that was hit
+
+layout(set = SWS_MESHES_SET, binding = SWS_MESHES_BINDING, std430) readonly buffer MeshesBuffer {
+    uvec4 Meshes[];         // bindless slots: x - material IDs, y - attribs, z - faces, w - the instance's material
+};
+
+layout(set = SWS_MATERIALS_SET, binding = SWS_MATERIALS_BINDING, std430) readonly buffer MaterialsBuffer {
+    MaterialParams Materials[];
+};
+
+// all views of the same bindless array
+layout(set = SWS_RESOURCES_SET, binding = SWS_RESOURCES_BUFFERS_BINDING, std430) readonly buffer MatIDsBuffer {
+    uint MatIDs[];
+} MatIDsArray[];
+
+layout(set = SWS_RESOURCES_SET, binding = SWS_RESOURCES_BUFFERS_BINDING, std430) readonly buffer AttribsBuffer {
+    VertexAttribute VertexAttribs[];
+} AttribsArray[];
+
+layout(set = SWS_RESOURCES_SET, binding = SWS_RESOURCES_BUFFERS_BINDING, std430) readonly buffer FacesBuffer {
+    uvec4 Faces[];
+} FacesArray[];
+
+layout(location = SWS_LOC_PRIMARY_RAY) rayPayloadInEXT RayPayload PrimaryRay;
+                                       hitAttributeEXT vec2 HitAttribs;
+
+struct HitSurface {
+    vec3  normal;
+    vec2  uv;
+    uint  matID;            // of the triangle, the instance's material is Meshes[].w
+    uvec4 face;
+};
+
+HitSurface FetchHitSurface() {
+    const vec3 barycentrics = vec3(1.0f - HitAttribs.x - HitAttribs.y, HitAttribs.x, HitAttribs.y);
+
+    const uvec4 mesh = Meshes[gl_InstanceCustomIndexEXT];
+
+    HitSurface surface;
+    surface.matID = MatIDsArray[nonuniformEXT(mesh.x)].MatIDs[gl_PrimitiveID];
+    surface.face = FacesArray[nonuniformEXT(mesh.z)].Faces[gl_PrimitiveID];
+
+    VertexAttribute v0 = AttribsArray[nonuniformEXT(mesh.y)].VertexAttribs[int(surface.face.x)];
+    VertexAttribute v1 = AttribsArray[nonuniformEXT(mesh.y)].VertexAttribs[int(surface.face.y)];
+    VertexAttribute v2 = AttribsArray[nonuniformEXT(mesh.y)].VertexAttribs[int(surface.face.z)];
+
+    // interpolate our vertex attribs
+    surface.normal = normalize(BaryLerp(v0.normal.xyz, v1.normal.xyz, v2.normal.xyz, barycentrics));
+    surface.uv = BaryLerp(v0.uv.xy, v1.uv.xy, v2.uv.xy, barycentrics);
+
+    return surface;
+}
+
+MaterialParams GetInstanceMaterial() {
+    return Materials[Meshes[gl_InstanceCustomIndexEXT].w];
+}
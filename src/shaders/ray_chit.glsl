@@ -5,42 +5,96 @@
 
 #include "../shared_with_shaders.h"
 
-layout(set = SWS_MATIDS_SET, binding = 0, std430) readonly buffer MatIDsBuffer {
-    uint MatIDs[];
-} MatIDsArray[];
+#include "hit_common.glsl"
 
-layout(set = SWS_ATTRIBS_SET, binding = 0, std430) readonly buffer AttribsBuffer {
-    VertexAttribute VertexAttribs[];
-} AttribsArray[];
+layout(set = SWS_CAMDATA_SET, binding = SWS_CAMDATA_BINDING, std140) uniform AppData {
+    UniformParams Params;
+};
 
-layout(set = SWS_FACES_SET, binding = 0, std430) readonly buffer FacesBuffer {
-    uvec4 Faces[];
-} FacesArray[];
+// virtual textures
+layout(set = SWS_TEXTURES_SET, binding = SWS_VT_POOL_BINDING) uniform sampler2D VTPagePool;
 
-layout(set = SWS_TEXTURES_SET, binding = 0) uniform sampler2D TexturesArray[];
+layout(set = SWS_TEXTURES_SET, binding = SWS_VT_TEXTURES_BINDING, std430) readonly buffer VTTexturesBuffer {
+    uvec4 VTTextures[];     // x - width, y - height, z - num mips, w - first page
+};
 
-layout(location = SWS_LOC_PRIMARY_RAY) rayPayloadInEXT RayPayload PrimaryRay;
-                                       hitAttributeEXT vec2 HitAttribs;
+layout(set = SWS_TEXTURES_SET, binding = SWS_VT_PAGE_TABLE_BINDING, std430) readonly buffer VTPageTableBuffer {
+    uint VTPageTable[];     // slot x | (slot y << 16), or SWS_VT_PAGE_NOT_RESIDENT
+};
 
-void main() {
-    const vec3 barycentrics = vec3(1.0f - HitAttribs.x - HitAttribs.y, HitAttribs.x, HitAttribs.y);
+// this frame's slice, the pages requested this frame
+layout(set = SWS_TEXTURES_SET, binding = SWS_VT_FEEDBACK_BINDING, std430) buffer VTFeedbackBuffer {
+    uint VTNumRequests;
+    uint VTRequests[SWS_VT_MAX_REQUESTS];
+};
+
+layout(set = SWS_TEXTURES_SET, binding = SWS_VT_PAGE_STAMPS_BINDING, std430) buffer VTPageStampsBuffer {
+    uint VTPageStamps[];    // frame stamp of the last request, so a page goes on the list once per frame
+};
+
+uint VTPagesAlong(uint size, uint mip) {
+    return (max(size >> mip, 1u) + SWS_VT_PAGE_SIZE - 1u) / SWS_VT_PAGE_SIZE;
+}
+
+uint VTPageIndex(uvec4 info, uint mip, uvec2 page) {
+    uint index = info.w;
+    for (uint m = 0u; m < mip; ++m) {
+        index += VTPagesAlong(info.x, m) * VTPagesAlong(info.y, m);
+    }
+    return index + page.y * VTPagesAlong(info.x, mip) + page.x;
+}
 
-    const uint matID = MatIDsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].MatIDs[gl_PrimitiveID];
+// requests the page for the wanted mip and samples the finest resident one
+vec3 SampleVirtualTexture(uint texId, vec2 uv, float lod) {
+    const uvec4 info = VTTextures[texId];
+    const uint wantedMip = min(uint(max(lod, 0.0f)), info.z - 1u);
+    uv = fract(uv);
 
-    const uvec4 face = FacesArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].Faces[gl_PrimitiveID];
+    // a quarter of the pixels reports per frame, that is plenty and keeps the writes down
+    const uint frameStamp = uint(Params.vtParams.x);
+    const bool writeFeedback = ((gl_LaunchIDEXT.x + gl_LaunchIDEXT.y * 3u + frameStamp) & 3u) == 0u;
 
-    VertexAttribute v0 = AttribsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].VertexAttribs[int(face.x)];
-    VertexAttribute v1 = AttribsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].VertexAttribs[int(face.y)];
-    VertexAttribute v2 = AttribsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].VertexAttribs[int(face.z)];
+    for (uint mip = wantedMip; mip < info.z; ++mip) {
+        const vec2 levelSize = vec2(max(info.xy >> mip, uvec2(1u)));
+        const vec2 texel = uv * levelSize;
+        const uvec2 page = min(uvec2(texel) / SWS_VT_PAGE_SIZE, uvec2(VTPagesAlong(info.x, mip), VTPagesAlong(info.y, mip)) - 1u);
+        const uint pageIndex = VTPageIndex(info, mip, page);
 
-    // interpolate our vertex attribs
-    const vec3 normal = normalize(BaryLerp(v0.normal.xyz, v1.normal.xyz, v2.normal.xyz, barycentrics));
-    const vec2 uv = BaryLerp(v0.uv.xy, v1.uv.xy, v2.uv.xy, barycentrics);
+        // the plain read skips the atomic for pages already requested this frame
+        if (mip == wantedMip && writeFeedback && VTPageStamps[pageIndex] != frameStamp &&
+            atomicExchange(VTPageStamps[pageIndex], frameStamp) != frameStamp) {
+            const uint request = atomicAdd(VTNumRequests, 1u);
+            if (request < SWS_VT_MAX_REQUESTS) {
+                VTRequests[request] = pageIndex;
+            }
+        }
+
+        const uint entry = VTPageTable[pageIndex];
+        if (entry != SWS_VT_PAGE_NOT_RESIDENT) {
+            const vec2 slot = vec2(entry & 0xFFFFu, entry >> 16u);
+            const vec2 inPage = texel - vec2(page * SWS_VT_PAGE_SIZE);
+            const vec2 poolUV = (slot * float(SWS_VT_PAGE_SLOT_SIZE) + float(SWS_VT_PAGE_BORDER) + inPage) / vec2(textureSize(VTPagePool, 0));
+            return textureLod(VTPagePool, poolUV, 0.0f).rgb;
+        }
+    }
+
+    // the coarsest page is always resident, should never get here
+    return vec3(1.0f, 0.0f, 1.0f);
+}
+
+// lambertian, the surface gets lit by the raygen
+void main() {
+    const HitSurface surface = FetchHitSurface();
+    const vec3 normal = surface.normal;
 
-    const vec3 texel = textureLod(TexturesArray[nonuniformEXT(matID)], uv, 0.0f).rgb;
+    // ray cone footprint at the hit, scaled by the texel density of the triangle (stored in face.w)
+    const uint texId = Materials[surface.matID].info.y;
+    const uvec2 texSize = VTTextures[texId].xy;
+    const float coneWidth = gl_HitTEXT * Params.vtParams.y;
+    const float NdotD = max(abs(dot(normal, gl_WorldRayDirectionEXT)), 1e-3f);
+    const float lod = uintBitsToFloat(surface.face.w) + 0.5f * log2(float(texSize.x * texSize.y)) + log2(coneWidth / NdotD);
 
-    const float objId = float(gl_InstanceCustomIndexEXT);
+    const vec3 texel = SampleVirtualTexture(texId, surface.uv, lod);
 
-    PrimaryRay.colorAndDist = vec4(texel, gl_HitTEXT);
-    PrimaryRay.normalAndObjId = vec4(normal, objId);
+    PrimaryRay = PackRayPayload(texel, gl_HitTEXT, normal, false, vec3(0.0f));
 }
@@ -0,0 +1,36 @@
+#version 460
+#extension GL_EXT_ray_tracing : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "../shared_with_shaders.h"
+
+#include "hit_common.glsl"
+
+// clear dielectric (ice, glass), the path goes on in the refracted direction
+void main() {
+    const HitSurface surface = FetchHitSurface();
+    const float ior = GetInstanceMaterial().params.x;
+
+    const vec3 direction = gl_WorldRayDirectionEXT;
+    const float NdotD = dot(surface.normal, direction);
+
+    // leaving the object if we hit the back side
+    vec3 refrNormal;
+    float refrEta;
+    if (NdotD > 0.0f) {
+        refrNormal = -surface.normal;
+        refrEta = ior;
+    } else {
+        refrNormal = surface.normal;
+        refrEta = 1.0f / ior;
+    }
+
+    // past the critical angle refract gives a zero vector, that's total internal reflection
+    vec3 scatterDir = refract(direction, refrNormal, refrEta);
+    if (dot(scatterDir, scatterDir) == 0.0f) {
+        scatterDir = reflect(direction, refrNormal);
+    }
+
+    PrimaryRay = PackRayPayload(vec3(0.0f), gl_HitTEXT, surface.normal, true, scatterDir);
+}
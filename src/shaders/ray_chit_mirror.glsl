@@ -0,0 +1,15 @@
+#version 460
+#extension GL_EXT_ray_tracing : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "../shared_with_shaders.h"
+
+#include "hit_common.glsl"
+
+// perfect mirror, the path goes on in the reflected direction
+void main() {
+    const HitSurface surface = FetchHitSurface();
+
+    PrimaryRay = PackRayPayload(vec3(0.0f), gl_HitTEXT, surface.normal, true, reflect(gl_WorldRayDirectionEXT, surface.normal));
+}
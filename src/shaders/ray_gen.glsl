@@ -1,20 +1,129 @@
 #version 460
 #extension GL_EXT_ray_tracing : enable
 #extension GL_GOOGLE_include_directive : require
+#ifdef SHADER_CLOCK
+#extension GL_EXT_shader_realtime_clock : require
+#endif
 
 #include "../shared_with_shaders.h"
 
 layout(set = SWS_SCENE_AS_SET,     binding = SWS_SCENE_AS_BINDING)            uniform accelerationStructureEXT Scene;
 layout(set = SWS_RESULT_IMAGE_SET, binding = SWS_RESULT_IMAGE_BINDING, rgba8) uniform image2D ResultImage;
+layout(set = SWS_ACCUM_IMAGE_SET,  binding = SWS_ACCUM_IMAGE_BINDING, rgba32f) uniform image2D AccumImage;
 
 layout(set = SWS_CAMDATA_SET,      binding = SWS_CAMDATA_BINDING, std140)     uniform AppData {
     UniformParams Params;
 };
 
+layout(push_constant) uniform TileParams {
+    TraceTileParams Tile;
+};
+
+layout(set = SWS_ENVS_SET, binding = SWS_ENV_TEXTURE_BINDING) uniform sampler2D EnvTexture;
+layout(set = SWS_ENVS_SET, binding = SWS_ENV_CDF_BINDING, std430) readonly buffer EnvCdfBuffer {
+    uvec4 EnvCdfSize;   // x - width, y - height
+    float EnvCdf[];     // marginal CDF (height + 1), then conditional CDFs (height * (width + 1))
+};
+
+#ifdef RAY_STATS
+layout(set = SWS_RAY_STATS_SET, binding = SWS_RAY_STATS_BINDING, std430) buffer RayStatsBuffer {
+    uint RayStats[SWS_RAY_STATS_NUM_COUNTERS];
+};
+#endif
+
 layout(location = SWS_LOC_PRIMARY_RAY) rayPayloadEXT RayPayload PrimaryRay;
 layout(location = SWS_LOC_SHADOW_RAY)  rayPayloadEXT ShadowRayPayload ShadowRay;
 
-const float kBunnyRefractionIndex = 1.0f / 1.31f; // ice
+// baked per pipeline, whatever is switched off compiles out of the variant
+layout(constant_id = SWS_SC_MAX_BOUNCES) const uint MaxBounces = SWS_MAX_RECURSION;
+layout(constant_id = SWS_SC_SHADOWS) const bool ShadowsEnabled = true;
+layout(constant_id = SWS_SC_DEBUG_VIEWS) const bool DebugViewsEnabled = true;
+
+const float kSunCosConeAngle = 0.9997f;             // ~1.4 degrees, gives the shadows soft edges
+
+// PCG hash based random numbers
+uint RandomHash(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float RandomFloat(inout uint seed) {
+    seed = RandomHash(seed);
+    return float(seed) * (1.0f / 4294967296.0f);
+}
+
+// largest index i in [0, size - 2] with cdf[offset + i] <= u
+uint FindInterval(uint offset, uint size, float u) {
+    uint first = 0;
+    uint len = size - 2;
+    while (len > 0) {
+        const uint halfLen = len >> 1;
+        const uint middle = first + halfLen + 1;
+        if (EnvCdf[offset + middle] <= u) {
+            first = middle;
+            len -= halfLen + 1;
+        } else {
+            len = halfLen;
+        }
+    }
+    return first;
+}
+
+// picks a direction proportionally to the env luminance, returns the solid angle pdf
+// (the tables are always built over the lat-long source, whatever the texture mapping is)
+vec3 SampleEnvironment(vec2 rnd, out float pdf) {
+    const uint width = EnvCdfSize.x;
+    const uint height = EnvCdfSize.y;
+
+    // no tables were built, FindInterval would wrap around on them, a zero pdf skips the sample
+    if (width == 0 || height == 0) {
+        pdf = 0.0f;
+        return vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    const uint v = FindInterval(0, height + 1, rnd.y);
+    const float m0 = EnvCdf[v];
+    const float m1 = EnvCdf[v + 1];
+    const float dv = (rnd.y - m0) / max(m1 - m0, 1e-8f);
+
+    const uint rowOffset = height + 1 + v * (width + 1);
+    const uint u = FindInterval(rowOffset, width + 1, rnd.x);
+    const float c0 = EnvCdf[rowOffset + u];
+    const float c1 = EnvCdf[rowOffset + u + 1];
+    const float du = (rnd.x - c0) / max(c1 - c0, 1e-8f);
+
+    const vec2 latLongUV = vec2((float(u) + du) / float(width), (float(v) + dv) / float(height));
+
+    // inverse of the DirToLatLong
+    const float theta = latLongUV.y * MY_PI;
+    const float phi = latLongUV.x * (2.0f * MY_PI) - MY_PI;
+    const float sinTheta = sin(theta);
+
+    const float pdfUV = (c1 - c0) * float(width) * (m1 - m0) * float(height);
+    pdf = (sinTheta > 0.0f) ? (pdfUV / (2.0f * MY_PI * MY_PI * sinTheta)) : 0.0f;
+
+    return vec3(sinTheta * sin(phi), cos(theta), sinTheta * cos(phi));
+}
+
+// uniformly distributed direction inside the cone around dir
+vec3 SampleCone(vec3 dir, float cosMax, vec2 rnd) {
+    const float cosTheta = 1.0f - rnd.x * (1.0f - cosMax);
+    const float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = rnd.y * 2.0f * MY_PI;
+
+    const vec3 up = (abs(dir.y) < 0.999f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    const vec3 tangent = normalize(cross(up, dir));
+    const vec3 bitangent = cross(dir, tangent);
+
+    return normalize(tangent * (cos(phi) * sinTheta) + bitangent * (sin(phi) * sinTheta) + dir * cosTheta);
+}
+
+// blue -> cyan -> green -> yellow -> red, t in [0, 1]
+vec3 HeatRamp(float t) {
+    t = clamp(t, 0.0f, 1.0f) * 4.0f;
+    return clamp(vec3(t - 2.0f, min(t, 4.0f - t), 2.0f - t), 0.0f, 1.0f);
+}
 
 vec3 CalcRayDir(vec2 screenUV, float aspect) {
     vec3 u = Params.camSide.xyz;
@@ -30,12 +139,25 @@ vec3 CalcRayDir(vec2 screenUV, float aspect) {
 }
 
 void main() {
-    const vec2 curPixel = vec2(gl_LaunchIDEXT.xy);
-    const vec2 bottomRight = vec2(gl_LaunchSizeEXT.xy - 1);
+#ifdef SHADER_CLOCK
+    const uint startClock = clockRealtime2x32EXT().x;
+#endif
+
+    const uint sampleIndex = uint(Params.accumParams.x);
+
+    // the launch covers just one tile of the image
+    const uvec2 pixel = gl_LaunchIDEXT.xy + Tile.tileOffsetAndRenderSize.xy;
+    const uvec2 renderSize = Tile.tileOffsetAndRenderSize.zw;
+
+    uint randomSeed = RandomHash(pixel.x + pixel.y * renderSize.x + RandomHash(sampleIndex));
 
-    const vec2 uv = (curPixel / bottomRight) * 2.0f - 1.0f;
+    // first sample goes through the pixel center, the rest are jittered for anti-aliasing
+    const vec2 curPixel = vec2(pixel);
+    const vec2 subPixel = (sampleIndex == 0) ? vec2(0.5f) : vec2(RandomFloat(randomSeed), RandomFloat(randomSeed));
 
-    const float aspect = float(gl_LaunchSizeEXT.x) / float(gl_LaunchSizeEXT.y);
+    const vec2 uv = ((curPixel + subPixel) / vec2(renderSize)) * 2.0f - 1.0f;
+
+    const float aspect = float(renderSize.x) / float(renderSize.y);
 
     vec3 origin = Params.camPos.xyz;
     vec3 direction = CalcRayDir(uv, aspect);
@@ -45,14 +167,19 @@ void main() {
 
     const uint cullMask = 0xFF;
 
-    const uint stbRecordStride = 1;
+    // one geometry per BLAS, the stride just has to skip over the ray types
+    const uint stbRecordStride = SWS_NUM_RAY_TYPES;
 
     const float tmin = 0.0f;
     const float tmax = Params.camNearFarFov.y;
 
     vec3 finalColor = vec3(0.0f);
 
-    for (int i = 0; i < SWS_MAX_RECURSION; ++i) {
+    // for the instrumented variant and the cost heatmap
+    uint numPathRays = 0;
+    uint numShadowRays = 0;
+
+    for (uint i = 0u; i < MaxBounces; ++i) {
         traceRayEXT(Scene,
                     rayFlags,
                     cullMask,
@@ -64,62 +191,91 @@ void main() {
                     direction,
                     tmax,
                     SWS_LOC_PRIMARY_RAY);
+        ++numPathRays;
 
-        const vec3 hitColor = PrimaryRay.colorAndDist.rgb;
-        const float hitDistance = PrimaryRay.colorAndDist.w;
+        const vec2 hitColorBAndScatter = unpackHalf2x16(PrimaryRay.colorBAndScatter);
+        const vec3 hitColor = vec3(unpackHalf2x16(PrimaryRay.colorRG), hitColorBAndScatter.x);
+        const float hitDistance = PrimaryRay.distance;
 
         // if hit background - quit
         if (hitDistance < 0.0f) {
             finalColor += hitColor;
             break;
         } else {
-            const vec3 hitNormal = PrimaryRay.normalAndObjId.xyz;
-            const float objectId = PrimaryRay.normalAndObjId.w;
-
+            const vec3 hitNormal = UnpackUnitVector(PrimaryRay.normal);
             const vec3 hitPos = origin + direction * hitDistance;
 
-            if (objectId == OBJECT_ID_TEAPOT) {
-                // our teapot is mirror, so reflect and continue
-
-                origin = hitPos + hitNormal * 0.001f;
-                direction = reflect(direction, hitNormal);
-            } else if (objectId == OBJECT_ID_BUNNY) {
-                // our bunny is made of ice, so refract and continue
-
-                const float NdotD = dot(hitNormal, direction);
-
-                vec3 refrNormal = hitNormal;
-                float refrEta;
-
-                if(NdotD > 0.0f) {
-                    refrNormal = -hitNormal;
-                    refrEta = 1.0f / kBunnyRefractionIndex;
-                } else {
-                    refrNormal = hitNormal;
-                    refrEta = kBunnyRefractionIndex;
-                }
-
+            // mirrors and glass were handled by their hit shaders, the path just goes on
+            if (hitColorBAndScatter.y > 0.0f) {
+                direction = UnpackUnitVector(PrimaryRay.scatterDir);
                 origin = hitPos + direction * 0.001f;
-                direction = refract(direction, refrNormal, refrEta);
             } else {
                 // we hit diffuse primitive - simple lambertian
 
-                const vec3 toLight = normalize(Params.sunPosAndAmbient.xyz);
+                const vec2 sunRnd = vec2(RandomFloat(randomSeed), RandomFloat(randomSeed));
+                const vec3 toLight = SampleCone(normalize(Params.sunPosAndAmbient.xyz), kSunCosConeAngle, sunRnd);
                 const vec3 shadowRayOrigin = hitPos + hitNormal * 0.001f;
 
-                traceRayEXT(Scene,
-                            shadowRayFlags,
-                            cullMask,
-                            SWS_SHADOW_HIT_SHADERS_IDX,
-                            stbRecordStride,
-                            SWS_SHADOW_MISS_SHADERS_IDX,
-                            shadowRayOrigin,
-                            0.0f,
-                            toLight,
-                            tmax,
-                            SWS_LOC_SHADOW_RAY);
+                float sunVisibility = 1.0f;
+                if (ShadowsEnabled) {
+                    traceRayEXT(Scene,
+                                shadowRayFlags,
+                                cullMask,
+                                SWS_SHADOW_HIT_SHADERS_IDX,
+                                stbRecordStride,
+                                SWS_SHADOW_MISS_SHADERS_IDX,
+                                shadowRayOrigin,
+                                0.0f,
+                                toLight,
+                                tmax,
+                                SWS_LOC_SHADOW_RAY);
+                    ++numShadowRays;
+
+                    sunVisibility = (ShadowRay.distance > 0.0f) ? 0.0f : 1.0f;
+                }
 
-                const float lighting = (ShadowRay.distance > 0.0f) ? Params.sunPosAndAmbient.w : max(Params.sunPosAndAmbient.w, dot(hitNormal, toLight));
+                const float sunLight = sunVisibility * max(0.0f, dot(hitNormal, toLight));
+
+                vec3 lighting;
+                if (Params.envLightParams.x > 0.0f) {
+                    // one importance sampled light from the environment instead of the constant ambient
+                    float envPdf;
+                    const vec2 rnd = vec2(RandomFloat(randomSeed), RandomFloat(randomSeed));
+                    const vec3 envDir = SampleEnvironment(rnd, envPdf);
+                    const float NdotE = dot(hitNormal, envDir);
+
+                    vec3 envLight = vec3(0.0f);
+                    if (NdotE > 0.0f && envPdf > 0.0f) {
+                        bool envVisible = true;
+                        if (ShadowsEnabled) {
+                            traceRayEXT(Scene,
+                                        shadowRayFlags,
+                                        cullMask,
+                                        SWS_SHADOW_HIT_SHADERS_IDX,
+                                        stbRecordStride,
+                                        SWS_SHADOW_MISS_SHADERS_IDX,
+                                        shadowRayOrigin,
+                                        0.0f,
+                                        envDir,
+                                        tmax,
+                                        SWS_LOC_SHADOW_RAY);
+                            ++numShadowRays;
+
+                            envVisible = (ShadowRay.distance < 0.0f);
+                        }
+
+                        if (envVisible) {
+                            // filtered importance sampling, a sample stands for 1 / pdf steradians of the sky
+                            const float envLod = EnvLodForSolidAngle(1.0f / envPdf, float(textureSize(EnvTexture, 0).x));
+                            const vec3 envRadiance = textureLod(EnvTexture, EnvDirToUV(envDir), envLod).rgb;
+                            envLight = envRadiance * (NdotE / (MY_PI * envPdf)) * Params.envLightParams.y;
+                        }
+                    }
+
+                    lighting = envLight + vec3(sunLight);
+                } else {
+                    lighting = vec3(max(Params.sunPosAndAmbient.w, sunLight));
+                }
 
                 finalColor += hitColor * lighting;
 
@@ -128,5 +284,43 @@ void main() {
         }
     }
 
-    imageStore(ResultImage, ivec2(gl_LaunchIDEXT.xy), vec4(LinearToSrgb(finalColor), 1.0f));
+#ifdef SHADER_CLOCK
+    // low halves are enough, a pixel takes nowhere near 2^32 ticks
+    const float pixelCost = float(clockRealtime2x32EXT().x - startClock);
+#else
+    const float pixelCost = float(numPathRays + numShadowRays);
+#endif
+
+    // running average of everything traced since the last reset
+    const ivec2 pixelCoord = ivec2(pixel);
+    if (DebugViewsEnabled && Params.debugParams.x > 0.0f) {
+        // the accumulation image holds the average cost while the heatmap is on
+        float cost = pixelCost;
+        if (sampleIndex > 0) {
+            cost = mix(imageLoad(AccumImage, pixelCoord).r, cost, 1.0f / float(sampleIndex + 1));
+        }
+
+        imageStore(AccumImage, pixelCoord, vec4(cost, 0.0f, 0.0f, 1.0f));
+        imageStore(ResultImage, pixelCoord, vec4(HeatRamp(cost / Params.debugParams.y), 1.0f));
+    } else {
+        if (sampleIndex > 0) {
+            const vec3 prevColor = imageLoad(AccumImage, pixelCoord).rgb;
+            finalColor = mix(prevColor, finalColor, 1.0f / float(sampleIndex + 1));
+        }
+
+        imageStore(AccumImage, pixelCoord, vec4(finalColor, 1.0f));
+        imageStore(ResultImage, pixelCoord, vec4(LinearToSrgb(finalColor), 1.0f));
+    }
+
+#ifdef RAY_STATS
+    // counted per pixel first, so it's a handful of atomics per invocation rather than one per ray
+    atomicAdd(RayStats[SWS_RAY_STATS_PRIMARY], 1u);
+    if (numPathRays > 1) {
+        atomicAdd(RayStats[SWS_RAY_STATS_SECONDARY], numPathRays - 1);
+    }
+    if (numShadowRays > 0) {
+        atomicAdd(RayStats[SWS_RAY_STATS_SHADOW], numShadowRays);
+    }
+    atomicAdd(RayStats[SWS_RAY_STATS_DEPTHS + numPathRays - 1], 1u);
+#endif
 }
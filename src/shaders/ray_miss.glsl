@@ -4,23 +4,19 @@
 
 #include "../shared_with_shaders.h"
 
-layout(set = SWS_ENVS_SET, binding = 0) uniform sampler2D EnvTexture;
+layout(set = SWS_CAMDATA_SET, binding = SWS_CAMDATA_BINDING, std140) uniform AppData {
+    UniformParams Params;
+};
 
-layout(location = SWS_LOC_PRIMARY_RAY) rayPayloadInEXT RayPayload PrimaryRay;
-
-const float MY_PI = 3.1415926535897932384626433832795;
-const float MY_INV_PI  = 1.0 / MY_PI;
-
-vec2 DirToLatLong(vec3 dir) {
-    float phi = atan(dir.x, dir.z);
-    float theta = acos(dir.y);
+layout(set = SWS_ENVS_SET, binding = SWS_ENV_TEXTURE_BINDING) uniform sampler2D EnvTexture;
 
-    return vec2((MY_PI + phi) * (0.5 / MY_PI), theta * MY_INV_PI);
-}
+layout(location = SWS_LOC_PRIMARY_RAY) rayPayloadInEXT RayPayload PrimaryRay;
 
 void main() {
-    vec2 uv = DirToLatLong(gl_WorldRayDirectionEXT);
-    vec3 envColor = textureLod(EnvTexture, uv, 0.0).rgb;
-    PrimaryRay.colorAndDist = vec4(envColor, -1.0);
-    PrimaryRay.normalAndObjId = vec4(0.0);
+    vec2 uv = EnvDirToUV(gl_WorldRayDirectionEXT);
+    // the pixel's footprint, the ray cone doesn't widen much off the flat mirrors and the glass in the scene
+    const float pixelSolidAngle = Params.vtParams.y * Params.vtParams.y;
+    const float lod = EnvLodForSolidAngle(pixelSolidAngle, float(textureSize(EnvTexture, 0).x));
+    vec3 envColor = textureLod(EnvTexture, uv, lod).rgb;
+    PrimaryRay = PackRayPayload(envColor, -1.0f, vec3(0.0f), false, vec3(0.0f));
 }
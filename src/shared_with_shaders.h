@@ -6,11 +6,19 @@
 #include "framework/common.h"
 #endif // __cplusplus
 
-//
+// hit groups go in pairs, one per ray type, and every material type has its own pair:
+// hit group = material type * SWS_NUM_RAY_TYPES + ray type, the instance SBT offset selects the pair
 #define SWS_PRIMARY_HIT_SHADERS_IDX     0
 #define SWS_PRIMARY_MISS_SHADERS_IDX    0
 #define SWS_SHADOW_HIT_SHADERS_IDX      1
 #define SWS_SHADOW_MISS_SHADERS_IDX     1
+#define SWS_NUM_RAY_TYPES               2
+
+// material types, each one shaded by its own closest hit shader
+#define SWS_MATERIAL_LAMBERT            0
+#define SWS_MATERIAL_MIRROR             1
+#define SWS_MATERIAL_DIELECTRIC         2
+#define SWS_NUM_MATERIAL_TYPES          3
 
 // resource locations
 #define SWS_SCENE_AS_SET                0
@@ -19,14 +27,44 @@
 #define SWS_RESULT_IMAGE_BINDING        1
 #define SWS_CAMDATA_SET                 0
 #define SWS_CAMDATA_BINDING             2
-
-#define SWS_MATIDS_SET                  1
-#define SWS_ATTRIBS_SET                 2
-#define SWS_FACES_SET                   3
-#define SWS_TEXTURES_SET                4
-#define SWS_ENVS_SET                    5
-
-#define SWS_NUM_SETS                    6
+#define SWS_MESHES_SET                  0
+#define SWS_MESHES_BINDING              3
+#define SWS_ACCUM_IMAGE_SET             0
+#define SWS_ACCUM_IMAGE_BINDING         4
+#define SWS_RAY_STATS_SET               0
+#define SWS_RAY_STATS_BINDING           5
+#define SWS_MATERIALS_SET               0
+#define SWS_MATERIALS_BINDING           6
+
+#define SWS_RESOURCES_SET               1
+#define SWS_TEXTURES_SET                2
+#define SWS_ENVS_SET                    3
+
+#define SWS_NUM_SETS                    4
+
+// bindless array, must match BindlessRegistry
+#define SWS_RESOURCES_BUFFERS_BINDING   0
+
+#define SWS_VT_POOL_BINDING             0
+#define SWS_VT_TEXTURES_BINDING         1
+#define SWS_VT_PAGE_TABLE_BINDING       2
+#define SWS_VT_FEEDBACK_BINDING         3
+#define SWS_VT_PAGE_STAMPS_BINDING      4
+
+#define SWS_ENV_TEXTURE_BINDING         0
+#define SWS_ENV_CDF_BINDING             1
+
+// how the environment texture is laid out
+#define SWS_ENV_MAPPING_LATLONG         0
+#define SWS_ENV_MAPPING_OCTAHEDRAL      1
+#define SWS_ENV_MAPPING                 SWS_ENV_MAPPING_OCTAHEDRAL
+
+// virtual texturing, must match VirtualTextureSystem
+#define SWS_VT_PAGE_SIZE                128
+#define SWS_VT_PAGE_BORDER              4
+#define SWS_VT_PAGE_SLOT_SIZE           (SWS_VT_PAGE_SIZE + 2 * SWS_VT_PAGE_BORDER)
+#define SWS_VT_PAGE_NOT_RESIDENT        0xFFFFFFFFu
+#define SWS_VT_MAX_REQUESTS             4096    // per frame, a feedback slice is the count plus this many page ids
 
 // cross-shader locations
 #define SWS_LOC_PRIMARY_RAY             0
@@ -35,25 +73,49 @@
 
 #define SWS_MAX_RECURSION               10
 
-#define OBJECT_ID_BUNNY                 0.0f
-#define OBJECT_ID_PLANE                 1.0f
-#define OBJECT_ID_TEAPOT                2.0f
+// raygen specialization constant ids, the app bakes a pipeline per combination it uses
+#define SWS_SC_MAX_BOUNCES              0   // path length cap, up to SWS_MAX_RECURSION
+#define SWS_SC_SHADOWS                  1   // sun and env light visibility rays
+#define SWS_SC_DEBUG_VIEWS              2   // cost heatmap
+
+// ray statistics counters, only the instrumented raygen variant (RAY_STATS defined) writes them
+#define SWS_RAY_STATS_PRIMARY           0
+#define SWS_RAY_STATS_SECONDARY         1   // reflections and refractions
+#define SWS_RAY_STATS_SHADOW            2
+#define SWS_RAY_STATS_DEPTHS            4   // histogram of path lengths, SWS_MAX_RECURSION entries
+#define SWS_RAY_STATS_NUM_COUNTERS      (SWS_RAY_STATS_DEPTHS + SWS_MAX_RECURSION)
+
 
 
+// goes through every trace, so it's packed tight (PackRayPayload below), 20 bytes
 struct RayPayload {
-    vec4 colorAndDist;
-    vec4 normalAndObjId;
+    uint  colorRG;          // half floats
+    uint  colorBAndScatter; // half floats: blue, then 1 if the path goes on (mirror, glass), 0 - the surface gets lit
+    uint  normal;           // octahedral, 16 bits per axis
+    uint  scatterDir;       // octahedral, where the path goes on
+    float distance;         // < 0 - missed
 };
 
 struct ShadowRayPayload {
     float distance;
 };
 
+// ray generation push constants, every launch covers one tile of the image
+struct TraceTileParams {
+    uvec4 tileOffsetAndRenderSize;  // xy - tile offset, zw - full render resolution
+};
+
 struct VertexAttribute {
     vec4 normal;
     vec4 uv;
 };
 
+// a material of the scene, the instances point at theirs through the mesh slots
+struct MaterialParams {
+    uvec4 info;             // x - material type, y - virtual texture
+    vec4  params;           // x - index of refraction (dielectric)
+};
+
 // packed std140
 struct UniformParams {
     // Lighting
@@ -65,6 +127,18 @@ struct UniformParams {
     vec4 camUp;
     vec4 camSide;
     vec4 camNearFarFov;
+
+    // Environment lighting
+    vec4 envLightParams;    // x - enabled, y - intensity
+
+    // Virtual texturing
+    vec4 vtParams;          // x - frame stamp, y - pixel spread angle
+
+    // Progressive accumulation
+    vec4 accumParams;       // x - samples accumulated so far (0 - start over)
+
+    // Debug views
+    vec4 debugParams;       // x - cost heatmap instead of color, y - cost at the top of the ramp
 };
 
 
@@ -89,4 +163,73 @@ vec3 LinearToSrgb(vec3 linear) {
     return vec3(LinearToSrgb(linear.r), LinearToSrgb(linear.g), LinearToSrgb(linear.b));
 }
 
+#ifndef __cplusplus
+const float MY_PI = 3.1415926535897932384626433832795;
+const float MY_INV_PI  = 1.0 / MY_PI;
+
+vec2 DirToLatLong(vec3 dir) {
+    float phi = atan(dir.x, dir.z);
+    float theta = acos(dir.y);
+
+    return vec2((MY_PI + phi) * (0.5 / MY_PI), theta * MY_INV_PI);
+}
+
+vec2 SignNotZero(vec2 v) {
+    return vec2((v.x >= 0.0f) ? 1.0f : -1.0f, (v.y >= 0.0f) ? 1.0f : -1.0f);
+}
+
+// no trigonometry, lower hemisphere is folded over the diagonals
+vec2 DirToOctahedral(vec3 dir) {
+    vec2 p = dir.xy * (1.0f / (abs(dir.x) + abs(dir.y) + abs(dir.z)));
+    if (dir.z < 0.0f) {
+        p = (1.0f - abs(p.yx)) * SignNotZero(p);
+    }
+    return p * 0.5f + 0.5f;
+}
+
+vec2 EnvDirToUV(vec3 dir) {
+#if SWS_ENV_MAPPING == SWS_ENV_MAPPING_OCTAHEDRAL
+    return DirToOctahedral(dir);
+#else
+    return DirToLatLong(dir);
+#endif
+}
+
+// mip of the octahedral env map whose texels cover the given solid angle, its texels are close enough to equal area
+// (a lat-long env only has the top level, any lod lands there)
+float EnvLodForSolidAngle(float solidAngle, float envSize) {
+    const float texelSolidAngle = 4.0f * MY_PI / (envSize * envSize);
+    return max(0.0f, 0.5f * log2(solidAngle / texelSolidAngle));
+}
+
+vec3 OctahedralToDir(vec2 uv) {
+    const vec2 p = uv * 2.0f - 1.0f;
+    vec3 dir = vec3(p, 1.0f - abs(p.x) - abs(p.y));
+    if (dir.z < 0.0f) {
+        dir.xy = (1.0f - abs(dir.yx)) * SignNotZero(dir.xy);
+    }
+    return normalize(dir);
+}
+
+// 16 bits per axis, the error stays well under a hundredth of a degree
+uint PackUnitVector(vec3 dir) {
+    return packUnorm2x16(DirToOctahedral(dir));
+}
+
+vec3 UnpackUnitVector(uint packed) {
+    return OctahedralToDir(unpackUnorm2x16(packed));
+}
+
+// normal only matters for a hit and scatterDir only if the path goes on, they have to be unit vectors then
+RayPayload PackRayPayload(vec3 color, float distance, vec3 normal, bool scatters, vec3 scatterDir) {
+    RayPayload payload;
+    payload.colorRG = packHalf2x16(color.rg);
+    payload.colorBAndScatter = packHalf2x16(vec2(color.b, scatters ? 1.0f : 0.0f));
+    payload.normal = (distance >= 0.0f) ? PackUnitVector(normal) : 0u;    // a miss has no normal
+    payload.scatterDir = scatters ? PackUnitVector(scatterDir) : 0u;
+    payload.distance = distance;
+    return payload;
+}
+#endif // __cplusplus
+
 #endif // SHARED_WITH_SHADERS_H